@@ -0,0 +1,15 @@
+#ifndef ALLOCCOUNT_H
+#define ALLOCCOUNT_H
+
+/* Counts the calls to the global operator new, per thread. The counting
+ * operator new only goes in builds with DRRT_COUNT_ALLOCATIONS (a test
+ * build, every allocation of the program pays for it), other builds do not
+ * count. Memory taken from a GraphArena or JListPool only shows up here when
+ * the pool takes a new slab
+ */
+
+// Returns how many times this thread has called operator new, or -1 if
+// the build does not count
+long AllocationCount();
+
+#endif // ALLOCCOUNT_H
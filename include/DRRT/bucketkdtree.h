@@ -0,0 +1,590 @@
+#ifndef BUCKETKDTREE_H
+#define BUCKETKDTREE_H
+
+#include <DRRT/statickdtree.h>
+
+/* A KD-Tree whose leaves hold up to BucketSize points instead of one.
+ * The points of a bucket are stored struct-of-arrays in a shared pool
+ * (all x's, then all y's, ...) so the Metric can score a whole bucket at
+ * once with Metric::ScoreBlock (see DubinsMetric). Full leaves are split
+ * at the median of the split dimension with the largest spread. Leaves
+ * whose points cannot be told apart along any split dimension are chained
+ * to more buckets instead. Points are identified by the same index as in
+ * FlatKDTree (insertion order, node->kd_index_). As in FlatKDTree, a
+ * subtree that gets too lopsided (more than balance_ of its points on one
+ * side) is rebuilt when an insert lands too deep, here by gathering its
+ * points into one leaf and splitting that until the leaves fit a bucket.
+ * Points are kept as Coord, the queries and distances are in double
+ */
+template <int Dim, class Metric, int BucketSize = 32>
+class BucketKDTree : public NNStorage {
+public:
+    typedef Eigen::Matrix<double,Dim,1> Point;   // a query
+    typedef Eigen::Matrix<Coord,Dim,1> Stored;   // a point in a bucket
+    typedef std::vector<Stored, Eigen::aligned_allocator<Stored>> Points;
+
+    double balance_;            // largest fraction of a subtree that may
+                                // be on one side before it is rebuilt
+    Metric metric_;             // distance function to use
+
+    // Tree nodes, a node is a leaf if bucket_[n] != -1
+    std::vector<int> split_dim_;      // splitting dimension of each node
+    std::vector<Coord> split_value_;  // position along split_dim_
+    std::vector<int> child_L_;        // index of left child or -1
+    std::vector<int> child_R_;        // index of right child or -1
+    std::vector<int> bucket_;         // first bucket of a leaf or -1
+    std::vector<int> count_;          // number of points under each node
+    std::vector<int> free_nodes_;     // nodes released by rebuilds
+
+    // Bucket pool, bucket b holds bucket_size_[b] points
+    std::vector<Coord> coords_;       // Dim*BucketSize values per bucket
+    std::vector<int> ids_;            // BucketSize point indices per bucket
+    std::vector<int> bucket_size_;    // number of points used in a bucket
+    std::vector<int> bucket_next_;    // next bucket in the chain or -1
+    std::vector<int> free_buckets_;   // buckets released by splits
+
+    // Constructor
+    BucketKDTree() : balance_(0.75) {}
+
+    // Reserves space for n points so inserting does not reallocate
+    void Reserve(int n) override
+    {
+        int buckets = 2*n/BucketSize + 1;  // leaves are at least half full
+        coords_.reserve(buckets*Dim*BucketSize);
+        ids_.reserve(buckets*BucketSize);
+        bucket_size_.reserve(buckets);
+        bucket_next_.reserve(buckets);
+        handles_.reserve(n);
+    }
+
+    // Inserts node into the tree and returns its index
+    int Insert(std::shared_ptr<KDTreeNode> &node) override
+    {
+        int index = tree_size_;
+        Stored position = node->position_.cast<Coord>();
+        handles_.push_back(node);
+        node->kd_index_ = index;
+
+        if( split_dim_.empty() ) NewLeaf();
+
+        // Walk down to the leaf, splitting full leaves on the way if they
+        // can be split, and count the point in every node on the path
+        path_.clear();
+        int n = 0;
+        while( true ) {
+            if( bucket_[n] == -1 ) {
+                path_.push_back(n);
+                n = (position(split_dim_[n]) < split_value_[n])
+                        ? child_L_[n] : child_R_[n];
+            } else if( !LeafFull(n) || !SplitLeaf(n) ) {
+                break;
+            }
+        }
+        AddToLeaf(n, position, index);
+        count_[n] += 1;
+        for( int i = 0; i < (int)path_.size(); i++ ) count_[path_[i]] += 1;
+
+        tree_size_ += 1;
+        double leaves = 2.0*tree_size_/BucketSize;
+        if( path_.size() > std::log(leaves)/std::log(1.0/balance_) ) {
+            Rebalance();
+        }
+        return index;
+    }
+
+    // Removes the point at index from its leaf
+    void Remove(int index) override
+    {
+        Stored position = handles_[index]->position_.cast<Coord>();
+        handles_[index].reset();
+
+        int n = 0;
+        while( bucket_[n] == -1 ) {
+            count_[n] -= 1;
+            n = (position(split_dim_[n]) < split_value_[n])
+                    ? child_L_[n] : child_R_[n];
+        }
+        count_[n] -= 1;
+
+        // Find the last point of the leaf and the slot of the removed one
+        int slot = -1, last = bucket_[n], before = -1;
+        for( int b = bucket_[n]; b != -1; b = bucket_next_[b] ) {
+            for( int i = 0; i < bucket_size_[b]; i++ ) {
+                if( ids_[b*BucketSize + i] == index ) slot = b*BucketSize + i;
+            }
+            if( bucket_next_[b] != -1 ) before = b;
+            last = b;
+        }
+
+        // Move the last point into the slot and drop an emptied bucket
+        int end = last*BucketSize + bucket_size_[last] - 1;
+        for( int j = 0; j < Dim; j++ ) {
+            coords_[(slot/BucketSize)*Dim*BucketSize + j*BucketSize
+                    + slot%BucketSize]
+                    = coords_[last*Dim*BucketSize + j*BucketSize
+                              + end%BucketSize];
+        }
+        ids_[slot] = ids_[end];
+        bucket_size_[last] -= 1;
+        if( bucket_size_[last] == 0 && before != -1 ) {
+            bucket_next_[before] = -1;
+            free_buckets_.push_back(last);
+        }
+    }
+
+    // Drops the removed points, gives the others the indices 0,1,... in
+    // the order given (updating their kd_index_) and rebuilds the tree
+    void Renumber(const std::vector<int> &order) override
+    {
+        const int size = (int)order.size();
+        Points points(size);
+        std::vector<int> indices(size);
+        std::vector<std::shared_ptr<KDTreeNode>> handles(size);
+        for( int i = 0; i < size; i++ ) {
+            handles[i] = std::move(handles_[order[i]]);
+            handles[i]->kd_index_ = i;
+            points[i] = handles[i]->position_.cast<Coord>();
+            indices[i] = i;
+        }
+        tree_size_ = size;
+        handles_.swap(handles);
+        Clear();
+        Refill(0, points, indices);
+    }
+
+    // Appends nodes and splits all of the points into leaves again from
+    // a single one (parallel is ignored, the leaves share the buckets)
+    void BulkInsert(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                    bool parallel=false) override
+    {
+        for( int i = 0; i < (int)nodes.size(); i++ ) {
+            handles_.push_back(nodes[i]);
+            nodes[i]->kd_index_ = tree_size_ + i;
+        }
+        tree_size_ += (int)nodes.size();
+
+        Points points;
+        std::vector<int> indices;
+        points.reserve(tree_size_);
+        indices.reserve(tree_size_);
+        for( int i = 0; i < tree_size_; i++ ) {
+            if( !handles_[i] ) continue;
+            points.push_back(handles_[i]->position_.cast<Coord>());
+            indices.push_back(i);
+        }
+        Clear();
+        Refill(0, points, indices);
+    }
+
+    // Returns the index of the point at exactly pos, or -1 if not present
+    int FindExact(const Point &pos) const
+    {
+        if( tree_size_ == 0 ) return -1;
+        Stored stored = pos.template cast<Coord>();
+        int leaf = FindLeaf(stored, 0);
+        for( int b = bucket_[leaf]; b != -1; b = bucket_next_[b] ) {
+            const Coord *block = &coords_[b*Dim*BucketSize];
+            for( int i = 0; i < bucket_size_[b]; i++ ) {
+                bool same = true;
+                for( int j = 0; j < Dim && same; j++ ) {
+                    same = (block[j*BucketSize + i] == stored(j));
+                }
+                if( same ) return ids_[b*BucketSize + i];
+            }
+        }
+        return -1;
+    }
+
+    int FindExact(const Eigen::VectorXd &pos) const override
+    { return FindExact(Point(pos)); }
+
+    // Updates nearest and nearestDist if there is a point closer to
+    // queryPoint than nearestDist (nearest may start as -1)
+    // scratch.Skip decides which subtrees are searched
+    void FindNearest(const Point &queryPoint, int &nearest,
+                     double &nearestDist, KDQueryScratch &scratch) const
+    {
+        if( tree_size_ == 0 ) return;
+        double dist[BucketSize];
+
+        scratch.stack_.clear();
+        scratch.stack_.push_back(std::make_pair(0, 0.0));
+        while( !scratch.stack_.empty() ) {
+            int n = scratch.stack_.back().first;
+            double bound = scratch.stack_.back().second;
+            scratch.stack_.pop_back();
+            if( scratch.Skip(bound, nearestDist) ) continue;
+
+            if( bucket_[n] == -1 ) {
+                PushChildren(queryPoint, n, bound, scratch);
+                continue;
+            }
+            if( count_[n] > 0 ) scratch.visits_++;   // emptied by Remove
+            for( int b = bucket_[n]; b != -1; b = bucket_next_[b] ) {
+                metric_.ScoreBlock(queryPoint, &coords_[b*Dim*BucketSize],
+                                   BucketSize, bucket_size_[b], dist);
+                for( int i = 0; i < bucket_size_[b]; i++ ) {
+                    if( dist[i] < nearestDist ) {
+                        nearest = ids_[b*BucketSize + i];
+                        nearestDist = dist[i];
+                    }
+                }
+            }
+        }
+    }
+
+    // Appends (index, distance) of every point closer than range to
+    // queryPoint to scratch.hits_
+    void FindWithinRange(const Point &queryPoint, double range,
+                         KDQueryScratch &scratch) const
+    {
+        if( tree_size_ == 0 ) return;
+        double dist[BucketSize];
+
+        scratch.stack_.clear();
+        scratch.stack_.push_back(std::make_pair(0, 0.0));
+        while( !scratch.stack_.empty() ) {
+            int n = scratch.stack_.back().first;
+            double bound = scratch.stack_.back().second;
+            scratch.stack_.pop_back();
+            if( bound >= range || scratch.Skip(bound, range) ) continue;
+
+            if( bucket_[n] == -1 ) {
+                PushChildren(queryPoint, n, bound, scratch);
+                continue;
+            }
+            if( count_[n] > 0 ) scratch.visits_++;   // emptied by Remove
+            for( int b = bucket_[n]; b != -1; b = bucket_next_[b] ) {
+                metric_.ScoreBlock(queryPoint, &coords_[b*Dim*BucketSize],
+                                   BucketSize, bucket_size_[b], dist);
+                for( int i = 0; i < bucket_size_[b]; i++ ) {
+                    if( dist[i] < range ) {
+                        scratch.hits_.push_back(
+                                std::make_pair(ids_[b*BucketSize + i], dist[i]));
+                    }
+                }
+            }
+        }
+    }
+
+    // Maintains scratch.heap_ as a max-heap (by distance) of the k points
+    // closest to queryPoint, points in the heap are marked in scratch
+    void FindKNearest(const Point &queryPoint, int k,
+                      KDQueryScratch &scratch) const
+    {
+        DaryHeap<KNNOrder> &heap = scratch.heap_;
+        if( tree_size_ == 0 || k <= 0 ) return;
+        double dist[BucketSize];
+
+        scratch.stack_.clear();
+        scratch.stack_.push_back(std::make_pair(0, 0.0));
+        while( !scratch.stack_.empty() ) {
+            int n = scratch.stack_.back().first;
+            double bound = scratch.stack_.back().second;
+            scratch.stack_.pop_back();
+
+            // Worst distance in the heap, INF until there are k points in it
+            double worstDist = (heap.Size() < k) ? INF : heap.Top().key_;
+            if( bound > worstDist ) continue;
+
+            if( bucket_[n] == -1 ) {
+                PushChildren(queryPoint, n, bound, scratch);
+                continue;
+            }
+            for( int b = bucket_[n]; b != -1; b = bucket_next_[b] ) {
+                metric_.ScoreBlock(queryPoint, &coords_[b*Dim*BucketSize],
+                                   BucketSize, bucket_size_[b], dist);
+                for( int i = 0; i < bucket_size_[b]; i++ ) {
+                    int index = ids_[b*BucketSize + i];
+                    if( dist[i] >= worstDist || !scratch.Mark(index) ) continue;
+                    if( heap.Size() == k ) heap.Pop();
+                    heap.Push(dist[i], index);
+                    worstDist = (heap.Size() < k) ? INF : heap.Top().key_;
+                }
+            }
+        }
+    }
+
+    // The NNStorage versions of the queries above
+    void FindNearest(const Eigen::VectorXd &queryPoint, int &nearest,
+                     double &nearestDist,
+                     KDQueryScratch &scratch) const override
+    { FindNearest(Point(queryPoint), nearest, nearestDist, scratch); }
+
+    void FindWithinRange(const Eigen::VectorXd &queryPoint, double range,
+                         KDQueryScratch &scratch) const override
+    { FindWithinRange(Point(queryPoint), range, scratch); }
+
+    void FindKNearest(const Eigen::VectorXd &queryPoint, int k,
+                      KDQueryScratch &scratch) const override
+    { FindKNearest(Point(queryPoint), k, scratch); }
+
+    bool WrapsItself() const override { return Metric::kWrapsItself; }
+
+private:
+    std::vector<int> path_;           // nodes above the last insert
+
+    // Adds an empty leaf node and returns its index, reusing one released
+    // by a rebuild if possible
+    int NewLeaf()
+    {
+        if( !free_nodes_.empty() ) {
+            int n = free_nodes_.back();
+            free_nodes_.pop_back();
+            child_L_[n] = -1;
+            child_R_[n] = -1;
+            bucket_[n] = NewBucket();
+            count_[n] = 0;
+            return n;
+        }
+        split_dim_.push_back(0);
+        split_value_.push_back(0.0);
+        child_L_.push_back(-1);
+        child_R_.push_back(-1);
+        bucket_.push_back(NewBucket());
+        count_.push_back(0);
+        return (int)bucket_.size() - 1;
+    }
+
+    // Returns an empty bucket, reusing one released by a split if possible
+    int NewBucket()
+    {
+        int b;
+        if( !free_buckets_.empty() ) {
+            b = free_buckets_.back();
+            free_buckets_.pop_back();
+        } else {
+            b = (int)bucket_size_.size();
+            coords_.resize(coords_.size() + Dim*BucketSize);
+            ids_.resize(ids_.size() + BucketSize);
+            bucket_size_.push_back(0);
+            bucket_next_.push_back(-1);
+        }
+        bucket_size_[b] = 0;
+        bucket_next_[b] = -1;
+        return b;
+    }
+
+    // Walks down from node n to the leaf that position belongs in
+    int FindLeaf(const Stored &position, int n) const
+    {
+        while( bucket_[n] == -1 ) {
+            n = (position(split_dim_[n]) < split_value_[n])
+                    ? child_L_[n] : child_R_[n];
+        }
+        return n;
+    }
+
+    // Returns true if every bucket of the leaf is full
+    bool LeafFull(int leaf) const
+    {
+        int b = bucket_[leaf];
+        while( bucket_next_[b] != -1 ) b = bucket_next_[b];
+        return bucket_size_[b] == BucketSize;
+    }
+
+    // Adds the point to the last bucket of the leaf, chaining a new
+    // bucket if that one is full
+    void AddToLeaf(int leaf, const Stored &position, int index)
+    {
+        int b = bucket_[leaf];
+        while( bucket_next_[b] != -1 ) b = bucket_next_[b];
+        if( bucket_size_[b] == BucketSize ) {
+            int next = NewBucket();
+            bucket_next_[b] = next;
+            b = next;
+        }
+        int i = bucket_size_[b];
+        for( int j = 0; j < Dim; j++ ) {
+            coords_[b*Dim*BucketSize + j*BucketSize + i] = position(j);
+        }
+        ids_[b*BucketSize + i] = index;
+        bucket_size_[b] += 1;
+    }
+
+    // Turns the leaf into an internal node with two leaf children.
+    // Returns false (and leaves it alone) if all of its points have the
+    // same value in every split dimension
+    bool SplitLeaf(int leaf)
+    {
+        Points points;
+        std::vector<int> indices;
+        Collect(leaf, points, indices);
+
+        // Split along the dimension with the largest spread
+        int split = 0;
+        double spread = -1.0;
+        for( int j = 0; j < Metric::kSplitDims; j++ ) {
+            double lo = INF, hi = -INF;
+            for( int i = 0; i < (int)points.size(); i++ ) {
+                lo = std::min(lo, (double)points[i](j));
+                hi = std::max(hi, (double)points[i](j));
+            }
+            if( hi - lo > spread ) {
+                spread = hi - lo;
+                split = j;
+            }
+        }
+        if( spread <= 0.0 ) return false;
+
+        // Median, moved up past the minimum so neither side is empty
+        std::vector<Coord> values;
+        for( int i = 0; i < (int)points.size(); i++ ) {
+            values.push_back(points[i](split));
+        }
+        std::nth_element(values.begin(), values.begin() + values.size()/2,
+                         values.end());
+        Coord value = values[values.size()/2];
+        if( value == *std::min_element(values.begin(), values.end()) ) {
+            Coord above = INF;
+            for( int i = 0; i < (int)values.size(); i++ ) {
+                if( values[i] > value ) above = std::min(above, values[i]);
+            }
+            value = above;
+        }
+
+        // Release the buckets of the leaf and make the two children
+        Release(leaf);
+        int left = NewLeaf();
+        int right = NewLeaf();
+        split_dim_[leaf] = split;
+        split_value_[leaf] = value;
+        child_L_[leaf] = left;
+        child_R_[leaf] = right;
+
+        for( int i = 0; i < (int)points.size(); i++ ) {
+            int child = (points[i](split) < value) ? left : right;
+            AddToLeaf(child, points[i], indices[i]);
+            count_[child] += 1;
+        }
+        return true;
+    }
+
+    // Appends the points under node n (and their indices) to points
+    void Collect(int n, Points &points, std::vector<int> &indices) const
+    {
+        std::vector<int> stack(1, n);
+        while( !stack.empty() ) {
+            n = stack.back();
+            stack.pop_back();
+            if( bucket_[n] == -1 ) {
+                stack.push_back(child_L_[n]);
+                stack.push_back(child_R_[n]);
+                continue;
+            }
+            for( int b = bucket_[n]; b != -1; b = bucket_next_[b] ) {
+                const Coord *block = &coords_[b*Dim*BucketSize];
+                for( int i = 0; i < bucket_size_[b]; i++ ) {
+                    Stored p;
+                    for( int j = 0; j < Dim; j++ ) p(j) = block[j*BucketSize + i];
+                    points.push_back(p);
+                    indices.push_back(ids_[b*BucketSize + i]);
+                }
+            }
+        }
+    }
+
+    // Releases every bucket and node under node n (but not n itself),
+    // which is left as an internal node without children
+    void Release(int n)
+    {
+        std::vector<int> stack(1, n);
+        while( !stack.empty() ) {
+            int m = stack.back();
+            stack.pop_back();
+            if( m != n ) free_nodes_.push_back(m);
+            if( bucket_[m] == -1 ) {
+                if( child_L_[m] != -1 ) stack.push_back(child_L_[m]);
+                if( child_R_[m] != -1 ) stack.push_back(child_R_[m]);
+                continue;
+            }
+            for( int b = bucket_[m]; b != -1; b = bucket_next_[b] ) {
+                free_buckets_.push_back(b);
+            }
+        }
+        bucket_[n] = -1;
+        child_L_[n] = -1;
+        child_R_[n] = -1;
+    }
+
+    // Drops every node and bucket, leaving a single empty leaf
+    void Clear()
+    {
+        split_dim_.clear();
+        split_value_.clear();
+        child_L_.clear();
+        child_R_.clear();
+        bucket_.clear();
+        count_.clear();
+        free_nodes_.clear();
+        coords_.clear();
+        ids_.clear();
+        bucket_size_.clear();
+        bucket_next_.clear();
+        free_buckets_.clear();
+        NewLeaf();
+    }
+
+    // Rebuilds the lowest subtree on path_ that has more than balance_
+    // of its points on one side. Its points are put back into a single
+    // leaf that is then split at medians until the leaves fit a bucket
+    void Rebalance()
+    {
+        int p = (int)path_.size() - 1;
+        for( ; p >= 0; p-- ) {
+            int n = path_[p];
+            int most = std::max(count_[child_L_[n]], count_[child_R_[n]]);
+            if( most > balance_*count_[n] ) break;
+        }
+        if( p < 0 ) return;
+
+        int n = path_[p];
+        Points points;
+        std::vector<int> indices;
+        Collect(n, points, indices);
+        Release(n);
+        bucket_[n] = NewBucket();
+        Refill(n, points, indices);
+    }
+
+    // Puts the points into the empty leaf n and splits it at medians
+    // until the leaves fit in a bucket
+    void Refill(int n, const Points &points, const std::vector<int> &indices)
+    {
+        for( int i = 0; i < (int)points.size(); i++ ) {
+            AddToLeaf(n, points[i], indices[i]);
+        }
+        count_[n] = (int)points.size();
+
+        std::vector<int> stack(1, n);
+        while( !stack.empty() ) {
+            int m = stack.back();
+            stack.pop_back();
+            if( count_[m] > BucketSize && SplitLeaf(m) ) {
+                stack.push_back(child_L_[m]);
+                stack.push_back(child_R_[m]);
+            }
+        }
+    }
+
+    // Pushes the children of internal node n onto the traversal stack, the
+    // far side first (bounded by the hyperplane distance) so the near side
+    // is searched first
+    void PushChildren(const Point &queryPoint, int n, double bound,
+                      KDQueryScratch &scratch) const
+    {
+        double hyperPlaneDist = queryPoint(split_dim_[n]) - split_value_[n];
+        int nearChild = child_R_[n];
+        int farChild = child_L_[n];
+        if( hyperPlaneDist < 0 ) std::swap(nearChild, farChild);
+
+        scratch.stack_.push_back(
+                    std::make_pair(farChild, std::abs(hyperPlaneDist)));
+        scratch.stack_.push_back(std::make_pair(nearChild, bound));
+    }
+};
+
+// The bucketed tree used for the [x,y,theta] Dubin's space
+typedef BucketKDTree<3, DubinsMetric> DubinsBucketKDTree;
+
+#endif // BUCKETKDTREE_H
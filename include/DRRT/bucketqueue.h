@@ -0,0 +1,66 @@
+#ifndef BUCKETQUEUE_H
+#define BUCKETQUEUE_H
+
+#include <DRRT/kdtreenode.h>
+
+/* A bucket queue for keys that are bounded, like costs on a grid. Bucket i
+ * holds the nodes with keys in [i*width_, (i+1)*width_), keys past the last
+ * bucket go in the last one. Adding and removing a node is O(1) and a pop
+ * only looks at the lowest bucket that is not empty, taking the smallest
+ * key in it, so nodes still come out in exact key order. Keys may be added
+ * in any order (the lowest bucket is tracked both ways). A node's slot is
+ * kept in its priority_queue_index_ field and in_priority_queue_ marks it,
+ * so a node is in at most one queue at a time
+ */
+class BucketQueue {
+public:
+    // Constructor, keys go up to about max_key
+    BucketQueue(double max_key, double width=1.0);
+
+    BucketQueue(const BucketQueue&) = delete;
+    BucketQueue& operator=(const BucketQueue&) = delete;
+
+    // Returns true if node is in the queue
+    static bool marked(const std::shared_ptr<KDTreeNode> &node)
+    { return node->in_priority_queue_; }
+
+    // Returns the number of nodes in the queue
+    int Size() const { return size_; }
+
+    // Adds node with key, returns false if it already is in the queue
+    bool Add(const std::shared_ptr<KDTreeNode> &node, double key);
+
+    // Removes the node with the smallest key and sets node to it,
+    // returns false if the queue is empty
+    bool Pop(std::shared_ptr<KDTreeNode> &node);
+
+    // Removes node, returns false if it is not in the queue
+    bool Remove(const std::shared_ptr<KDTreeNode> &node);
+
+    // Removes every node
+    void Clear();
+
+private:
+    struct Entry {
+        double key_;
+        int slot_;
+    };
+
+    double width_;
+    std::vector<std::vector<Entry>> buckets_;
+    int lowest_;    // no bucket below this one has nodes
+    int size_;
+
+    std::vector<std::shared_ptr<KDTreeNode>> nodes_; // slot -> node
+    std::vector<int> bucket_of_;                      // slot -> bucket
+    std::vector<int> position_of_;                    // slot -> in bucket
+    std::vector<int> free_slots_;                     // slots not in use
+
+    // Returns the bucket key belongs in
+    int BucketOf(double key) const;
+
+    // Takes the entry at position out of bucket and frees its slot
+    void Take(int bucket, int position);
+};
+
+#endif // BUCKETQUEUE_H
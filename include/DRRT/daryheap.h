@@ -0,0 +1,141 @@
+#ifndef DARYHEAP_H
+#define DARYHEAP_H
+
+#include <vector>
+
+// An entry of a DaryHeap
+struct HeapEntry {
+    double key_;        // cached priority
+    int id_;            // what the entry stands for
+    int tie_;           // breaks ties between equal keys (if the order
+                        // looks at it)
+};
+
+/* A D-ary heap of (key, id, tie) entries stored inline in one array, so
+ * sifting compares cached keys instead of following pointers to whatever
+ * the ids stand for. With D = 4 the children of an entry share a cache
+ * line and the heap is half as deep as a binary one. Order decides what
+ * comes first and is told where entries move:
+ *   bool Before(const HeapEntry &a, const HeapEntry &b) const
+ *   void Moved(const HeapEntry &entry, int position)
+ * which is what lets a caller that tracks positions change the key of an
+ * entry that is in the middle of the heap (see Update)
+ */
+template <class Order, int D=4>
+class DaryHeap {
+public:
+    typedef HeapEntry Entry;
+
+    std::vector<Entry> entries_;    // the heap, top at 0
+    Order order_;
+
+    // Constructor
+    DaryHeap(Order order=Order()) : order_(order) {}
+
+    int Size() const { return (int)entries_.size(); }
+    bool Empty() const { return entries_.empty(); }
+    const Entry& Top() const { return entries_.front(); }
+    const Entry& At(int position) const { return entries_[position]; }
+    void Clear() { entries_.clear(); }
+    void Reserve(int n) { entries_.reserve(n); }
+
+    // Adds an entry
+    void Push(double key, int id, int tie=0)
+    {
+        Entry entry = {key, id, tie};
+        entries_.push_back(entry);
+        SiftUp((int)entries_.size() - 1);
+    }
+
+    // Removes the top entry and returns it
+    Entry Pop()
+    {
+        Entry top = entries_.front();
+        Remove(0);
+        return top;
+    }
+
+    // Removes the entry at position
+    void Remove(int position)
+    {
+        int last = (int)entries_.size() - 1;
+        if( position != last ) {
+            entries_[position] = entries_[last];
+            entries_.pop_back();
+            order_.Moved(entries_[position], position);
+            Restore(position);
+        } else {
+            entries_.pop_back();
+        }
+    }
+
+    // Changes the key (and tie) of the entry at position, in either
+    // direction, and moves it to where it now belongs
+    void Update(int position, double key, int tie=0)
+    {
+        entries_[position].key_ = key;
+        entries_[position].tie_ = tie;
+        Restore(position);
+    }
+
+    // Moves the entry at position up or down to where it belongs
+    void Restore(int position)
+    {
+        if( position > 0 && order_.Before(entries_[position],
+                                          entries_[(position - 1)/D]) ) {
+            SiftUp(position);
+        } else {
+            SiftDown(position);
+        }
+    }
+
+    // Returns true if every entry comes after its parent
+    bool Valid() const
+    {
+        for( int i = 1; i < (int)entries_.size(); i++ ) {
+            if( order_.Before(entries_[i], entries_[(i - 1)/D]) ) return false;
+        }
+        return true;
+    }
+
+private:
+    // Moves the entry at position up past the parents it comes before
+    void SiftUp(int position)
+    {
+        Entry entry = entries_[position];
+        while( position > 0 ) {
+            int parent = (position - 1)/D;
+            if( !order_.Before(entry, entries_[parent]) ) break;
+            entries_[position] = entries_[parent];
+            order_.Moved(entries_[position], position);
+            position = parent;
+        }
+        entries_[position] = entry;
+        order_.Moved(entry, position);
+    }
+
+    // Moves the entry at position down past the children that come
+    // before it, always swapping with the one that comes first
+    void SiftDown(int position)
+    {
+        const int size = (int)entries_.size();
+        Entry entry = entries_[position];
+        while( true ) {
+            int first = D*position + 1;
+            if( first >= size ) break;
+            int last = (first + D < size) ? first + D : size;
+            int best = first;
+            for( int c = first + 1; c < last; c++ ) {
+                if( order_.Before(entries_[c], entries_[best]) ) best = c;
+            }
+            if( !order_.Before(entries_[best], entry) ) break;
+            entries_[position] = entries_[best];
+            order_.Moved(entries_[position], position);
+            position = best;
+        }
+        entries_[position] = entry;
+        order_.Moved(entry, position);
+    }
+};
+
+#endif // DARYHEAP_H
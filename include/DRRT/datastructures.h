@@ -3,20 +3,25 @@
 
 
 #include <DRRT/list.h>
+#include <DRRT/obstacleregistry.h>
+#include <DRRT/grapharena.h>
 #include <DRRT/heap.h>
 #include <DRRT/edge.h> // includes jlist.h which includes
                        // obstacle.h which includes distancefunctions.h
 /// Include implementation of desired edge here
 #include <DRRT/dubinsedge.h>
 
+class WorkerPool;
+
 // For holding triangles
 typedef Eigen::Matrix<double,Eigen::Dynamic,6> MatrixX6d;
 
 class ConfigSpace : public std::enable_shared_from_this<ConfigSpace> {
 public:
-    std::mutex cspace_mutex_;         // mutex for accessing obstacle List
+    std::mutex cspace_mutex_;         // mutex for accessing obstacles_
+    std::shared_ptr<GraphArena> arena_; // memory for the nodes and edges
     int num_dimensions_;              // dimensions
-    std::shared_ptr<List> obstacles_; // a list of obstacles
+    std::shared_ptr<ObstacleRegistry> obstacles_; // the obstacles
     bool obstacles_moved_;
     double obs_delta_; // the granularity of obstacle checks on edges
     Eigen::VectorXd lower_bounds_; // 1xD vector containing the lower bounds
@@ -36,6 +41,8 @@ public:
     std::vector<std::shared_ptr<Edge>> collisions_; // edges known to be in
                                                   // collision with an obstacle
     std::vector<std::shared_ptr<Edge>> trajectories_;
+    std::vector<std::shared_ptr<KDTreeNode>> viz_nodes_; // the nodes of the
+                                    // edges above, which only point at them
 
     double (*distanceFunction)(Eigen::VectorXd a, Eigen::VectorXd b);
 
@@ -109,7 +116,8 @@ public:
                                                    bt_broadphase_,
                                                    bt_collision_configuration_);
 
-        obstacles_ = std::make_shared<List>();
+        obstacles_ = std::make_shared<ObstacleRegistry>();
+        arena_ = std::make_shared<GraphArena>();
 
         hyper_volume_ = 0.0; // flag indicating this needs to be calculated
         in_warmup_time_ = false;
@@ -134,14 +142,15 @@ public:
 //        std::lock_guard<std::mutex> lock(this->cspace_mutex_);
         // For adding a trajectory edge to the vizualiser
         if(vis) {
-            for(int k = 1; k < edge->trajectory_.rows(); k++) {
-                Eigen::VectorXd _start_point = edge->trajectory_.row(k-1);
-                Eigen::VectorXd _end_point = edge->trajectory_.row(k);
+            const Eigen::MatrixXd &trajectory = edge->Trajectory();
+            for(int k = 1; k < trajectory.rows(); k++) {
+                Eigen::VectorXd _start_point = trajectory.row(k-1);
+                Eigen::VectorXd _end_point = trajectory.row(k);
 
                 std::shared_ptr<KDTreeNode> _s
-                        = std::make_shared<KDTreeNode>(_start_point);
+                        = MakeInArena<KDTreeNode>(this->arena_, _start_point);
                 std::shared_ptr<KDTreeNode> _e
-                        = std::make_shared<KDTreeNode>(_end_point);
+                        = MakeInArena<KDTreeNode>(this->arena_, _end_point);
 
                 double _angle = atan2(_end_point(1) - _start_point(1),
                                       _end_point(0) - _start_point(0));
@@ -153,7 +162,9 @@ public:
 
                 std::shared_ptr<Edge> _de
                      = Edge::NewEdge(this->GetPointer(),
-                                     std::make_shared<KDTree>(), _s, _e);
+                                     std::shared_ptr<KDTree>(), _s, _e);
+                this->viz_nodes_.push_back(_s);
+                this->viz_nodes_.push_back(_e);
                 if(type == "coll") {
                     this->collisions_.push_back(_de);
                 } else if(type == "traj") {
@@ -178,16 +189,54 @@ public:
                                     this->trajectories_.end(),edge),
                         this->trajectories_.end());
         }
+
+        // Let go of the nodes of the edges that are gone
+        this->viz_nodes_.clear();
+        for(int i = 0; i < (int)this->collisions_.size(); i++) {
+            this->viz_nodes_.push_back(this->collisions_[i]->start_node_->GetPointer());
+            this->viz_nodes_.push_back(this->collisions_[i]->end_node_->GetPointer());
+        }
+        for(int i = 0; i < (int)this->trajectories_.size(); i++) {
+            this->viz_nodes_.push_back(this->trajectories_[i]->start_node_->GetPointer());
+            this->viz_nodes_.push_back(this->trajectories_[i]->end_node_->GetPointer());
+        }
     }
 };
 
+// Decides which nodes PruneGraph removes from the graph and the KD-Tree
+// and how often the main loop calls it
+typedef struct PrunePolicy{
+    bool prune_cost;    // drop nodes whose rrt_LMC_ is above move_goal_'s
+    double window;      // drop nodes further than this from the robot
+                        // in x,y (0 = no window)
+    double period;      // seconds between prunes (0 = never prune)
+    double last_prune;  // time_elapsed_ at the last prune
+
+    // Constructor
+    PrunePolicy() : prune_cost(false), window(0.0), period(0.0),
+        last_prune(0.0)
+    {}
+} PrunePolicy;
+
 typedef struct Queue{
     std::mutex queuetex;
     std::string type;
     std::shared_ptr<ConfigSpace> cspace;
-    std::shared_ptr<BinaryHeap> priority_queue; // nodes to be rewired
+    std::shared_ptr<PriorityQueue> priority_queue; // nodes to be rewired
     std::shared_ptr<JList> obs_successors; // obstacle successor list
     double change_thresh; // threshold of local changes that we care about
+    PrunePolicy prune_policy; // used by PruneGraph
+    int k_nearest;      // if > 0, Extend links new nodes to this many nearest
+                        // nodes instead of all nodes in the hyper ball
+    double relayout_period; // seconds between KDCompact(true) calls in the
+                            // main loop (0 = never)
+    double last_relayout;   // time_elapsed_ at the last one
+    double min_node_spacing; // Extend drops samples closer than this to a
+                             // node already in the tree (0 = keep all)
+    int reduce_threads;     // threads ReduceInconsistency may use on a long
+                            // queue (< 2 = one)
+    std::shared_ptr<WorkerPool> reduce_pool; // those threads, started the
+                                             // first time they are needed
 
 } Queue;
 
@@ -200,17 +249,16 @@ typedef struct RrtNodeNeighborIterator{
 
     int list_flag;          // flag with the following values:
                             //  0: uninitialized
-                            //  1: successors
-                            //  2: original neighbors
-                            //  3: current neighbors
+                            //  1: original neighbors
+                            //  2: current neighbors
+                            //  3: done
 
-    std::shared_ptr<JListNode> current_item; // a pointer to the position in
-                                             // the current neighbor list we
-                                             // are iterating through
+    int current_item;       // index of the position in the current
+                            // neighbor list we are iterating through
 
     // Constructor
     RrtNodeNeighborIterator( std::shared_ptr<KDTreeNode> &node ):
-        this_node(node), list_flag(0)
+        this_node(node), list_flag(0), current_item(-1)
     {}
 
 } RrtNodeNeighborIterator;
@@ -257,6 +305,8 @@ typedef struct RobotData{
     std::shared_ptr<Edge> robot_edge; // this is the edge that contains the
                                      // trajectory that the
                                      // robot is currently following
+    std::shared_ptr<KDTreeNode> robot_node; // keeps the start of robot_edge
+                                           // alive when it is not in the tree
 
     bool robot_edge_used; // true if robot_edge is populated;
 
@@ -25,6 +25,19 @@
 #define MAXPATHNODES 1000
 #define DELTA 10 // should be changed if delta is changed in executable
 
+// Scalar the stored copies of coordinates are kept in (the nearest neighbor
+// storages and the cached geometry of edges). Costs and distances are
+// always worked out in double. DRRT_FLOAT_STORAGE only narrows these
+// copies, so the storages scan twice as many points per cache line.
+// KDTreeNode::position_ stays a VectorXd, so a node in a storage still has
+// its coordinates twice and takes more memory than in the pointer tree,
+// which keeps no copy
+#ifdef DRRT_FLOAT_STORAGE
+typedef float Coord;
+#else
+typedef double Coord;
+#endif
+
 /* Returns the distance between two points in the projection of a Dubin's space
  * that contains [X Y T] depending on if time is being used or not.
  * This is useful for calculating the distance between two points that are close
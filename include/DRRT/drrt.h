@@ -26,6 +26,22 @@ public:
     Eigen::VectorXi wraps;              // wrapping dimensions (0=1st)
     Eigen::VectorXd wrap_points;        // points at which they wrap
     int num_threads;                    // number of main loop threads to spawn
+    std::string kd_tree_storage;        // "pointer", "flat", "dubins",
+                                        // "bucket" or "grid"
+    double grid_cell_size;              // cell width of "grid" (0 = delta)
+    bool prune_cost;                    // prune nodes costlier than robot
+    double prune_window;                // prune nodes this far from robot
+    double prune_period;                // seconds between prunes (0 = off)
+    double relayout_period;             // seconds between Z-order relayouts
+                                        // of the KD-Tree (0 = off)
+    int k_nearest;                      // neighbors per new node (0 = use
+                                        // the hyper ball instead)
+    double min_node_spacing;            // drop samples this close to a node
+                                        // (0 = off, else indexes positions)
+    int reduce_threads;                 // threads that propagate cost
+                                        // changes (< 2 = one)
+    double approx_epsilon;              // approximate nearest/range search
+    int approx_budget;                  // (see KDTree::SetApproximation)
 
     // Constructor
     Problem(std::string se_t,
@@ -51,7 +67,18 @@ public:
             move_robot_flag(m_r_f),
             wraps(w),
             wrap_points(w_p),
-            num_threads(n)
+            num_threads(n),
+            kd_tree_storage("pointer"),
+            grid_cell_size(0.0),
+            prune_cost(false),
+            prune_window(0.0),
+            prune_period(0.0),
+            relayout_period(0.0),
+            k_nearest(0),
+            min_node_spacing(0.0),
+            reduce_threads(0),
+            approx_epsilon(0.0),
+            approx_budget(0)
     {}
 } Problem;
 
@@ -127,7 +154,7 @@ bool Extend(std::shared_ptr<KDTree> &Tree,
 /////////////////////// RRT* Functions ///////////////////////
 // Functions used for RRT*. Some of these are also used in RRT# and RRTx
 
-/* This looks through the list to find the best parent for newNode
+/* This looks through near_nodes to find the best parent for newNode
  * If the list is empty then it uses closestNode instead. If a parent
  * is found then newNode is linked to its parent. If saveAllEdges is true
  * then it saves a copy of each edge in each node (to avoid work duplication
@@ -137,7 +164,7 @@ bool Extend(std::shared_ptr<KDTree> &Tree,
 void FindBestParent(std::shared_ptr<ConfigSpace> &C,
                     std::shared_ptr<KDTree> &Tree,
                     std::shared_ptr<KDTreeNode> &new_node,
-                    std::shared_ptr<JList> &node_list,
+                    KDResults &near_nodes,
                     std::shared_ptr<KDTreeNode> &closest_node,
                     bool save_all_edges );
 
@@ -146,7 +173,7 @@ void FindBestParent(std::shared_ptr<ConfigSpace> &C,
 // Functions used for RRT#. Some of these are also used in RRTx
 
 // Resets the neighbor iterator
-void ResetNeighborIterator(std::shared_ptr<RrtNodeNeighborIterator> &It);
+void ResetNeighborIterator(RrtNodeNeighborIterator &It);
 
 // Links an edge -from- node -to- newNeighbor
 // Edge should already be populated correctly.
@@ -185,6 +212,19 @@ void ReduceInconsistency(std::shared_ptr<Queue> &Q,
                          std::shared_ptr<KDTreeNode> &root,
                          double hyper_ball_rad);
 
+// The same with several threads that take nodes near the top of a relaxed
+// queue (see MultiQueue) and lock the nodes they change. Nodes may be
+// processed out of order, which can cost some extra work, and neighbor
+// lists are not culled. ReduceInconsistency hands long queues to this when
+// Q->reduce_threads > 1. The threads are started on the first call and kept
+// in Q->reduce_pool
+void ParallelReduceInconsistency(std::shared_ptr<Queue> &Q,
+                                 std::shared_ptr<KDTreeNode> &goal_node,
+                                 double robot_rad,
+                                 std::shared_ptr<KDTreeNode> &root,
+                                 double hyper_ball_rad,
+                                 int threads);
+
 
 /////////////////////// RRTx Functions ///////////////////////
 // Functions used for RRTx
@@ -212,18 +252,21 @@ void CullCurrentNeighbors(std::shared_ptr<KDTreeNode> &node,
                           double hyper_ball_rad);
 
 // RRTx based version
-// Returns the JListNode containing the next outgoing neighbor edge of the
-// node for which this iterator was created
-std::shared_ptr<JListNode> NextOutNeighbor(
-        std::shared_ptr<RrtNodeNeighborIterator> &It);
+// Returns the next outgoing neighbor edge of the node for which this
+// iterator was created, initial neighbors first, or NULL when there are
+// no more
+std::shared_ptr<Edge>* NextOutNeighbor(RrtNodeNeighborIterator &It);
 
 // RRTx based version
-// Returns the JListNode containing the next outgoing neighbor edge of the
-// node for which this iterator was created
-std::shared_ptr<JListNode> NextInNeighbor(
-        std::shared_ptr<RrtNodeNeighborIterator> &It);
-
-// Makes newParent the parent of node via the edge
+// Returns the next incoming neighbor edge of the node for which this
+// iterator was created, initial neighbors first, or NULL when there are
+// no more
+std::shared_ptr<Edge>* NextInNeighbor(RrtNodeNeighborIterator &It);
+
+// Makes newParent the parent of node via the edge. This takes no locks, a
+// caller that runs alongside other threads (ParallelReduceInconsistency)
+// must hold the NodeLocks of node, its old parent and new_parent while the
+// successor lists are relinked
 void MakeParentOf(std::shared_ptr<KDTreeNode> &new_parent,
                   std::shared_ptr<KDTreeNode> &node,
                   std::shared_ptr<Edge> &edge);
@@ -274,5 +317,19 @@ void FindNewTarget(std::shared_ptr<ConfigSpace> &C,
                     std::shared_ptr<RobotData> &Robot,
                     double hyper_ball_rad);
 
+/* Removes the nodes selected by Q->prune_policy from the graph and the
+ * KD-Tree: nodes with a higher cost than the robot (they can no longer
+ * be on its path to the goal) and nodes outside the window around the
+ * robot. The root, the move goal's path to it and the nodes the robot is
+ * moving between are kept. Successors that are kept lose their parent and are handed to
+ * PropogateDescendants like nodes cut off by an obstacle. The KD-Tree is
+ * compacted once it holds more removed than live nodes.
+ * The caller holds Q->queuetex, cspace_mutex_ and tree_mutex_.
+ * Returns the number of nodes removed
+ */
+int PruneGraph(std::shared_ptr<Queue> &Q,
+               std::shared_ptr<KDTree> &Tree,
+               std::shared_ptr<RobotData> &Robot);
+
 
 #endif // DRRT_H
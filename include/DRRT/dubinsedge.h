@@ -8,25 +8,43 @@
 // #include this file in datastructures.h
 // Remember to implement Edge::NewEdge(Eigen::VectorXd,Eigen::VectorXd)
 
+/* A Dubin's edge keeps its path the way CalculateTrajectory found it: the
+ * word in edge_type_, the pose the path starts from, the length of each of
+ * its three parts and the turn radius. Trajectory() samples it into a
+ * buffer of the calling thread that is reused until another edge is
+ * sampled there. The path is kept as Coord, its dist_ and w_dist_ are
+ * worked out in double first
+ */
 class DubinsEdge : public Edge
 {
 public:
+    Coord path_start_[3];       // x, y, heading where the path starts
+    Coord segment_length_[3];   // length of each part of edge_type_
+    Coord turn_radius_;
+    unsigned long path_id_;     // names the path in the sample buffers,
+                                // 0 if there is no path to sample
+
     // Constructors
     DubinsEdge()
-        : Edge() {}
+        : Edge(), path_id_(0) {}
 
-    DubinsEdge(std::shared_ptr<ConfigSpace> C,
-               std::shared_ptr<KDTree> Tree,
-               std::shared_ptr<KDTreeNode> start,
-               std::shared_ptr<KDTreeNode> end)
-        : Edge(C,Tree,start,end) {}
+    DubinsEdge(const std::shared_ptr<ConfigSpace> &C,
+               const std::shared_ptr<KDTree> &Tree,
+               const std::shared_ptr<KDTreeNode> &start,
+               const std::shared_ptr<KDTreeNode> &end)
+        : Edge(C,Tree,start,end), path_id_(0) {}
 
+    const Eigen::MatrixXd& Trajectory();
     bool ValidMove();
     Eigen::VectorXd PoseAtDistAlongEdge(double dist_along_edge);
     Eigen::VectorXd PoseAtTimeAlongEdge(double time_along_edge);
     void CalculateTrajectory();
     void CalculateHoverTrajectory();
     bool ExplicitEdgeCheck(std::shared_ptr<Obstacle> obstacle);
+
+private:
+    // Writes the sampled path into samples
+    void SamplePath(Eigen::MatrixXd &samples);
 };
 
 #endif // DUBINSEDGE_H
@@ -13,14 +13,16 @@
 class ConfigSpace;
 class KDTree;
 
-// Edge for a Dubin's state space
+// Edge for a Dubin's state space. An edge only points at its space, tree
+// and nodes, it does not keep them alive (GetPointer() on them does). The
+// nodes outlive every edge between them that a node holds, see KDTreeNode
 class Edge: public std::enable_shared_from_this<Edge> {
 public:
-    std::shared_ptr<ConfigSpace> cspace_;
-    std::shared_ptr<KDTree> tree_;   // k-d tree to which this edge belongs
+    ConfigSpace *cspace_;
+    KDTree *tree_;   // k-d tree to which this edge belongs
 
-    std::shared_ptr<KDTreeNode> start_node_;
-    std::shared_ptr<KDTreeNode> end_node_;
+    KDTreeNode *start_node_;
+    KDTreeNode *end_node_;
 
     // This field should be populated by Edge::CalculateTrajectory()
     double dist_;    // the distance between startNode and endNode
@@ -33,10 +35,14 @@ public:
                            // need to recalculate if this edge is removed and
                            // then added again
 
-    // pointer to this edge's location in startNode
-    std::shared_ptr<JListNode> list_item_in_start_node_;
-    // pointer to this edge's location in endNode
-    std::shared_ptr<JListNode> list_item_in_end_node_;
+    // index of this edge in startNode's out_ edges
+    int index_in_start_node_ = -1;
+    // index of this edge in endNode's in_ edges
+    int index_in_end_node_ = -1;
+    // index of this edge in the initial_out_, initial_in_ or initial_refs_
+    // edges of startNode and of endNode (see NodeEdges)
+    int index_in_start_initial_ = -1;
+    int index_in_end_initial_ = -1;
 
     double w_dist_; // this contains the distance that the robot must travel
                     // through the *workspace* along the edge (so far only
@@ -45,24 +51,24 @@ public:
     std::string edge_type_; // one of the following types:
                             // lsl, rsr, lsr, rsl, lrl, rlr
 
-    Eigen::MatrixXd trajectory_; // stores a discritized version
-                                 // of the Dubin's path
+    Eigen::MatrixXd trajectory_; // an explicit discritized path
                                  // [x y] or [x y time] (these are rows)
-                                 // depending on if time is being used
+                                 // depending on if time is being used,
+                                 // empty unless set by hand. Read the
+                                 // path through Trajectory()
 
     double velocity_; // the velocity that this robot travels along this edge
                       // only used if time is part of the state space
 
     // Constructor
-    Edge() : dist_(-1) { trajectory_ = Eigen::MatrixXd::Zero(MAXPATHNODES,3); }
-    Edge(std::shared_ptr<ConfigSpace> &CS,
-         std::shared_ptr<KDTree> &T,
-         std::shared_ptr<KDTreeNode> &s,
-         std::shared_ptr<KDTreeNode> &e)
-        : cspace_(CS), tree_(T), start_node_(s), end_node_(e)
-    {
-        trajectory_ = Eigen::MatrixXd::Zero(MAXPATHNODES,3);
-    }
+    Edge() : cspace_(NULL), tree_(NULL), start_node_(NULL), end_node_(NULL),
+        dist_(-1) {}
+    Edge(const std::shared_ptr<ConfigSpace> &CS,
+         const std::shared_ptr<KDTree> &T,
+         const std::shared_ptr<KDTreeNode> &s,
+         const std::shared_ptr<KDTreeNode> &e)
+        : cspace_(CS.get()), tree_(T.get()), start_node_(s.get()),
+          end_node_(e.get()) {}
 
     /////////////////////// Edge Functions ///////////////////////
 
@@ -70,8 +76,8 @@ public:
     // This must be implemented by all edge types!!
     static std::shared_ptr<Edge> NewEdge(std::shared_ptr<ConfigSpace> C,
                                          std::shared_ptr<KDTree> Tree,
-                                         std::shared_ptr<KDTreeNode> &start_node,
-                                         std::shared_ptr<KDTreeNode> &end_node);
+                                         const std::shared_ptr<KDTreeNode> &start_node,
+                                         const std::shared_ptr<KDTreeNode> &end_node);
 
     // Saturate moving nP within delta of cP
     // This must be implemented by all edge types!!
@@ -82,6 +88,11 @@ public:
 
     std::shared_ptr<Edge> GetPointer() { return shared_from_this(); }
 
+    // Returns the discritized path of the edge, rows as in trajectory_
+    // Edge types that keep their path in another form sample it here, the
+    // result may then only be valid until the next call on this thread
+    virtual const Eigen::MatrixXd& Trajectory() { return trajectory_; }
+
     // Returns true if the dynamics of the robot in the space will
     // allow a robot to follow the edge
     // Dubin's edge version
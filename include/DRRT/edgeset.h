@@ -0,0 +1,116 @@
+#ifndef EDGESET_H
+#define EDGESET_H
+
+#include <memory>
+#include <cmath>
+
+class KDTreeNode;
+class GraphArena;
+class Edge;
+
+/* The edges of one neighbor list of a node, kept in one array with room
+ * for kInline of them inside the set so most sets never allocate. Removing
+ * moves the last edge into the hole, which is O(1) but does not keep the
+ * order. A sorted set instead keeps its edges by increasing length
+ * (dist_original_) and shifts them on insert and remove, so the longest
+ * edges can be dropped off the end. Depending on its Kind a set keeps an
+ * index back into itself up to date for every edge it holds, that is how
+ * a given edge is removed without a search. A set that outgrows kInline
+ * takes its array from arena if it has one
+ */
+class EdgeSet {
+public:
+    static const int kInline = 4;
+
+    enum Kind {
+        kPlain,         // no index is kept
+        kOut,           // edge->index_in_start_node_
+        kIn,            // edge->index_in_end_node_
+        kInitial        // edge->index_in_start_initial_ if node is the
+                        // start of the edge, else index_in_end_initial_
+    };
+
+    // Constructor, node is the node that a kInitial set belongs to
+    EdgeSet(Kind kind=kPlain, bool sorted=false, GraphArena *arena=NULL,
+            const KDTreeNode *node=NULL)
+        : data_(inline_), size_(0), capacity_(kInline), kind_(kind),
+          sorted_(sorted), arena_(arena), node_(node) {}
+    ~EdgeSet();
+
+    EdgeSet(const EdgeSet&) = delete;
+    EdgeSet& operator=(const EdgeSet&) = delete;
+
+    int Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+    std::shared_ptr<Edge>& operator[](int i) { return data_[i]; }
+
+    // Adds edge at the end (in order if the set is sorted)
+    void Push(const std::shared_ptr<Edge> &edge);
+
+    // Removes the edge at i, moving the last edge there (or shifting the
+    // ones after it down if the set is sorted)
+    void RemoveAt(int i);
+
+    // Removes edge through its index, returns false if it is not in this
+    // set (or the set keeps no index)
+    bool Remove(const Edge *edge);
+
+    // Removes every edge
+    void Clear();
+
+private:
+    std::shared_ptr<Edge> *data_;   // inline_ until it outgrows it
+    int size_;
+    int capacity_;
+    Kind kind_;
+    bool sorted_;
+    GraphArena *arena_;             // NULL to use operator new
+    const KDTreeNode *node_;        // the node of a kInitial set
+    std::shared_ptr<Edge> inline_[kInline];
+
+    // Returns an array of capacity empty edges
+    std::shared_ptr<Edge>* NewData(int capacity);
+
+    // Frees an array from NewData
+    void DeleteData(std::shared_ptr<Edge> *data, int capacity);
+
+    // Stores i as the index of the edge at i (-1 to forget it)
+    void SetIndex(int i, int index);
+
+    // Returns the index stored for edge
+    int IndexOf(const Edge *edge) const;
+};
+
+// All the edges of a node in the graph. A node only gets these when it is
+// first linked, samples that never join the graph go without. Successors
+// are not edges, see KDTreeNode::first_successor_. The sets grow in arena,
+// which has to outlive them (it does if the NodeEdges is made in it).
+// Every edge is held by both of its nodes: out_ of the start and in_ of
+// the end, and an initial edge by its other node in initial_refs_ if that
+// node does not have it as an initial edge too. So the edges of a node can
+// be taken out of the nodes at their other ends (see PruneGraph)
+struct NodeEdges {
+    EdgeSet out_;           // edges in the graph that can be reached from
+                            // this node
+    EdgeSet in_;            // edges in the graph that reach this node
+    EdgeSet initial_out_;   // edges to nodes in the original ball that can
+                            // be reached from this node
+    EdgeSet initial_in_;    // edges to nodes in the original ball that can
+                            // reach this node
+    EdgeSet initial_refs_;  // initial edges of other nodes that end at
+                            // this node, not used to find neighbors
+
+    double cull_radius_;    // no edge in out_ is longer than this, so
+                            // culling at a radius at least this big is a
+                            // no-op
+
+    // Constructor, node is the node that has these edges
+    explicit NodeEdges(GraphArena *arena=NULL, const KDTreeNode *node=NULL)
+        : out_(EdgeSet::kOut, true, arena), in_(EdgeSet::kIn, false, arena),
+          initial_out_(EdgeSet::kInitial, false, arena, node),
+          initial_in_(EdgeSet::kInitial, false, arena, node),
+          initial_refs_(EdgeSet::kInitial, false, arena, node),
+          cull_radius_(INFINITY) {}
+};
+
+#endif // EDGESET_H
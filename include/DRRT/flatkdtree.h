@@ -0,0 +1,115 @@
+#ifndef FLATKDTREE_H
+#define FLATKDTREE_H
+
+#include <DRRT/nnstorage.h>
+
+/* A KD-Tree that keeps everything it needs for searching in contiguous
+ * arrays (struct-of-arrays) instead of following shared_ptr links between
+ * KDTreeNodes. Every node in the tree is identified by its index i:
+ *   positions_[i*dimensions_ + j]  is dimension j of its position
+ *   split_dim_[i], split_value_[i] describe its splitting hyperplane
+ *   child_L_[i], child_R_[i], parent_[i] are indices (-1 if not used)
+ *   handles_[i] is the KDTreeNode stored there (node->kd_index_ == i)
+ *               or NULL if it was removed
+ * The tree is kept balanced scapegoat style: when an insert lands deeper
+ * than log(n)/log(1/balance_), the lowest subtree on its path where one
+ * side holds more than balance_ of the nodes is rebuilt by median splits.
+ * Only the links change, so a node keeps its index. The root is root_
+ * (not necessarily index 0). Removed nodes stay in the tree, only to
+ * split the space, until Compact() drops them and renumbers the rest.
+ * Wrapping dimensions are handled by the owning KDTree, which calls these
+ * functions once for the query point and once for every ghost point.
+ */
+class FlatKDTree : public NNStorage {
+public:
+    int dimensions_;            // the number of dimensions in the space
+    int root_;                  // index of the root node or -1
+    double balance_;            // largest fraction of a subtree that may
+                                // be on one side before it is rebuilt
+
+    // distance function to use
+    double (*distanceFunction)(Eigen::VectorXd a, Eigen::VectorXd b);
+
+    std::vector<Coord> positions_;    // dimensions_ values per node
+    std::vector<int> split_dim_;      // splitting dimension of each node
+    std::vector<Coord> split_value_;  // position along split_dim_
+    std::vector<int> child_L_;        // index of left child or -1
+    std::vector<int> child_R_;        // index of right child or -1
+    std::vector<int> parent_;         // index of parent or -1 (root)
+    std::vector<int> size_;           // number of nodes in each subtree
+
+    // Constructor
+    FlatKDTree(int _d)
+        :   dimensions_(_d), root_(-1), balance_(0.75), distanceFunction(0)
+    {}
+
+    // Reserves space for n nodes so inserting does not reallocate
+    void Reserve(int n) override;
+
+    typedef Eigen::Matrix<Coord,Eigen::Dynamic,1> Stored;
+
+    // Returns a view of the (stored) position of the node at index
+    Eigen::Map<const Stored> Position(int index) const
+    { return Eigen::Map<const Stored>(&positions_[index*dimensions_],
+                                      dimensions_); }
+
+    // Inserts node into the tree and returns its index
+    int Insert(std::shared_ptr<KDTreeNode> &node) override;
+
+    // Appends nodes and rebuilds the whole tree balanced, building the
+    // subtrees near the top on separate threads if parallel is true
+    void BulkInsert(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                    bool parallel=false) override;
+
+    // Returns the index of the node at exactly pos, or -1 if not present
+    int FindExact(const Eigen::VectorXd &pos) const override;
+
+    // Drops the removed nodes, gives the others the indices 0,1,... in
+    // the order given (updating their kd_index_) and rebuilds the tree
+    void Renumber(const std::vector<int> &order) override;
+
+    // Setter for distanceFunction
+    void SetDistanceFunction(double(*func)(Eigen::VectorXd a,
+                                           Eigen::VectorXd b)) override
+    { distanceFunction = func; }
+
+    // The searches below only read the tree, everything they write
+    // goes into scratch so they can be called from several threads
+
+    // Updates nearest and nearestDist if there is a node closer to
+    // queryPoint than nearestDist (nearest may start as -1)
+    // (see KDQueryScratch::Approximate, which also applies to the range query)
+    void FindNearest(const Eigen::VectorXd &queryPoint,
+                     int &nearest, double &nearestDist,
+                     KDQueryScratch &scratch) const override;
+
+    // Appends (index, distance) of every node closer than range to
+    // queryPoint to scratch.hits_. The same node may be appended by
+    // several calls (e.g. for ghost points) so the caller removes duplicates
+    void FindWithinRange(const Eigen::VectorXd &queryPoint, double range,
+                         KDQueryScratch &scratch) const override;
+
+    // Maintains scratch.heap_ as a max-heap (by distance) of the k nodes
+    // closest to queryPoint. Nodes already in the heap keep their smallest
+    // distance, so it can be called again for each ghost point
+    void FindKNearest(const Eigen::VectorXd &queryPoint, int k,
+                      KDQueryScratch &scratch) const override;
+
+    // Prints the subtree starting at index (-1 for the whole tree)
+    void PrintTree(int index, int indent=0, char type=' ') override;
+
+private:
+    // Rebuilds the lowest unbalanced subtree above the node at index
+    void Rebalance(int index);
+
+    // Subtrees with more nodes than this are worth a thread of their own
+    enum { kParallelBuild = 4096 };
+
+    // Links order[lo,hi) into a balanced subtree under parent, splitting
+    // each node along the dimension with the largest spread. Returns the
+    // index of its root (-1 if empty). Up to threads threads are used
+    int Build(std::vector<int> &order, int lo, int hi, int parent,
+              int threads=1);
+};
+
+#endif // FLATKDTREE_H
@@ -39,4 +39,7 @@ typedef struct GhostPointIterator {
 Eigen::VectorXd GetNextGhostPoint(std::shared_ptr<GhostPointIterator> G,
                                   double best_dist);
 
+// Same as above for an iterator that lives on the caller's stack
+Eigen::VectorXd GetNextGhostPoint(GhostPointIterator &G, double best_dist);
+
 #endif // GHOSTPOINT_H
@@ -0,0 +1,122 @@
+#ifndef GRAPHARENA_H
+#define GRAPHARENA_H
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/* Memory for the nodes and edges of one planner. Blocks are cut from slabs
+ * of kBatch blocks of one size, and freed blocks are kept for the next
+ * object of that size rather than given back. Every thread has its own free
+ * blocks so making and dropping objects takes no lock, a thread only locks
+ * to trade a batch with the shared free blocks or take a new slab. The
+ * slabs are all released together when the arena goes, which is only once
+ * the last object made in it is gone since every object holds on to the
+ * arena through its allocator
+ */
+class GraphArena {
+public:
+    static const int kBatch = 256;      // blocks a thread takes at once
+    static const int kGranule = 16;     // block sizes are multiples of this
+    static const int kClasses = 64;     // so the largest block is 1024 bytes
+    static const int kThreads = 64;     // threads that get their own blocks
+
+    // Constructor
+    GraphArena();
+    ~GraphArena();
+
+    GraphArena(const GraphArena&) = delete;
+    GraphArena& operator=(const GraphArena&) = delete;
+
+    // Returns a block of at least size bytes, aligned to kGranule. Sizes
+    // past the largest block go to operator new
+    void* Allocate(std::size_t size);
+
+    // Takes back a block from Allocate(size)
+    void Deallocate(void *block, std::size_t size);
+
+    // Returns how many times the arena took memory from the system. Once
+    // the graph stops growing this stops moving
+    long SlabCount() const { return slab_count_.load(); }
+
+    // Returns how many blocks are handed out (a snapshot if other threads
+    // are allocating)
+    long BlocksInUse() const;
+
+private:
+    struct Block {
+        Block *next_;
+    };
+
+    // The free blocks of one thread, each list no longer than 2*kBatch
+    struct alignas(64) Cache {
+        Block *free_[kClasses];
+        int count_[kClasses];
+        long taken_;
+        long given_;
+    };
+
+    Cache caches_[kThreads];
+    Cache overflow_;            // for threads past kThreads, under mutex_
+
+    std::mutex mutex_;          // guards everything below
+    Block *shared_[kClasses];   // free blocks no thread holds on to
+    std::vector<char*> slabs_;
+    std::atomic<long> slab_count_;
+
+    // Fills cache's list for class c with a batch of blocks
+    void Refill(Cache &cache, int c);
+
+    // Moves a batch of blocks from cache's list for class c to shared_
+    void Spill(Cache &cache, int c);
+};
+
+// Allocator that takes its memory from a GraphArena, for allocate_shared
+template<class T>
+class GraphAllocator {
+public:
+    typedef T value_type;
+
+    std::shared_ptr<GraphArena> arena_;
+
+    // Constructors
+    explicit GraphAllocator(const std::shared_ptr<GraphArena> &arena)
+        : arena_(arena) {}
+
+    template<class U>
+    GraphAllocator(const GraphAllocator<U> &other) : arena_(other.arena_) {}
+
+    T* allocate(std::size_t n)
+    {
+        static_assert(alignof(T) <= GraphArena::kGranule,
+                      "GraphArena blocks are not aligned enough");
+        return static_cast<T*>(arena_->Allocate(n*sizeof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        arena_->Deallocate(p, n*sizeof(T));
+    }
+};
+
+template<class T, class U>
+bool operator==(const GraphAllocator<T> &a, const GraphAllocator<U> &b)
+{ return a.arena_ == b.arena_; }
+
+template<class T, class U>
+bool operator!=(const GraphAllocator<T> &a, const GraphAllocator<U> &b)
+{ return a.arena_ != b.arena_; }
+
+// Makes a T in arena, or with make_shared if there is no arena
+template<class T, class... Args>
+std::shared_ptr<T> MakeInArena(const std::shared_ptr<GraphArena> &arena,
+                               Args&&... args)
+{
+    if( !arena ) return std::make_shared<T>(std::forward<Args>(args)...);
+    return std::allocate_shared<T>(GraphAllocator<T>(arena),
+                                   std::forward<Args>(args)...);
+}
+
+#endif // GRAPHARENA_H
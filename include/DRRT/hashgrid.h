@@ -0,0 +1,163 @@
+#ifndef HASHGRID_H
+#define HASHGRID_H
+
+#include <DRRT/statickdtree.h>
+#include <unordered_map>
+
+/* A uniform grid for the [x,y,theta] Dubin's space. The (x,y) plane is
+ * cut into square cells of width cell_size_ and each cell into theta_bins_
+ * equal slices of [0,2pi). Cells are made when the first node lands in
+ * them and are looked up by hashing their (x,y) cell coordinates, so the
+ * workspace does not have to be known in advance. The points of a bin are
+ * stored struct-of-arrays (all x's, then all y's, then all thetas) and
+ * scored with DubinsMetric::ScoreBlock. Inserting and removing are O(1)
+ * and a range query only looks at the cells the range overlaps, which
+ * is cheaper than walking a tree when the nodes cover a bounded workspace
+ * evenly and the range is about cell_size_. Nearest node queries search
+ * rings of cells around the query point until the next ring is further
+ * away than what was found, so they get slow far away from every node.
+ * Points are identified by insertion order as in FlatKDTree and kept
+ * as Coord
+ */
+class HashGrid : public NNStorage {
+public:
+    typedef Eigen::Matrix<double,3,1> Point;   // a query
+    typedef Eigen::Matrix<Coord,3,1> Stored;   // a point in the grid
+    enum { kMaxBins = 64 };
+
+    // The points of one theta bin of a cell
+    struct Bin {
+        std::vector<Coord> coords_;   // capacity x's, y's, then thetas
+        std::vector<int> ids_;        // point index of each slot in use
+
+        int Capacity() const { return (int)coords_.size()/3; }
+    };
+
+    double cell_size_;          // width of a cell along x and y
+    int theta_bins_;            // number of theta slices per cell
+    DubinsMetric metric_;       // distance function to use
+
+    std::unordered_map<unsigned long long,int> cells_; // (x,y) key -> cell
+    std::vector<Bin> bins_;     // bins of cell c are c*theta_bins_,...
+    std::vector<Stored, Eigen::aligned_allocator<Stored>> positions_;
+    int min_x_, max_x_;         // range of cell coordinates that hold
+    int min_y_, max_y_;         // (or held) a point
+
+    // Constructor
+    HashGrid(double cell_size, int theta_bins=8);
+
+    // Reserves space for n points so inserting does not reallocate
+    void Reserve(int n) override;
+
+    // Inserts node into its bin and returns its index
+    int Insert(std::shared_ptr<KDTreeNode> &node) override;
+
+    // Returns the index of the point at exactly pos, or -1 if not present
+    int FindExact(const Eigen::VectorXd &pos) const override;
+
+    // Removes the point at index from its bin
+    void Remove(int index) override;
+
+    // Drops the removed points, gives the others the indices 0,1,... in
+    // the order given (updating their kd_index_) and refills the grid
+    void Renumber(const std::vector<int> &order) override;
+
+    // Updates nearest and nearestDist if there is a point closer to
+    // queryPoint than nearestDist (nearest may start as -1). A budget
+    // counts the cells that are visited
+    void FindNearest(const Eigen::VectorXd &queryPoint, int &nearest,
+                     double &nearestDist,
+                     KDQueryScratch &scratch) const override;
+
+    // Appends (index, distance) of every point closer than range to
+    // queryPoint to scratch.hits_
+    void FindWithinRange(const Eigen::VectorXd &queryPoint, double range,
+                         KDQueryScratch &scratch) const override;
+
+    // Maintains scratch.heap_ as a max-heap (by distance) of the k points
+    // closest to queryPoint
+    void FindKNearest(const Eigen::VectorXd &queryPoint, int k,
+                      KDQueryScratch &scratch) const override;
+
+    bool WrapsItself() const override { return true; }
+
+private:
+    // Returns the cell coordinate of x along x or y
+    int CellOf(double x) const { return (int)std::floor(x/cell_size_); }
+
+    // Returns the theta slice that theta falls in
+    int BinOf(double theta) const;
+
+    // Returns the key of cell (cx,cy) in cells_
+    static unsigned long long Key(int cx, int cy)
+    {
+        return ((unsigned long long)(unsigned int)cx << 32)
+                | (unsigned int)cy;
+    }
+
+    // Returns the cell at (cx,cy) or -1 if no point was ever put there
+    int FindCell(int cx, int cy) const
+    {
+        std::unordered_map<unsigned long long,int>::const_iterator it
+                = cells_.find(Key(cx, cy));
+        return (it == cells_.end()) ? -1 : it->second;
+    }
+
+    // Adds the point at index to the bin it falls in, making its cell
+    void AddToGrid(int index);
+
+    // Writes the smallest theta distance from theta to each slice to bound
+    void BinBounds(double theta, double *bound) const;
+
+    // Returns the (x,y) distance from queryPoint to cell (cx,cy)
+    double CellBound(const Point &queryPoint, int cx, int cy) const;
+
+    // Calls visit(index, distance) for every point in bin b
+    template <class Visit>
+    void ScoreBin(const Point &queryPoint, int b, Visit visit) const
+    {
+        const Bin &bin = bins_[b];
+        const int n = (int)bin.ids_.size();
+        double dist[32];
+        for( int start = 0; start < n; start += 32 ) {
+            int count = std::min(32, n - start);
+            metric_.ScoreBlock(queryPoint, &bin.coords_[start],
+                               bin.Capacity(), count, dist);
+            for( int i = 0; i < count; i++ ) {
+                visit(bin.ids_[start + i], dist[i]);
+            }
+        }
+    }
+
+    // Calls visit(cell, cx, cy) for each cell that exists in the square
+    // ring k cells away from (cx,cy). Returns false if the ring is
+    // entirely outside the cells in use (and so is every larger ring)
+    template <class Visit>
+    bool VisitRing(int cx, int cy, int k, Visit visit) const
+    {
+        if( cx - k < min_x_ && cx + k > max_x_
+                && cy - k < min_y_ && cy + k > max_y_ ) return false;
+        for( int x = std::max(cx - k, min_x_);
+             x <= std::min(cx + k, max_x_); x++ ) {
+            int cell;
+            if( x == cx - k || x == cx + k ) {
+                // A side of the ring, all of its cells
+                for( int y = std::max(cy - k, min_y_);
+                     y <= std::min(cy + k, max_y_); y++ ) {
+                    if( (cell = FindCell(x, y)) != -1 ) visit(cell, x, y);
+                }
+                continue;
+            }
+            // Only the top and bottom cells in between
+            if( cy - k >= min_y_ && (cell = FindCell(x, cy - k)) != -1 ) {
+                visit(cell, x, cy - k);
+            }
+            if( cy + k <= max_y_ && (cell = FindCell(x, cy + k)) != -1 ) {
+                visit(cell, x, cy + k);
+            }
+        }
+        return true;
+    }
+};
+
+#endif // HASHGRID_H
@@ -7,205 +7,96 @@
 #define HEAP_H
 
 #include <DRRT/kdtreenode.h>
-
-// A binary heap data structure
-class BinaryHeap {
+#include <DRRT/daryheap.h>
+
+// The priority queue of RRTx (and of Theta*), smallest key first. Nodes
+// are ordered by min(rrt_tree_cost_, rrt_LMC_), the move goal first among
+// equal keys. The heap holds (key, slot) entries where slot indexes
+// nodes_, a node's slot is kept in its priority_queue_index_ field and
+// the heap position of each slot in positions_. Keys are cached when a
+// node is added or updated, so a node whose cost changes has to be
+// updated (UpdateHeap) before the heap is used again
+class PriorityQueue {
 public:
-    // Stores the things that are in the heap
-    std::vector<std::shared_ptr<KDTreeNode>> heap_;
-    int index_of_last_;    // the index of the last node in the heap array
-    int parent_of_last_;   // stores the index of the parent of the last node
-    bool use_default_;     // flag for using key or keyQ e.g. (DRRT.jl>>3289)
-
-    // Functions for interacting with marks and indices
-    // Returns the key value of the node
-    /// Should keyD return rrt_LMC_ as well? used in KDFindKNearest only (afaik)
-    double keyD(std::shared_ptr<KDTreeNode> node)
-    {return node->dist_;}
-
-    double keyQ(std::shared_ptr<KDTreeNode> node)
-    {return std::min( node->rrt_tree_cost_, node->rrt_LMC_ );}
-
-    double key(std::shared_ptr<KDTreeNode> node)
-    {return ( use_default_ ? keyD(node) : keyQ(node) );}
-
-
-    // Default less than function
-    bool lessD(std::shared_ptr<KDTreeNode> a, std::shared_ptr<KDTreeNode> b)
-    {return (keyD(a) < keyD(b));}
-
-    bool lessQ(std::shared_ptr<KDTreeNode> a, std::shared_ptr<KDTreeNode> b)
-    {return ((keyQ(a) < keyQ(b))
-             || (keyQ(a) == keyQ(b) && a->is_move_goal_));}
-
-    bool lessThan(std::shared_ptr<KDTreeNode> a,
-                  std::shared_ptr<KDTreeNode> b)
-    {return ( use_default_ ? lessD(a,b) : lessQ(a,b) );}
-
-
-    // Default greater than function DATA
-    bool greaterD(std::shared_ptr<KDTreeNode> a, std::shared_ptr<KDTreeNode> b)
-    {return (keyD(a) > keyD(b));}
-
-    bool greaterQ(std::shared_ptr<KDTreeNode> a, std::shared_ptr<KDTreeNode> b)
-    {return ((keyQ(a) > keyQ(b))
-             || (keyQ(a) == keyQ(b) && b->is_move_goal_));}
-
-    bool greaterThan(std::shared_ptr<KDTreeNode> a,
-                     std::shared_ptr<KDTreeNode> b)
-    {return ( use_default_ ? greaterD(a,b) : greaterQ(a,b) );}
-
-
-    // Default heap marker function (marks when a node is in the heap)
-    void markD(std::shared_ptr<KDTreeNode> &node)
-    {node->in_heap_ = true;}
-
-    void markQ(std::shared_ptr<KDTreeNode> &node)
-    {node->in_priority_queue_ = true;}
-
-    void mark(std::shared_ptr<KDTreeNode> &node)
-    {(use_default_ ? markD(node) : markQ(node));}
-
-
-    // Default heap unmarker function (un marks when a node is removed)
-    void unmarkD(std::shared_ptr<KDTreeNode> &node)
-    {node->in_heap_ = false;}
-
-    void unmarkQ(std::shared_ptr<KDTreeNode> &node)
-    {node->in_priority_queue_ = false;}
-
-    void unmark(std::shared_ptr<KDTreeNode> &node)
-    {(use_default_ ? unmarkD(node) : unmarkQ(node));}
-
-
-    // Default heap check marker function (checks if node is marked)
-    bool markedD(std::shared_ptr<KDTreeNode> node)
-    {return node->in_heap_;}
-
-    bool markedQ(std::shared_ptr<KDTreeNode> node)
-    {return node->in_priority_queue_;}
+    // Heap order, also keeps positions_ up to date
+    struct Order {
+        std::vector<int> *positions_;
 
-    bool marked(std::shared_ptr<KDTreeNode> node)
-    {return (use_default_ ? markedD(node) : markedQ(node));}
+        bool Before(const HeapEntry &a, const HeapEntry &b) const
+        { return a.key_ < b.key_ || (a.key_ == b.key_ && a.tie_ < b.tie_); }
 
+        void Moved(const HeapEntry &entry, int position)
+        { (*positions_)[entry.id_] = position; }
+    };
 
-    // Sets the heap index to a value
-    void setIndexD(std::shared_ptr<KDTreeNode> &node, int value)
-    {node->heap_index_ = value;}
+    DaryHeap<Order> heap_;
+    std::vector<std::shared_ptr<KDTreeNode>> nodes_; // slot -> node
+    std::vector<int> positions_;                      // slot -> heap position
+    std::vector<int> free_slots_;                     // slots not in use
 
-    void setIndexQ(std::shared_ptr<KDTreeNode> &node, int value)
-    {node->priority_queue_index_ = value;}
-
-    void setIndex(std::shared_ptr<KDTreeNode> &node, int value)
-    {(use_default_ ? setIndexD(node,value) : setIndexQ(node,value));}
-
-
-    // Set the heap index to the unused value (-1)
-    void unsetIndexD(std::shared_ptr<KDTreeNode> &node)
-    {node->heap_index_ = -1;}
-
-    void unsetIndexQ(std::shared_ptr<KDTreeNode> &node)
-    {node->priority_queue_index_ = -1;}
+    // Constructor
+    PriorityQueue()
+    {
+        Order order = {&positions_};
+        heap_ = DaryHeap<Order>(order);
+    }
 
-    void unsetIndex(std::shared_ptr<KDTreeNode> &node)
-    {(use_default_ ? unsetIndexD(node) : unsetIndexQ(node));}
+    // The queue points into itself, it is not copied
+    PriorityQueue(const PriorityQueue&) = delete;
+    PriorityQueue& operator=(const PriorityQueue&) = delete;
 
+    // Returns the key of node
+    static double Key(const KDTreeNode &node)
+    { return std::min(node.rrt_tree_cost_, node.rrt_LMC_); }
 
-    // Returns the heap index
-    int getIndexD(std::shared_ptr<KDTreeNode> node)
-    {return node->heap_index_;}
+    // Returns the tie breaker of node (the move goal goes first)
+    static int Tie(const KDTreeNode &node)
+    { return node.is_move_goal_ ? 0 : 1; }
 
-    int getIndexQ(std::shared_ptr<KDTreeNode> node)
-    {return node->priority_queue_index_;}
+    // Returns true if a comes before b (with their current costs)
+    static bool lessThan(const std::shared_ptr<KDTreeNode> &a,
+                         const std::shared_ptr<KDTreeNode> &b)
+    { return Key(*a) < Key(*b) || (Key(*a) == Key(*b) && a->is_move_goal_); }
 
-    int getIndex(std::shared_ptr<KDTreeNode> node)
-    {return (use_default_ ? getIndexD(node) : getIndexQ(node));}
+    // Returns true if node is in the queue
+    static bool marked(const std::shared_ptr<KDTreeNode> &node)
+    { return node->in_priority_queue_; }
 
+    // Returns the number of nodes in the queue
+    int Size() const { return heap_.Size(); }
 
-    // Constructor
-    BinaryHeap(bool use_d) : index_of_last_(0), parent_of_last_(-1), use_default_(use_d)
-    {
-        this->heap_.push_back( std::make_shared<KDTreeNode>() );
-    }
+    // Returns the node at heap position i (in no particular order)
+    const std::shared_ptr<KDTreeNode>& Node(int i) const
+    { return nodes_[heap_.At(i).id_]; }
 
-    // Displays the KDTreeNodes in the heap
+    // Displays the nodes in the queue
     void DisplayHeap();
 
-    // Returns the heap in a vector array
-    void GetHeap(std::vector<std::shared_ptr<KDTreeNode>> &heap);
-    // Returns the index of the last node in the heap array
-    int* GetIndexOfLast() {return &index_of_last_;}
-    // Returns the index of the parent of the last index in the heap array
-    int* GetParentOfLast() {return &parent_of_last_;}
-
-    /* Heap operation functions for returning the smallest thing */
-
-    // Compares a node with its parent and switches them if the parent's
-    // cost is more than the node's cost. Repeats if a switch happens
-    bool BubbleUp(int n);
-
-    // Compares a node n with its childeren, and switches them if a child's
-    // cost is less than the node's cost. Repeats if a switch happens
-    bool BubbleDown(int n);
-
-    // Add a node to the heap
+    // Add a node to the heap, returns false if it already is in it
     bool AddToHeap(std::shared_ptr<KDTreeNode> &node);
 
-    // Returns the node thas is on the top of the heap
-    // If heap is empty, return node with data = -1
+    // Sets node to the node on the top of the heap (unchanged if empty)
     void TopHeap(std::shared_ptr<KDTreeNode> &node);
 
-    // Removes the top valued node from the heap and returns it
-    // If heap is empty, return node with data = -1
+    // Removes the top node from the heap and sets node to it
     void PopHeap(std::shared_ptr<KDTreeNode> &node);
 
-    // Removes the node from the heap, assuming that it is in the heap
+    // Removes the node from the heap, returns false if it is not in it
     bool RemoveFromHeap(std::shared_ptr<KDTreeNode> &node);
 
-    // Updates a node that is already in the heap
+    // Moves a node that is already in the heap to where its current
+    // key puts it, returns false if it is not in the heap
     bool UpdateHeap(std::shared_ptr<KDTreeNode> &node);
 
     // Returns true if heap is good, false if bad
     bool CheckHeap();
 
-    // Removes all items from the heap and returns an array containing
-    // the heap items (unsorted)
+    // Removes all nodes from the heap and returns them (unsorted)
     void CleanHeap(std::vector<std::shared_ptr<KDTreeNode>> &heap);
 
-    /* Heap operation functions for returning the largest thing */
-
-    // Compares a node n with its parent, and switches them if
-    // the parent's cost is less than the node's cost. Repeats
-    // if a switch happens
-    bool BubbleUpB(int n);
-
-    // Compares an node n with its children, and switches them if
-    // a child's cost is more than the node's cost. Repeats if
-    // a switch happens
-    bool BubbleDownB(int n);
-
-    // Add node to the heap
-    bool AddToHeapB(std::shared_ptr<KDTreeNode> &node);
-
-    // Returns the node that is on top of the heap
-    void TopHeapB(std::shared_ptr<KDTreeNode> &node) {return TopHeap(node);}
-
-    // Removes the top valued node from the heap and returns it
-    void PopHeapB(std::shared_ptr<KDTreeNode> &node);
-
-    // Removes the node from the heap, assuming it is in the heap
-    bool RemoveFromHeapB(std::shared_ptr<KDTreeNode> node);
-
-    // Updates a node that is already in the heap
-    bool UpdateHeapB(std::shared_ptr<KDTreeNode> node);
-
-    // Returns 1 if heap is good, 0 if bad
-    bool CheckHeapB();
-
-    // Removes all items from the heap and returns an array containing
-    // the heap items (unsorted)
-    void CleanHeapB(std::vector<std::shared_ptr<KDTreeNode>> &heap)
-    { return CleanHeap(heap); }
+private:
+    // Takes node out of its slot and unmarks it
+    void Release(int slot);
 };
 
 #endif // HEAP_H
@@ -10,30 +10,49 @@
 
 class KDTreeNode;
 class Edge;
+class JList;
 
 // A JList node_ (not that key_ is unused for JList operations,
 // but it is often helpful to have a key_ value associated
-// with data)
+// with data). Cells come from JListPool and go back to it as soon as they
+// leave their list, so a JListNode* is only good while its cell is in a list
 class JListNode{
 public:
-    std::shared_ptr<JListNode> child_;
-    std::shared_ptr<JListNode> parent_;
+    JListNode *child_;
+    JListNode *parent_;
     std::shared_ptr<KDTreeNode> node_;
     std::shared_ptr<Edge> edge_;
     double key_ = 0.0;
+    const JList *list_;     // the list the cell is in (NULL if none)
 
     // Corstructor
-    JListNode() : key_(-1.0) {}
-    JListNode(std::shared_ptr<KDTreeNode> &t) : node_(t) {}
-    JListNode(std::shared_ptr<Edge> &e) : edge_(e) {}
+    JListNode() : child_(this), parent_(this), key_(-1.0), list_(NULL) {}
+};
+
+// Hands out JListNodes cut from slabs of kSlabSize. Every thread keeps its
+// own free cells so pushing and popping take no lock, a thread only locks
+// to get another slab's worth (or hand its cells back when it exits).
+// Slabs are never freed
+class JListPool {
+public:
+    static const int kSlabSize = 256;
+
+    // Returns a cell that is in no list
+    static JListNode* New();
+
+    // Takes back a cell that has left its list, dropping what it held
+    static void Delete(JListNode *cell);
+
+    // Returns how many slabs have been made so far
+    static long SlabCount();
 };
 
 // A simple JList
 class JList{
 public:
-    std::shared_ptr<JListNode> front_;
-    std::shared_ptr<JListNode> back_;
-    std::shared_ptr<JListNode> bound_;   // bounds either side of the list
+    JListNode *front_;
+    JListNode *back_;
+    JListNode *bound_;   // bounds either side of the list
     int length_;
     bool use_nodes_;    // flag for indicating whether this JList
                         // is one of Edges or KDTreeNodes. True
@@ -42,16 +61,19 @@ public:
     // Constructor
     JList( bool node_flag ) : use_nodes_(node_flag)
     {
-        std::shared_ptr<JListNode> end_node = std::make_shared<JListNode>();
-        end_node->child_ = end_node;
-        end_node->parent_ = end_node;
-
-        front_ = end_node;
-        back_ = end_node;
-        bound_ = end_node;
+        front_ = &end_;
+        back_ = &end_;
+        bound_ = &end_;
         length_ = 0;
     }
 
+    // Gives the cells back to the pool
+    ~JList();
+
+    // Cells point at bound_, which lives in the list
+    JList(const JList&) = delete;
+    JList& operator=(const JList&) = delete;
+
     // Functions
     bool JListContains(std::shared_ptr<KDTreeNode> &t);
     void JListPush( std::shared_ptr<KDTreeNode> &t );
@@ -68,10 +90,19 @@ public:
     void JListPopKey(std::shared_ptr<KDTreeNode> &n,
                      std::shared_ptr<double> k);
     void JListPopKey(std::shared_ptr<Edge> &e, std::shared_ptr<double> k);
-    bool JListRemove(std::shared_ptr<JListNode> &node);
+    bool JListRemove(JListNode *node);
     void JListPrint();
     Eigen::Matrix<double, Eigen::Dynamic, 2> JListAsMatrix();
     void JListEmpty();
+
+private:
+    JListNode end_;     // the cell bound_ points at
+
+    // Links a new cell in at the front and returns it
+    JListNode* PushCell();
+
+    // Unlinks the front cell and returns it (the list is not empty)
+    JListNode* PopCell();
 };
 
 #endif // JLIST_H
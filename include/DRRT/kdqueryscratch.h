@@ -0,0 +1,140 @@
+#ifndef KDQUERYSCRATCH_H
+#define KDQUERYSCRATCH_H
+
+#include <DRRT/kdtreenode.h>
+#include <DRRT/daryheap.h>
+#include <algorithm>
+
+// Order of the k-nearest heap: largest distance on top, the nodes in it
+// are found by scanning so nothing tracks where they move
+struct KNNOrder {
+    bool Before(const HeapEntry &a, const HeapEntry &b) const
+    { return a.key_ > b.key_; }
+
+    void Moved(const HeapEntry &entry, int position) const {}
+};
+
+/* Everything a single KDTree query writes to while it is running. Each
+ * thread searching the tree uses its own scratch, so the nodes in the
+ * tree are never marked and several queries can run at the same time.
+ * A node with kd_index_ i has been marked by the current query if
+ * visited_[i] == stamp_, which makes starting a new query O(1)
+ */
+class KDQueryScratch {
+public:
+    std::vector<unsigned int> visited_;  // stamp of the query that marked
+                                         // each node index
+    unsigned int stamp_;                 // stamp of the current query
+
+    // Traversal stack of (index, lower bound on distance) for FlatKDTree
+    std::vector<std::pair<int,double>> stack_;
+
+    // Result buffers: (index, distance) for range queries and a max-heap
+    // of (distance, index) entries for k-nearest queries. The pointer tree
+    // also keeps the nodes it added to the heap in found_
+    std::vector<std::pair<int,double>> hits_;
+    DaryHeap<KNNOrder> heap_;
+    std::vector<std::shared_ptr<KDTreeNode>> found_;
+
+    // Approximate queries (see KDTree::SetApproximation) skip subtrees
+    // that can not hold a node approx_ times closer than the best one so
+    // far (or than the range), and everything after budget_ visits
+    double approx_;         // 1 + epsilon, 1 for exact queries
+    int budget_;            // most live nodes (leaves for BucketKDTree,
+                            // cells for HashGrid) to score, 0 for no limit
+    int visits_;            // of those scored by the current query
+    double skipped_;        // smallest bound of a subtree that was skipped
+    double error_;          // relative error bound of the last query
+
+    // Constructor
+    KDQueryScratch()
+        : stamp_(0), approx_(1.0), budget_(0), visits_(0), skipped_(INF),
+          error_(0.0) {}
+
+    // Starts a new query on a tree that has size nodes
+    void Begin(int size)
+    {
+        if( (int)visited_.size() < size ) visited_.resize(size, 0);
+        stamp_ += 1;
+        if( stamp_ == 0 ) {
+            // Stamp wrapped around, forget every old mark
+            std::fill(visited_.begin(), visited_.end(), 0);
+            stamp_ = 1;
+        }
+        stack_.clear();
+        hits_.clear();
+        heap_.Clear();
+        found_.clear();
+        Approximate(0.0, 0);
+    }
+
+    // Sets up the current query to be approximate, epsilon = 0 and
+    // budget = 0 make it exact
+    void Approximate(double epsilon, int budget)
+    {
+        approx_ = 1.0 + epsilon;
+        budget_ = budget;
+        visits_ = 0;
+        skipped_ = INF;
+    }
+
+    // Returns true if a subtree whose nodes are at least bound away can be
+    // skipped by a query for nodes closer than dist
+    bool Skip(double bound, double dist)
+    {
+        if( bound*approx_ <= dist && (budget_ == 0 || visits_ < budget_) ) {
+            return false;
+        }
+        if( bound < skipped_ ) skipped_ = bound;
+        return true;
+    }
+
+    // Sets error_ to how much further than the true nearest node (or the
+    // closest missed node) a result at dist can be, relative to dist
+    double Finish(double dist)
+    {
+        if( skipped_ >= dist ) error_ = 0.0;
+        else if( skipped_ > 0.0 ) error_ = dist/skipped_ - 1.0;
+        else error_ = INF;
+        return error_;
+    }
+
+    // Returns true if the node at index is marked by this query
+    bool Marked(int index) const { return visited_[index] == stamp_; }
+
+    // Marks the node at index, returns false if it was already marked
+    bool Mark(int index)
+    {
+        if( visited_[index] == stamp_ ) return false;
+        visited_[index] = stamp_;
+        return true;
+    }
+
+    // Distance of the worst node in the k-nearest heap, INF while it holds
+    // fewer than k nodes
+    double WorstKNN(int k) const
+    {
+        return (heap_.Size() < k) ? INF : heap_.Top().key_;
+    }
+
+    // Offers node index at dist to the k-nearest heap. A node can be
+    // offered more than once (through the ghost points of a wrapped
+    // space) and keeps its smallest distance. Returns true if index was
+    // not in the heap and has been added
+    bool OfferKNN(double dist, int index, int k)
+    {
+        for( int i = 0; i < heap_.Size(); i++ ) {
+            if( heap_.At(i).id_ != index ) continue;
+            if( dist < heap_.At(i).key_ ) heap_.Update(i, dist);
+            return false;
+        }
+        if( heap_.Size() == k ) {
+            if( heap_.Top().key_ <= dist ) return false;
+            heap_.Pop();
+        }
+        heap_.Push(dist, index);
+        return true;
+    }
+};
+
+#endif // KDQUERYSCRATCH_H
@@ -8,11 +8,27 @@
 
 #include <DRRT/ghostPoint.h>
 #include <DRRT/datastructures.h>
+#include <DRRT/flatkdtree.h>
+#include <DRRT/bucketkdtree.h>
+#include <DRRT/hashgrid.h>
+#include <DRRT/positionindex.h>
+#include <shared_mutex>
+
+// (node, distance) pairs filled in by the queries that write to a vector
+typedef std::vector<std::pair<std::shared_ptr<KDTreeNode>,double>> KDResults;
 
 // A KD-Tree data structure that stores nodes of type T
+// Queries only read the tree and keep their state in a KDQueryScratch
+// owned by the calling thread, so any number of them can run at once.
+// They hold query_mutex_ shared while inserts hold it exclusively.
+// This is the nearest neighbor interface the planner uses: by default the
+// nodes are linked through their kd_ pointers, the Use*Storage functions
+// hand them to an NNStorage (another kind of tree or a grid) instead.
+// The tree owns the nodes of the graph, see KDTreeNode
 class KDTree {
 public:
     std::mutex tree_mutex_;
+    std::shared_timed_mutex query_mutex_;
     std::vector<std::shared_ptr<KDTreeNode>> nodes_;
 
     int dimensions_;                       // the number of dimensions in the space (5)
@@ -21,6 +37,11 @@ public:
     double (*distanceFunction)(Eigen::VectorXd a, Eigen::VectorXd b);
 
     int tree_size_;               // the number of nodes in the KD-Tree
+    int num_indices_;             // kd_index_ values handed out so far,
+                                  // removed nodes keep theirs until KDCompact
+
+    double approx_epsilon_;       // settings for approximate queries, see
+    int approx_budget_;           // SetApproximation
 
     int num_wraps_;               // the total number of dimensions that wrap
     Eigen::VectorXi wraps_;      // a vector of length dimensions_ containing a list of
@@ -29,24 +50,117 @@ public:
                                 // wrap_points_[i] along dimension wraps_[i]
     std::shared_ptr<KDTreeNode> root;   // the root node
 
+    // If not NULL, nodes are stored and searched in this storage instead
+    // of through the kd_ pointers. The Dubin's storages use DubinsMetric
+    // instead of distanceFunction (they must agree)
+    std::shared_ptr<NNStorage> storage_;
+
+    // If not NULL, every node in the tree is also filed here by position
+    // (see UsePositionIndex)
+    std::shared_ptr<PositionIndex> position_index_;
+
     // Constructors
     KDTree(int _d, Eigen::VectorXi _wraps, Eigen::VectorXd _wrapPoints)
         :   dimensions_(_d), distanceFunction(0), tree_size_(0),
+            num_indices_(0), approx_epsilon_(0.0), approx_budget_(0),
             num_wraps_(_wraps.size()), wraps_(_wraps), wrap_points_(_wrapPoints)
     { nodes_ = std::vector<std::shared_ptr<KDTreeNode>>(); }
 
     KDTree(int _d)
-        :   dimensions_(_d), distanceFunction(0), tree_size_(0), num_wraps_(0)
+        :   dimensions_(_d), distanceFunction(0), tree_size_(0),
+            num_indices_(0), approx_epsilon_(0.0), approx_budget_(0),
+           num_wraps_(0)
     { nodes_ = std::vector<std::shared_ptr<KDTreeNode>>(); }
 
     KDTree()
-        :  dimensions_(0), distanceFunction(0), tree_size_(0), num_wraps_(0)
+        :  dimensions_(0), distanceFunction(0), tree_size_(0),
+           num_indices_(0), approx_epsilon_(0.0), approx_budget_(0),
+           num_wraps_(0)
     { nodes_ = std::vector<std::shared_ptr<KDTreeNode>>(); }
 
+    // Destructor, frees the nodes without recursing down the tree
+    ~KDTree();
+
     // Setter for distanceFunction
     void SetDistanceFunction(double(*func)(Eigen::VectorXd a,
                                            Eigen::VectorXd b))
-    { distanceFunction = func; }
+    {
+        distanceFunction = func;
+        if( storage_ ) storage_->SetDistanceFunction(func);
+    }
+
+    // Sets up the queries that ask to be approximate: the nearest node
+    // found may be up to 1+epsilon times further away than the true one,
+    // a range query may miss nodes further than range/(1+epsilon), and
+    // a query stops after visiting budget nodes (leaves for the bucket
+    // storage and cells for the grid, 0 for no limit). Only the storages
+    // approximate, the pointer tree always searches exactly
+    void SetApproximation(double epsilon, int budget)
+    {
+        approx_epsilon_ = epsilon;
+        approx_budget_ = budget;
+    }
+
+    // Returns the bound on the relative error of the calling thread's
+    // last nearest or range query: the true nearest node is at most
+    // 1+error closer than the one found, and a range query found every
+    // node closer than range/(1+error). INF if the budget ran out before
+    // anything was found
+    double KDApproxError() const;
+
+    // Switches this tree to flat storage, reserving space for
+    // reserve nodes. Nodes already in the tree are moved over
+    void UseFlatStorage(int reserve=0);
+
+    // Switches this (3 dimensional) tree to DubinsKDTree storage,
+    // reserving space for reserve nodes. Nodes already in the tree
+    // are moved over
+    void UseDubinsStorage(int reserve=0);
+
+    // Same as above but with DubinsBucketKDTree storage
+    void UseBucketStorage(int reserve=0);
+
+    // Switches this [x,y,theta] tree to a HashGrid with cells cell_size
+    // wide and theta_bins slices of theta per cell
+    void UseGridStorage(double cell_size, int theta_bins=8, int reserve=0);
+
+    // Keeps a PositionIndex of the nodes with cubes cell_size wide next to
+    // the tree from now on. GetNodeAt looks nodes up in it, KDInsert and
+    // KDBulkBuild reject a node at the exact position of one already in
+    // the tree, and KDHasNodeWithin answers from it for radii up to
+    // cell_size
+    void UsePositionIndex(double cell_size);
+
+    // Removes every node from the current storage (clearing their kd_
+    // fields) and returns them, each node comes after its kd parent
+    std::vector<std::shared_ptr<KDTreeNode>> TakeNodes();
+
+    // Inserts nodes (from TakeNodes) into the new storage_, reserving
+    // space for at least reserve nodes
+    void FillStorage(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                     int reserve);
+
+    // Returns every node in the tree (in the same order as TakeNodes),
+    // the caller holds query_mutex_
+    std::vector<std::shared_ptr<KDTreeNode>> CollectNodes();
+
+    // Returns every node in the tree
+    std::vector<std::shared_ptr<KDTreeNode>> KDNodes();
+
+    // Returns true if the storage has to be searched at the ghost points
+    // of the wrapped dimensions too
+    bool SearchGhosts() const
+    { return num_wraps_ > 0 && !(storage_ && storage_->WrapsItself()); }
+
+    // Returns the node at index in storage_
+    std::shared_ptr<KDTreeNode>& Handle(int index)
+    { return storage_->handles_[index]; }
+
+    // Updates nearest and nearestDist if storage_ has a node closer to
+    // queryPoint (or to one of its ghost points), the caller holds
+    // query_mutex_
+    void StorageFindNearest(const Eigen::VectorXd &queryPoint, int &nearest,
+                            double &nearestDist, KDQueryScratch &scratch);
 
     // Adds a node to the JList for the visualizer
     void AddVizNode(std::shared_ptr<KDTreeNode> node);
@@ -62,9 +176,59 @@ public:
     void GetNodeAt(Eigen::VectorXd pos,
                    std::shared_ptr<KDTreeNode>& node);
 
-    // Inserts a new node into the tree
+    // Returns true if some node in the tree is closer than radius to pos
+    bool KDHasNodeWithin(const Eigen::VectorXd &pos, double radius);
+
+    // Inserts a new node into the tree, returns false if it already is
+    // in it (or, with a position index, another node is at its position)
     bool KDInsert(std::shared_ptr<KDTreeNode> &node);
 
+    // Inserts every node of nodes that is not in the tree yet (and not at
+    // the position of another one with a position index) and returns
+    // how many were, building the storage up balanced in O(n log n) rather
+    // than linking them in one at a time. The storages build the subtrees
+    // near the top on their own threads if parallel is true. The pointer
+    // tree is rebuilt below its root, which stays the first node inserted.
+    // The nodes are only added to nodes_ (for the visualizer) if visualize
+    // is true
+    int KDBulkBuild(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                    bool parallel=false, bool visualize=true);
+
+    // Returns the dimension along which the nodes order[lo,hi) of nodes
+    // are spread out the most
+    int SplitDimension(const std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                       const std::vector<int> &order, int lo, int hi) const;
+
+    // Links the nodes order[lo,hi) of nodes into a balanced pointer subtree
+    // that is the left (or right) child of parent
+    void LinkBalanced(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                      std::vector<int> &order, int lo, int hi,
+                      std::shared_ptr<KDTreeNode> parent, bool left);
+
+    // Links node into the pointer tree below the node it belongs under
+    void KDLink(std::shared_ptr<KDTreeNode> &node);
+
+    // Removes a node from the tree (and the visualizer), returns false if
+    // it is not in the tree or is the root. The index storages may keep
+    // some space for the node until KDCompact, the pointer tree links
+    // the node's kd subtree back in below its parent right away
+    bool KDRemove(std::shared_ptr<KDTreeNode> &node);
+
+    // Same as above for many nodes, returns how many were removed
+    int KDRemove(std::vector<std::shared_ptr<KDTreeNode>> &nodes);
+
+    // Does the work for the two functions above without touching the
+    // visualizer, the caller holds query_mutex_
+    bool KDDetach(std::shared_ptr<KDTreeNode> &node);
+
+    // Rebuilds the storage without the space left by removed nodes and
+    // gives the nodes the kd_index_ values 0,...,tree_size_-1. With
+    // relayout, the indices follow a Z-order curve over the positions so
+    // the storage keeps nodes that are close in space close in memory
+    // (the KDTreeNodes themselves stay where they were allocated). The
+    // caller holds tree_mutex_ since the visualizer list is sorted too
+    void KDCompact(bool relayout=false);
+
     /////////////////////// Nearest ///////////////////////
 
     // Returns the nearest node to the queryPoint in the subtree starting
@@ -78,9 +242,12 @@ public:
                                 double suggestedClosestDist);
 
     // Returns the nearest node to the queryPoint and also its distance
+    // (approximately if asked to, see SetApproximation). Returns false if
+    // the storage holds no live node
     bool KDFindNearest(std::shared_ptr<KDTreeNode> &nearestNode,
                        std::shared_ptr<double> nearestNodeDist,
-                       Eigen::VectorXd queryPoint);
+                       Eigen::VectorXd queryPoint,
+                       bool approximate=false);
 
     // Returns the nearest node to queryPoint in the subtree starting at
     // the root and also its distance. It also takes a suggestion for a
@@ -102,43 +269,45 @@ public:
 
     /////////////////////// K Nearest ///////////////////////
 
-    // Adds the node to the heap if there is space in the current heap
-    // without growing past k, otherwise the current top is removed
-    // and then the top is returned
-
-    std::shared_ptr<KDTreeNode> AddToKNNHeap(std::shared_ptr<BinaryHeap> H,
-                                             std::shared_ptr<KDTreeNode> node,
-                                             double key, int k);
+    // Adds the node to the scratch heap if there is space in the current
+    // heap without growing past k, otherwise the current top is removed
+    // if it is further away than the node (see KDQueryScratch::OfferKNN).
+    // Returns the distance of the (new) top, INF while the heap holds
+    // fewer than k nodes
+    double AddToKNNHeap(KDQueryScratch &scratch,
+                        std::shared_ptr<KDTreeNode> &node,
+                        double key, int k);
 
     /* Finds the K nearest nodes to queryPoint in the subtree starting
-     * at root. Note that this return data is stored in the nearestHeap,
+     * at root. Note that this return data is stored in the scratch heap,
      * and the heap may also contain nodes before this function is called
-     * explicitly. Returns the node of the nearest set that is FARTHEST
-     * from the queryPoint along with its distance. Assumes that there
-     * is at least one node in the heap to begin with. IF this is the
-     * first call to this function (e.g. from KDFindKNearest) then it
-     * is also assumed that a dummy node has been added that has an INF
-     * key value. This makes things easier with checking that all K slots
-     * are used during the recursion
      */
-    bool KDFindKNearestInSubtree(std::shared_ptr<KDTreeNode> farthestNode,
-                                 std::shared_ptr<double> farthestNodeDist,
-                                 std::shared_ptr<KDTreeNode> root,
+    void KDFindKNearestInSubtree(std::shared_ptr<KDTreeNode> &root,
                                  int k,
-                                 Eigen::VectorXd queryPoint,
-                                 std::shared_ptr<BinaryHeap> nearestHeap);
+                                 Eigen::VectorXd &queryPoint,
+                                 KDQueryScratch &scratch);
 
-    // Returns the K nearest nodes to queryPoint and olso their distances
-    // Note that they are not sorted but are in reverse heap order
+    // Returns the K nearest nodes to queryPoint, nearest first
     std::vector<std::shared_ptr<KDTreeNode>> KDFindKNearest(int k,
                                                 Eigen::VectorXd queryPoint);
 
+    // Fills result with the K nearest nodes to queryPoint and their
+    // distances, nearest first. Wrapped dimensions are searched through
+    // ghost points. The search itself only uses the calling thread's
+    // scratch, so reusing result between calls avoids allocating
+    void KDFindKNearest(int k, Eigen::VectorXd &queryPoint, KDResults &result);
+
     /////////////////////// Within Range ///////////////////////
 
     // Adds the node to the list if it is not already there
     bool AddToRangeList(std::shared_ptr<JList> &S,
                         std::shared_ptr<KDTreeNode> &node,
-                        double key);
+                        double key, KDQueryScratch &scratch);
+
+    // Appends the node to result if this query did not add it yet
+    bool AddToRangeList(KDResults &result,
+                        std::shared_ptr<KDTreeNode> &node,
+                        double key, KDQueryScratch &scratch);
 
     // Pops the range list
     void PopFromRangeList(std::shared_ptr<JList> &S,
@@ -150,11 +319,21 @@ public:
 
     // Finds all nodes within range of the queryPoint in the subtree starting
     // at root and also their distance squared. This data is stored in nodeList
+    // (a JList or KDResults, see AddToRangeList)
     // The nodeList may also contain nodes before this function is called
+    template <class List>
     bool KDFindWithinRangeInSubtree(std::shared_ptr<KDTreeNode> &root,
                                     double range,
                                     Eigen::VectorXd queryPoint,
-                                    std::shared_ptr<JList> &nodeList);
+                                    List &nodeList,
+                                    KDQueryScratch &scratch);
+
+    // Adds the nodes of the pointer tree within range of queryPoint (or of
+    // one of its ghosts) to nodeList, the caller holds query_mutex_
+    template <class List>
+    void KDFindWithinRangeInTree(List &nodeList, double range,
+                                 Eigen::VectorXd &queryPoint,
+                                 KDQueryScratch &scratch);
 
     // Returns all nodes within range of queryPoint and also their distances
     // This data is contained in the JList at S
@@ -165,7 +344,8 @@ public:
      * be inserted
      */
     void KDFindWithinRange(std::shared_ptr<JList> &S, double range,
-                           Eigen::VectorXd queryPoint);
+                           Eigen::VectorXd queryPoint,
+                           bool approximate=false);
 
     // Returns all nodes within range of queryPoint and also their distance.
     // They are returned in a list with elements of type KDTreeNode
@@ -176,6 +356,27 @@ public:
     void KDFindMoreWithinRange(std::shared_ptr<JList> &S, double range,
                                Eigen::VectorXd queryPoint);
 
+    // Does the work for the two functions above with the given scratch
+    // (they use the calling thread's). Nodes already in S are not added
+    void KDFindWithinRange(std::shared_ptr<JList> &S, double range,
+                           Eigen::VectorXd queryPoint,
+                           KDQueryScratch &scratch,
+                           bool approximate=false);
+
+    // Fills result with every node within range of queryPoint and its
+    // distance, nearest first if sorted is true (approximately if asked
+    // to, see SetApproximation). result is cleared first, reusing it
+    // between calls avoids allocating anything per hit
+    void KDFindWithinRange(double range, Eigen::VectorXd &queryPoint,
+                           KDResults &result, bool sorted=false,
+                           bool approximate=false);
+
+    // Appends (index, distance) of the nodes within range of queryPoint
+    // to scratch.hits_ for storage_, searching the ghosts too. Nodes can
+    // show up more than once, the caller holds query_mutex_
+    void KDFindRangeHits(double range, Eigen::VectorXd &queryPoint,
+                         KDQueryScratch &scratch);
+
     // Inserts a new point into the tree (used only for debugging)
     void KDInsert(Eigen::VectorXd a);
 };
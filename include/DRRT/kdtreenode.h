@@ -2,6 +2,8 @@
 #define KDTREENODE_H
 
 #include <DRRT/jlist.h>
+#include <DRRT/edgeset.h>
+#include <DRRT/grapharena.h>
 
 class Edge;
 
@@ -10,24 +12,32 @@ class Edge;
  * can also be used as long as they have these fields that are
  * initialized as follows by a default constructor and the parent
  * and children types are the same as the node's type itself.
+ * A node owns its kd children and its edges. The links that point back
+ * (kd_parent_, and the nodes of an edge) do not own anything, the KDTree
+ * of the planner keeps the nodes of the graph alive. A node can only be
+ * freed once it is out of the KDTree and no other node holds an edge to
+ * it: PruneGraph takes every edge of a removed node out of the node at the
+ * other end (see NodeEdges), so no edge outlives its nodes
  */
-class KDTreeNode{
+class KDTreeNode : public std::enable_shared_from_this<KDTreeNode> {
 public:
     // Data used for KD Tree
     bool kd_in_tree_;          // set to true if this node is in the kd-tree
     bool kd_parent_exist_;     // set to true if parent in the tree is used
     bool kd_child_L_exist_;     // set to true if left child in the tree is used
     bool kd_child_R_exist_;     // set to true if right child in the tree is used
+    int kd_index_;              // index of this node in a FlatKDTree (-1 if none)
 
     // Data used for heap in KNN-search
     int heap_index_;    // named such to allow the use of default heap functions
-    bool in_heap_;      // ditto
+    bool in_heap_;      // ditto, also marks the nodes that
+                        // ParallelReduceInconsistency still has to process
     double dist_;      // ditto, this will hold the distance
 
     // More data used for KD Tree
     Eigen::VectorXd position_; // a d x 1 array of the dimensions of the space
     int kd_split_;              // the dimension used for splitting at this node
-    std::shared_ptr<KDTreeNode> kd_parent_;   // parent in the tree
+    KDTreeNode *kd_parent_ = NULL;            // parent in the tree
     std::shared_ptr<KDTreeNode> kd_child_L_;   // left child in the tree
     std::shared_ptr<KDTreeNode> kd_child_R_;   // right child in the tree
 
@@ -40,11 +50,9 @@ public:
     double rrt_tree_cost_;     // the cost to get to the root through the tree
 
     // RRT#
-    std::shared_ptr<JList> rrt_neighbors_out_;  // edges in the graph that
-                                             // can be reached
-                                             // from this node
-    std::shared_ptr<JList> rrt_neighbors_in_;   // edges in the graph that
-                                             // reach this node
+    std::shared_ptr<NodeEdges> edges_;  // neighbor, successor and initial
+                                        // neighbor edges, NULL until Edges()
+                                        // is first called
 
     int priority_queue_index_;     // index in the queue
     bool in_priority_queue_;       // flag for in the queue
@@ -56,67 +64,80 @@ public:
                             // calculating the same trajectory multiple times
 
     // RRTx (his idea)
-    std::shared_ptr<JList> successor_list_; // edges to nodes that use
-                                          // this node as their parent
-    std::shared_ptr<JList> initial_neighbor_list_out_; // edges to nodes in
-                                                   // the original ball
-                                   // that can be reached bfrom this node
-    std::shared_ptr<JList> initial_neighbor_list_in_;  // edges to nodes in
-                                                   // the original ball
-                                                // that can reach this node
-
     bool in_OS_queue_;     // flag for in the OS queue
     bool is_move_goal_;    // true if this is move goal (robot pose)
 
-    // pointer to the list node in the parent's successor list that
-    // holds parent's edge to this node
-    std::shared_ptr<JListNode> successor_list_item_in_parent_;
+    // Theta* (see ThetaStar), the node is in the closed set of a search
+    // if this matches the stamp of that search
+    unsigned int theta_closed_ = 0;
+
+    // The nodes that use this node as their parent, linked through
+    // next_successor_ and prev_successor_. successor_of_ is the node whose
+    // list this node is in (NULL if none), normally its rrt parent
+    KDTreeNode *first_successor_ = NULL;
+    KDTreeNode *next_successor_ = NULL;
+    KDTreeNode *prev_successor_ = NULL;
+    KDTreeNode *successor_of_ = NULL;
+
+    std::shared_ptr<KDTreeNode> GetPointer() { return shared_from_this(); }
+
+    // Puts node at the front of this node's successors, taking it out of
+    // the list it was in first
+    void AddSuccessor(KDTreeNode *node)
+    {
+        node->RemoveFromSuccessors();
+        node->next_successor_ = first_successor_;
+        if( first_successor_ ) first_successor_->prev_successor_ = node;
+        first_successor_ = node;
+        node->successor_of_ = this;
+    }
+
+    // Takes this node out of its parent's successors, if it is in them
+    void RemoveFromSuccessors()
+    {
+        if( !successor_of_ ) return;
+        if( prev_successor_ ) prev_successor_->next_successor_ = next_successor_;
+        else successor_of_->first_successor_ = next_successor_;
+        if( next_successor_ ) next_successor_->prev_successor_ = prev_successor_;
+        next_successor_ = prev_successor_ = successor_of_ = NULL;
+    }
+
+    // Returns the node's edges, creating them in arena on first use
+    NodeEdges& Edges(const std::shared_ptr<GraphArena> &arena)
+    {
+        if( !edges_ ) {
+            edges_ = MakeInArena<NodeEdges>(arena, arena.get(), this);
+        }
+        return *edges_;
+    }
 
 
     // Constructors
     KDTreeNode() : kd_in_tree_(false), kd_parent_exist_(false), kd_child_L_exist_(false),
-        kd_child_R_exist_(false), heap_index_(-1), in_heap_(false), dist_(-1),
-        rrt_parent_used_(false), rrt_neighbors_out_(std::make_shared<JList>(false)),
-        rrt_neighbors_in_(std::make_shared<JList>(false)), priority_queue_index_(-1),
-        in_priority_queue_(false), successor_list_(std::make_shared<JList>(false)),
-        initial_neighbor_list_out_(std::make_shared<JList>(false)),
-        initial_neighbor_list_in_(std::make_shared<JList>(false)),
-        in_OS_queue_(false), is_move_goal_(false)
+        kd_child_R_exist_(false), kd_index_(-1), heap_index_(-1), in_heap_(false), dist_(-1),
+        rrt_parent_used_(false), priority_queue_index_(-1),
+        in_priority_queue_(false), in_OS_queue_(false), is_move_goal_(false)
     {
         position_.setZero();
     }
     KDTreeNode(float d) :  kd_in_tree_(false), kd_parent_exist_(false),
-        kd_child_L_exist_(false), kd_child_R_exist_(false), heap_index_(-1),
+        kd_child_L_exist_(false), kd_child_R_exist_(false), kd_index_(-1), heap_index_(-1),
         in_heap_(false), dist_(d), rrt_parent_used_(false),
-        rrt_neighbors_out_(std::make_shared<JList>(false)),
-        rrt_neighbors_in_(std::make_shared<JList>(false)),
         priority_queue_index_(-1), in_priority_queue_(false),
-        successor_list_(std::make_shared<JList>(false)),
-        initial_neighbor_list_out_(std::make_shared<JList>(false)),
-        initial_neighbor_list_in_(std::make_shared<JList>(false)),
         in_OS_queue_(false), is_move_goal_(false)
     {
         position_.setZero();
     }
     KDTreeNode(float d, Eigen::VectorXd pos) :  kd_in_tree_(false),
         kd_parent_exist_(false), kd_child_L_exist_(false), kd_child_R_exist_(false),
-        heap_index_(-1), in_heap_(false), dist_(d), position_(pos),
-        rrt_parent_used_(false), rrt_neighbors_out_(std::make_shared<JList>(false)),
-        rrt_neighbors_in_(std::make_shared<JList>(false)), priority_queue_index_(-1),
-        in_priority_queue_(false), successor_list_(std::make_shared<JList>(false)),
-        initial_neighbor_list_out_(std::make_shared<JList>(false)),
-        initial_neighbor_list_in_(std::make_shared<JList>(false)),
-        in_OS_queue_(false), is_move_goal_(false)
+        kd_index_(-1), heap_index_(-1), in_heap_(false), dist_(d), position_(pos),
+        rrt_parent_used_(false), priority_queue_index_(-1),
+        in_priority_queue_(false), in_OS_queue_(false), is_move_goal_(false)
     {}
     KDTreeNode(Eigen::VectorXd pos) : kd_in_tree_(false), kd_parent_exist_(false),
-        kd_child_L_exist_(false), kd_child_R_exist_(false), heap_index_(-1),
+        kd_child_L_exist_(false), kd_child_R_exist_(false), kd_index_(-1), heap_index_(-1),
         in_heap_(false), dist_(INFINITY), position_(pos), rrt_parent_used_(false),
-        rrt_neighbors_out_(std::make_shared<JList>(false)),
-        rrt_neighbors_in_(std::make_shared<JList>(false)),
         priority_queue_index_(-1), in_priority_queue_(false),
-        successor_list_(std::make_shared<JList>(false)),
-        initial_neighbor_list_out_(std::make_shared<JList>(false)),
-        initial_neighbor_list_in_(std::make_shared<JList>(false)),
         in_OS_queue_(false), is_move_goal_(false)
     {}
 
@@ -126,6 +147,7 @@ public:
         kd_parent_exist_(other.kd_parent_exist_),
         kd_child_L_exist_(other.kd_child_L_exist_),
         kd_child_R_exist_(other.kd_child_R_exist_),
+        kd_index_(other.kd_index_),
         heap_index_(other.heap_index_),
         in_heap_(other.in_heap_),
         dist_(other.dist_),
@@ -137,19 +159,14 @@ public:
         rrt_parent_used_(other.rrt_parent_used_),
         rrt_parent_edge_(other.rrt_parent_edge_),
         rrt_tree_cost_(other.rrt_tree_cost_),
-        rrt_neighbors_out_(other.rrt_neighbors_out_),
-        rrt_neighbors_in_(other.rrt_neighbors_in_),
+        edges_(other.edges_),
         priority_queue_index_(other.priority_queue_index_),
         in_priority_queue_(other.in_priority_queue_),
         rrt_LMC_(other.rrt_LMC_),
         rrt_H_(other.rrt_H_),
         temp_edge_(other.temp_edge_),
-        successor_list_(other.successor_list_),
-        initial_neighbor_list_out_(other.initial_neighbor_list_out_),
-        initial_neighbor_list_in_(other.initial_neighbor_list_in_),
         in_OS_queue_(other.in_OS_queue_),
-        is_move_goal_(other.is_move_goal_),
-        successor_list_item_in_parent_(other.successor_list_item_in_parent_)
+        is_move_goal_(other.is_move_goal_)
     {}
 };
 
@@ -0,0 +1,99 @@
+#ifndef MULTIQUEUE_H
+#define MULTIQUEUE_H
+
+#include <DRRT/heap.h>
+#include <atomic>
+#include <mutex>
+
+/* A relaxed priority queue that several threads can use at once (a
+ * MultiQueue). Nodes are spread over a few heaps per thread, each behind
+ * its own lock, and Pop takes the better of the tops of two heaps picked at
+ * random. What comes out is near the smallest key, not always the smallest,
+ * and threads rarely wait on each other. Keys are cached when a node is
+ * pushed and a node can be in the queue more than once, the caller decides
+ * which entries still count (ParallelReduceInconsistency marks the nodes
+ * it wants with in_heap_)
+ */
+class MultiQueue {
+public:
+    // Constructor
+    MultiQueue(int threads, int heaps_per_thread=2);
+
+    MultiQueue(const MultiQueue&) = delete;
+    MultiQueue& operator=(const MultiQueue&) = delete;
+
+    // Adds node with its current key
+    void Push(const std::shared_ptr<KDTreeNode> &node);
+
+    // Removes a node near the top and sets node and key to it and the key it
+    // was pushed with, returns false if the queue is empty
+    bool Pop(std::shared_ptr<KDTreeNode> &node, double &key);
+
+    // Sets key and tie to those of the smallest entry (looking at every
+    // heap), returns false if the queue is empty
+    bool Min(double &key, int &tie);
+
+    // Returns the number of entries
+    int Size() const { return size_.load(); }
+
+    // Removes all entries and returns their nodes (unsorted)
+    void Drain(std::vector<std::shared_ptr<KDTreeNode>> &nodes);
+
+private:
+    struct Order {
+        bool Before(const HeapEntry &a, const HeapEntry &b) const
+        { return a.key_ < b.key_ || (a.key_ == b.key_ && a.tie_ < b.tie_); }
+
+        void Moved(const HeapEntry &entry, int position) {}
+    };
+
+    // One of the heaps with its lock
+    struct Part {
+        std::mutex mutex_;
+        DaryHeap<Order> heap_;
+        std::vector<std::shared_ptr<KDTreeNode>> nodes_; // slot -> node
+        std::vector<int> free_slots_;                     // slots not in use
+    };
+
+    std::vector<std::unique_ptr<Part>> parts_;
+    std::atomic<int> size_;
+
+    // Returns a random heap
+    int RandomPart() const;
+
+    // Removes the top of part (which is locked and not empty)
+    std::shared_ptr<KDTreeNode> PopFrom(Part &part, double &key);
+};
+
+/* A fixed table of locks that stands in for a lock on every node: a node
+ * is guarded by the lock its address hashes to. A Guard locks the stripes of
+ * up to three nodes at once, always in stripe order, so threads that each
+ * hold a few nodes at a time cannot deadlock
+ */
+class NodeLocks {
+public:
+    static const int kStripes = 1024;
+
+    class Guard {
+    public:
+        Guard(NodeLocks &locks, const KDTreeNode *a,
+              const KDTreeNode *b=NULL, const KDTreeNode *c=NULL);
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        NodeLocks &locks_;
+        int stripes_[3];
+        int count_;
+    };
+
+private:
+    std::mutex stripes_[kStripes];
+
+    // Returns the stripe guarding node
+    static int StripeOf(const KDTreeNode *node);
+};
+
+#endif // MULTIQUEUE_H
@@ -0,0 +1,134 @@
+#ifndef NNSTORAGE_H
+#define NNSTORAGE_H
+
+#include <DRRT/kdqueryscratch.h>
+#include <algorithm>
+#include <iostream>
+
+// Arranges order[lo,hi) for a median split along key(index) and returns m
+// such that key(order[i]) < key(order[m]) for i in [lo,m) and
+// key(order[i]) >= key(order[m]) for i in (m,hi). If the median key is
+// shared by a run of nodes, m is whichever end of the run (the first node
+// of it or the first node after it) is closer to the middle. Takes linear
+// time on average, so building a tree with it takes O(n log n)
+template <class Key>
+int MedianSplit(std::vector<int> &order, int lo, int hi, Key key)
+{
+    std::vector<int>::iterator begin = order.begin();
+    int mid = (lo + hi)/2;
+    std::nth_element(begin + lo, begin + mid, begin + hi,
+                     [&key](int a, int b) { return key(a) < key(b); });
+    double value = key(order[mid]);
+
+    // Split the run of median keys off both sides of mid
+    int first = std::partition(begin + lo, begin + mid,
+                               [&](int i) { return key(i) < value; }) - begin;
+    int last = std::partition(begin + mid + 1, begin + hi,
+                              [&](int i) { return key(i) == value; }) - begin;
+    if( last < hi && last - mid < mid - first ) {
+        // Bring the smallest key above the run to its end
+        std::iter_swap(begin + last,
+                       std::min_element(begin + last, begin + hi,
+                                        [&key](int a, int b)
+                                        { return key(a) < key(b); }));
+        return last;
+    }
+    std::iter_swap(begin + first, begin + mid);
+    return first;
+}
+
+/* Nearest neighbor storage behind the KDTree class. KDTree keeps the
+ * locking, the visualizer list and the ghost points of wrapped dimensions
+ * and hands the nodes to one of these (FlatKDTree, DubinsKDTree,
+ * DubinsBucketKDTree or HashGrid). A stored node is identified by its
+ * index, which the storage writes to node->kd_index_. Removed nodes leave
+ * a NULL handle behind until Compact() renumbers the rest, so an index
+ * stays valid as long as its node is stored. The queries only read the
+ * storage and write their state and results to scratch, which makes them
+ * safe to run from several threads at once
+ */
+class NNStorage {
+public:
+    int tree_size_;             // the number of indices in use
+                                // (including removed nodes)
+    std::vector<std::shared_ptr<KDTreeNode>> handles_; // index -> node
+                                                       // (NULL if removed)
+
+    // Constructor
+    NNStorage() : tree_size_(0) {}
+    virtual ~NNStorage() {}
+
+    // Reserves space for n nodes so inserting does not reallocate
+    virtual void Reserve(int n) = 0;
+
+    // Inserts node and returns its index (also set as node->kd_index_)
+    virtual int Insert(std::shared_ptr<KDTreeNode> &node) = 0;
+
+    // Inserts all of nodes, giving them the next indices in order. Storages
+    // that can build themselves in one go do so (from the nodes that are
+    // already stored too), using several threads if parallel is true
+    virtual void BulkInsert(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                            bool parallel=false)
+    {
+        Reserve(tree_size_ + (int)nodes.size());
+        for( int i = 0; i < (int)nodes.size(); i++ ) Insert(nodes[i]);
+    }
+
+    // Returns the index of the node at exactly pos, or -1 if not present
+    virtual int FindExact(const Eigen::VectorXd &pos) const = 0;
+
+    // Removes the node at index, searches skip it from now on
+    virtual void Remove(int index) { handles_[index].reset(); }
+
+    // Drops the removed nodes and gives the others the indices 0,1,...
+    // in the order they are listed in order (the indices of every stored
+    // node), updating their kd_index_
+    virtual void Renumber(const std::vector<int> &order) = 0;
+
+    // Drops the removed nodes and renumbers the others, keeping them in
+    // the same order or, if relayout is true, sorting them along a Z-order
+    // curve so that nodes close to each other get close indices (and so
+    // sit close to each other in the storage's arrays)
+    void Compact(bool relayout=false);
+
+    // Returns the Z-order (Morton) key of each node, made by interleaving
+    // the bits of its position quantized over the nodes' bounding box
+    static std::vector<unsigned long long> MortonKeys(
+            const std::vector<std::shared_ptr<KDTreeNode>> &nodes);
+
+    // Updates nearest and nearestDist if there is a node closer to
+    // queryPoint than nearestDist (nearest may start as -1). Approximate
+    // queries are set up in scratch (see KDQueryScratch::Approximate)
+    virtual void FindNearest(const Eigen::VectorXd &queryPoint,
+                             int &nearest, double &nearestDist,
+                             KDQueryScratch &scratch) const = 0;
+
+    // Appends (index, distance) of every node closer than range to
+    // queryPoint to scratch.hits_
+    virtual void FindWithinRange(const Eigen::VectorXd &queryPoint,
+                                 double range,
+                                 KDQueryScratch &scratch) const = 0;
+
+    // Maintains scratch.heap_ as a max-heap (by distance) of the k nodes
+    // closest to queryPoint, a node offered twice keeps its smaller distance
+    virtual void FindKNearest(const Eigen::VectorXd &queryPoint, int k,
+                              KDQueryScratch &scratch) const = 0;
+
+    // True if the distance used by the storage wraps the space by itself
+    // (DubinsMetric wraps theta), so KDTree does not search ghost points
+    virtual bool WrapsItself() const { return false; }
+
+    // Sets the distance function for storages that take one (the others
+    // have their own and ignore it)
+    virtual void SetDistanceFunction(double(*func)(Eigen::VectorXd a,
+                                                   Eigen::VectorXd b)) {}
+
+    // Prints the storage starting at index (-1 for the top)
+    virtual void PrintTree(int index, int indent=0, char type=' ')
+    {
+        std::cout << "ERROR: PrintTree not implemented for this storage"
+                  << std::endl;
+    }
+};
+
+#endif // NNSTORAGE_H
@@ -17,6 +17,8 @@ class Obstacle : public std::enable_shared_from_this<Obstacle>
 {
 public:
 
+    int id_ = -1;   // id in the ConfigSpace's ObstacleRegistry (-1 if none)
+
     int kind_;  // 1 = ball
                 // 2 = axis aligned hyperrectangle
                 // 3 = polygon
@@ -181,7 +183,7 @@ public:
     static void ReadTimeObstaclesFromFile(std::string obstacle_file);
     static void ReadDynamicTimeObstaclesFromFile(std::string obstacle_file);
 
-    // Update obstacle position
+    // Update obstacle position (refresh its bounds in the registry after)
     void UpdatePosition(Eigen::VectorXd new_position)
     { this->origin_ = new_position; }
 
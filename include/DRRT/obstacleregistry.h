@@ -0,0 +1,58 @@
+#ifndef OBSTACLEREGISTRY_H
+#define OBSTACLEREGISTRY_H
+
+#include <memory>
+#include <vector>
+
+class Obstacle;
+
+/* The obstacles of a ConfigSpace, kept in a vector. An obstacle's id is
+ * its index and never changes. Next to the obstacles the registry keeps
+ * the bounds of each one struct-of-arrays: the bounding circle the 2D
+ * checks use (origin_ and radius_) and an axis aligned box around that
+ * circle and the obstacle's polygon. NearPoint and InBox sweep these arrays
+ * without branching and return the ids that may be in conflict, so the
+ * expensive checks only run on those. Obstacles that move through time
+ * (kinds 6 and 7) have unbounded bounds and are always returned. Bounds
+ * are a copy, call Refresh after an obstacle moves
+ */
+class ObstacleRegistry {
+public:
+    // Constructor
+    ObstacleRegistry() {}
+
+    // Adds O and sets its id_, returns the id
+    int Add(const std::shared_ptr<Obstacle> &O);
+
+    // Returns the number of obstacles
+    int Size() const { return (int)obstacles_.size(); }
+
+    // Returns the obstacle with id
+    std::shared_ptr<Obstacle>& operator[](int id) { return obstacles_[id]; }
+
+    // Returns all obstacles, ordered by id
+    const std::vector<std::shared_ptr<Obstacle>>& Obstacles() const
+    { return obstacles_; }
+
+    // Copies the bounds of obstacle id again
+    void Refresh(int id);
+
+    // Sets ids to the obstacles whose bounding circle grown by margin
+    // holds the 2D point (x,y)
+    void NearPoint(double x, double y, double margin,
+                   std::vector<int> &ids) const;
+
+    // Sets ids to the obstacles whose box overlaps the box
+    // [min_x,max_x] x [min_y,max_y]
+    void InBox(double min_x, double min_y, double max_x, double max_y,
+               std::vector<int> &ids) const;
+
+private:
+    std::vector<std::shared_ptr<Obstacle>> obstacles_;  // id -> obstacle
+
+    // Bounds, id -> value
+    std::vector<double> center_x_, center_y_, radius_;
+    std::vector<double> min_x_, min_y_, max_x_, max_y_;
+};
+
+#endif // OBSTACLEREGISTRY_H
@@ -0,0 +1,63 @@
+#ifndef POSITIONINDEX_H
+#define POSITIONINDEX_H
+
+#include <DRRT/kdtreenode.h>
+#include <unordered_map>
+
+/* A hash map from quantized position to the nodes there, kept next to a
+ * KDTree for looking nodes up by their exact position and for asking if
+ * there is any node within cell_size_ of a point without walking the
+ * tree. Space is cut into cubes cell_size_ wide, a node is filed under the
+ * hash of the cube it falls in (cubes that collide share a list, which
+ * only costs a few extra comparisons). Along a wrapping dimension the
+ * cubes are widened a bit so that a whole number of them fits between
+ * 0 and the wrap point, and the cube numbers wrap around with the space
+ */
+class PositionIndex {
+public:
+    typedef std::vector<std::shared_ptr<KDTreeNode>> Cell;
+
+    double cell_size_;          // width of a cube
+    int dimensions_;            // the number of dimensions in the space
+    std::vector<int> wrap_cells_;       // cubes along each dimension that
+                                        // wraps (0 if it does not)
+    std::vector<double> wrap_points_;   // where each dimension wraps
+
+    std::unordered_map<unsigned long long,Cell> cells_; // hash -> nodes
+
+    // Constructor
+    PositionIndex(int dimensions, double cell_size,
+                  const Eigen::VectorXi &wraps,
+                  const Eigen::VectorXd &wrap_points);
+
+    // Files node under its position
+    void Insert(const std::shared_ptr<KDTreeNode> &node);
+
+    // Removes node, returns false if it was not in the index
+    bool Remove(const std::shared_ptr<KDTreeNode> &node);
+
+    // Returns the node at exactly pos, or NULL if there is none
+    std::shared_ptr<KDTreeNode> Find(const Eigen::VectorXd &pos) const;
+
+    // Returns true if some node is closer than radius to pos. The radius
+    // may be at most cell_size_ since only the neighboring cubes are looked
+    // at, distance is the same distance function as the KDTree's
+    bool FindWithin(const Eigen::VectorXd &pos, double radius,
+                    double (*distance)(Eigen::VectorXd a,
+                                       Eigen::VectorXd b)) const;
+
+    // Removes every node
+    void Clear() { cells_.clear(); }
+
+private:
+    // Returns the cube coordinate of x along dimension j
+    long CellOf(double x, int j) const;
+
+    // Returns the hash of the cube with the given coordinates
+    unsigned long long Key(const std::vector<long> &cell) const;
+
+    // Returns the hash of the cube that pos falls in
+    unsigned long long KeyOf(const Eigen::VectorXd &pos) const;
+};
+
+#endif // POSITIONINDEX_H
@@ -0,0 +1,465 @@
+#ifndef STATICKDTREE_H
+#define STATICKDTREE_H
+
+#include <DRRT/nnstorage.h>
+#include <future>
+#include <thread>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Distance in the [x,y,theta] space of a Dubin's car where theta wraps
+// around at 2pi (same as distance_function in smalltest.cpp)
+struct DubinsMetric {
+    // Only x and y are used for splitting. Since the theta term wraps
+    // inside the metric, no ghost points are needed when searching
+    enum { kSplitDims = 2, kWrapsItself = 1 };
+
+    template <class Scalar>
+    double operator()(const Eigen::Matrix<double,3,1> &a,
+                      const Eigen::Matrix<Scalar,3,1> &b) const
+    {
+        double dx = a(0) - b(0);
+        double dy = a(1) - b(1);
+        double dt = std::abs(a(2) - b(2));
+        dt = std::min(dt, 2.0*PI - dt);
+        return std::sqrt(dx*dx + dy*dy + dt*dt);
+    }
+
+    // Writes the distance from q to each of the n points in block to out.
+    // Dimension j of point i is at block[j*stride + i] (struct-of-arrays),
+    // stored as float or double but always scored in double.
+    // Uses AVX2 (4 points at a time) or SSE2 (2 at a time) if available,
+    // the results match operator() up to rounding
+    template <class Scalar>
+    static void ScoreBlock(const Eigen::Matrix<double,3,1> &q,
+                           const Scalar *block, int stride, int n,
+                           double *out)
+    {
+        const Scalar *x = block;
+        const Scalar *y = block + stride;
+        const Scalar *t = block + 2*stride;
+        int i = 0;
+#if defined(__AVX2__)
+        const __m256d qx = _mm256_set1_pd(q(0));
+        const __m256d qy = _mm256_set1_pd(q(1));
+        const __m256d qt = _mm256_set1_pd(q(2));
+        const __m256d twoPi = _mm256_set1_pd(2.0*PI);
+        const __m256d signBit = _mm256_set1_pd(-0.0);
+        for( ; i + 4 <= n; i += 4 ) {
+            __m256d dx = _mm256_sub_pd(qx, Load(x + i));
+            __m256d dy = _mm256_sub_pd(qy, Load(y + i));
+            __m256d dt = _mm256_andnot_pd(signBit,
+                            _mm256_sub_pd(qt, Load(t + i)));
+            dt = _mm256_min_pd(dt, _mm256_sub_pd(twoPi, dt));
+            __m256d sum = _mm256_add_pd(
+                        _mm256_add_pd(_mm256_mul_pd(dx, dx),
+                                      _mm256_mul_pd(dy, dy)),
+                        _mm256_mul_pd(dt, dt));
+            _mm256_storeu_pd(out + i, _mm256_sqrt_pd(sum));
+        }
+#elif defined(__SSE2__)
+        const __m128d qx = _mm_set1_pd(q(0));
+        const __m128d qy = _mm_set1_pd(q(1));
+        const __m128d qt = _mm_set1_pd(q(2));
+        const __m128d twoPi = _mm_set1_pd(2.0*PI);
+        const __m128d signBit = _mm_set1_pd(-0.0);
+        for( ; i + 2 <= n; i += 2 ) {
+            __m128d dx = _mm_sub_pd(qx, Load(x + i));
+            __m128d dy = _mm_sub_pd(qy, Load(y + i));
+            __m128d dt = _mm_andnot_pd(signBit,
+                            _mm_sub_pd(qt, Load(t + i)));
+            dt = _mm_min_pd(dt, _mm_sub_pd(twoPi, dt));
+            __m128d sum = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx),
+                                                _mm_mul_pd(dy, dy)),
+                                     _mm_mul_pd(dt, dt));
+            _mm_storeu_pd(out + i, _mm_sqrt_pd(sum));
+        }
+#endif
+        for( ; i < n; i++ ) {
+            double dx = q(0) - x[i];
+            double dy = q(1) - y[i];
+            double dt = std::abs(q(2) - t[i]);
+            dt = std::min(dt, 2.0*PI - dt);
+            out[i] = std::sqrt(dx*dx + dy*dy + dt*dt);
+        }
+    }
+
+private:
+    // Loads the next points of one dimension of a block as doubles
+#if defined(__AVX2__)
+    static __m256d Load(const double *p) { return _mm256_loadu_pd(p); }
+    static __m256d Load(const float *p)
+    { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+#elif defined(__SSE2__)
+    static __m128d Load(const double *p) { return _mm_loadu_pd(p); }
+    static __m128d Load(const float *p)
+    {
+        return _mm_cvtps_pd(_mm_castsi128_ps(
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+    }
+#endif
+};
+
+/* A KD-Tree for a space with a dimension known at compile time. Positions
+ * are stored as fixed size Eigen vectors (of Coord) and the distance is
+ * computed by an (inlinable) Metric functor, so nothing is allocated and
+ * there is no indirect call per distance. The Metric must provide
+ *   double operator()(const Point &a, const Stored &b) const
+ *   enum { kSplitDims = n }  (only dimensions [0,n) are used for splitting)
+ *   enum { kWrapsItself = 0 or 1 }  (1 if it takes care of wrapping)
+ * and |a(i) - b(i)| must be a lower bound on the distance for each of
+ * those n dimensions. Layout, indexing and balancing follow FlatKDTree
+ */
+template <int Dim, class Metric>
+class StaticKDTree : public NNStorage {
+public:
+    typedef Eigen::Matrix<double,Dim,1> Point;   // a query
+    typedef Eigen::Matrix<Coord,Dim,1> Stored;   // a node in the tree
+
+    int root_;                  // index of the root node or -1
+    double balance_;            // largest fraction of a subtree that may
+                                // be on one side before it is rebuilt
+    Metric metric_;             // distance function to use
+
+    std::vector<Stored, Eigen::aligned_allocator<Stored>> positions_;
+    std::vector<int> split_dim_;      // splitting dimension of each node
+    std::vector<Coord> split_value_;  // position along split_dim_
+    std::vector<int> child_L_;        // index of left child or -1
+    std::vector<int> child_R_;        // index of right child or -1
+    std::vector<int> size_;           // number of nodes in each subtree
+
+    // Constructor
+    StaticKDTree() : root_(-1), balance_(0.75) {}
+
+    // Reserves space for n nodes so inserting does not reallocate
+    void Reserve(int n) override
+    {
+        positions_.reserve(n);
+        split_dim_.reserve(n);
+        split_value_.reserve(n);
+        child_L_.reserve(n);
+        child_R_.reserve(n);
+        size_.reserve(n);
+        handles_.reserve(n);
+    }
+
+    // Inserts node into the tree and returns its index
+    int Insert(std::shared_ptr<KDTreeNode> &node) override
+    {
+        int index = tree_size_;
+        Stored position = node->position_.cast<Coord>();
+        positions_.push_back(position);
+        child_L_.push_back(-1);
+        child_R_.push_back(-1);
+        size_.push_back(1);
+        handles_.push_back(node);
+        node->kd_index_ = index;
+
+        // Figure out where to put this node, remembering the path down
+        path_.clear();
+        int split = 0;
+        if( index == 0 ) {
+            root_ = 0;
+        } else {
+            int parent = root_;
+            while( true ) {
+                path_.push_back(parent);
+                size_[parent] += 1;
+                int &child = (position(split_dim_[parent])
+                              < split_value_[parent])
+                        ? child_L_[parent] : child_R_[parent];
+                if( child == -1 ) {
+                    child = index;
+                    break;
+                }
+                parent = child;
+            }
+            split = split_dim_[parent] + 1;
+            if( split == Metric::kSplitDims ) split = 0;
+        }
+        split_dim_.push_back(split);
+        split_value_.push_back(position(split));
+
+        tree_size_ += 1;
+        if( path_.size() > std::log(tree_size_)/std::log(1.0/balance_) ) {
+            Rebalance();
+        }
+        node->kd_split_ = split_dim_[index];
+        return index;
+    }
+
+    // Returns the index of the node at exactly pos, or -1 if not present
+    int FindExact(const Point &pos) const
+    {
+        Stored stored = pos.template cast<Coord>();
+        int index = root_;
+        while( index != -1 ) {
+            if( handles_[index] && positions_[index] == stored ) return index;
+            index = (stored(split_dim_[index]) < split_value_[index])
+                    ? child_L_[index] : child_R_[index];
+        }
+        return -1;
+    }
+
+    int FindExact(const Eigen::VectorXd &pos) const override
+    { return FindExact(Point(pos)); }
+
+    // Appends nodes and links the whole tree up again by median splits,
+    // with the two sides of the larger subtrees built on their own
+    // threads if parallel is true
+    void BulkInsert(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                    bool parallel=false) override
+    {
+        const int size = tree_size_ + (int)nodes.size();
+        Reserve(size);
+        for( int i = 0; i < (int)nodes.size(); i++ ) {
+            positions_.push_back(Stored(nodes[i]->position_.cast<Coord>()));
+            handles_.push_back(nodes[i]);
+            nodes[i]->kd_index_ = tree_size_ + i;
+        }
+        tree_size_ = size;
+        split_dim_.resize(size);
+        split_value_.resize(size);
+        child_L_.resize(size);
+        child_R_.resize(size);
+        size_.resize(size);
+
+        std::vector<int> all(size);
+        for( int i = 0; i < size; i++ ) all[i] = i;
+        int threads = parallel ? (int)std::thread::hardware_concurrency() : 1;
+        root_ = Build(all, 0, size, std::max(threads, 1));
+    }
+
+    // Removed nodes stay in the tree to split the space (searches skip
+    // them) until Compact() is called
+
+    // Drops the removed nodes, gives the others the indices 0,1,... in
+    // the order given (updating their kd_index_) and rebuilds the tree
+    void Renumber(const std::vector<int> &order) override
+    {
+        const int size = (int)order.size();
+        std::vector<Stored, Eigen::aligned_allocator<Stored>> positions(size);
+        std::vector<std::shared_ptr<KDTreeNode>> handles(size);
+        for( int i = 0; i < size; i++ ) {
+            positions[i] = positions_[order[i]];
+            handles[i] = std::move(handles_[order[i]]);
+            handles[i]->kd_index_ = i;
+        }
+        tree_size_ = size;
+        positions_.swap(positions);
+        handles_.swap(handles);
+        split_dim_.resize(size);
+        split_value_.resize(size);
+        child_L_.resize(size);
+        child_R_.resize(size);
+        size_.resize(size);
+
+        std::vector<int> all(size);
+        for( int i = 0; i < size; i++ ) all[i] = i;
+        root_ = Build(all, 0, size);
+    }
+
+    // Updates nearest and nearestDist if there is a node closer to
+    // queryPoint than nearestDist (nearest may start as -1)
+    // scratch.Skip decides which subtrees are searched
+    void FindNearest(const Point &queryPoint, int &nearest,
+                     double &nearestDist, KDQueryScratch &scratch) const
+    {
+        if( tree_size_ == 0 ) return;
+
+        scratch.stack_.clear();
+        scratch.stack_.push_back(std::make_pair(root_, 0.0));
+        while( !scratch.stack_.empty() ) {
+            int index = scratch.stack_.back().first;
+            double bound = scratch.stack_.back().second;
+            scratch.stack_.pop_back();
+            if( scratch.Skip(bound, nearestDist) ) continue;
+
+            if( handles_[index] ) {
+                scratch.visits_++;
+                double newDist = metric_(queryPoint, positions_[index]);
+                if( newDist < nearestDist ) {
+                    nearest = index;
+                    nearestDist = newDist;
+                }
+            }
+            PushChildren(queryPoint, index, bound, scratch);
+        }
+    }
+
+    // Appends (index, distance) of every node closer than range to
+    // queryPoint to scratch.hits_
+    void FindWithinRange(const Point &queryPoint, double range,
+                         KDQueryScratch &scratch) const
+    {
+        if( tree_size_ == 0 ) return;
+
+        scratch.stack_.clear();
+        scratch.stack_.push_back(std::make_pair(root_, 0.0));
+        while( !scratch.stack_.empty() ) {
+            int index = scratch.stack_.back().first;
+            double bound = scratch.stack_.back().second;
+            scratch.stack_.pop_back();
+            if( bound >= range || scratch.Skip(bound, range) ) continue;
+
+            if( handles_[index] ) {
+                scratch.visits_++;
+                double newDist = metric_(queryPoint, positions_[index]);
+                if( newDist < range ) {
+                    scratch.hits_.push_back(std::make_pair(index, newDist));
+                }
+            }
+            PushChildren(queryPoint, index, bound, scratch);
+        }
+    }
+
+    // Maintains scratch.heap_ as a max-heap (by distance) of the k nodes
+    // closest to queryPoint, nodes in the heap are marked in scratch
+    void FindKNearest(const Point &queryPoint, int k,
+                      KDQueryScratch &scratch) const
+    {
+        DaryHeap<KNNOrder> &heap = scratch.heap_;
+        if( tree_size_ == 0 || k <= 0 ) return;
+
+        scratch.stack_.clear();
+        scratch.stack_.push_back(std::make_pair(root_, 0.0));
+        while( !scratch.stack_.empty() ) {
+            int index = scratch.stack_.back().first;
+            double bound = scratch.stack_.back().second;
+            scratch.stack_.pop_back();
+
+            // Worst distance in the heap, INF until there are k nodes in it
+            double worstDist = (heap.Size() < k) ? INF : heap.Top().key_;
+            if( bound > worstDist ) continue;
+
+            if( handles_[index] ) {
+                double newDist = metric_(queryPoint, positions_[index]);
+                if( newDist < worstDist && scratch.Mark(index) ) {
+                    if( heap.Size() == k ) heap.Pop();
+                    heap.Push(newDist, index);
+                }
+            }
+            PushChildren(queryPoint, index, bound, scratch);
+        }
+    }
+
+    // The NNStorage versions of the queries above
+    void FindNearest(const Eigen::VectorXd &queryPoint, int &nearest,
+                     double &nearestDist,
+                     KDQueryScratch &scratch) const override
+    { FindNearest(Point(queryPoint), nearest, nearestDist, scratch); }
+
+    void FindWithinRange(const Eigen::VectorXd &queryPoint, double range,
+                         KDQueryScratch &scratch) const override
+    { FindWithinRange(Point(queryPoint), range, scratch); }
+
+    void FindKNearest(const Eigen::VectorXd &queryPoint, int k,
+                      KDQueryScratch &scratch) const override
+    { FindKNearest(Point(queryPoint), k, scratch); }
+
+    bool WrapsItself() const override { return Metric::kWrapsItself; }
+
+private:
+    std::vector<int> path_;           // nodes above the last insert
+
+    // Rebuilds the lowest subtree on path_ that has more than balance_
+    // of its nodes on one side
+    void Rebalance()
+    {
+        int p = (int)path_.size() - 1;
+        for( ; p >= 0; p-- ) {
+            int n = path_[p];
+            int left = (child_L_[n] == -1) ? 0 : size_[child_L_[n]];
+            int right = (child_R_[n] == -1) ? 0 : size_[child_R_[n]];
+            if( std::max(left, right) > balance_*size_[n] ) break;
+        }
+        if( p < 0 ) return;
+
+        int n = path_[p];
+        std::vector<int> order;
+        order.reserve(size_[n]);
+        order.push_back(n);
+        for( int i = 0; i < (int)order.size(); i++ ) {
+            if( child_L_[order[i]] != -1 ) order.push_back(child_L_[order[i]]);
+            if( child_R_[order[i]] != -1 ) order.push_back(child_R_[order[i]]);
+        }
+        int subtree = Build(order, 0, (int)order.size());
+        if( p == 0 ) root_ = subtree;
+        else if( child_L_[path_[p-1]] == n ) child_L_[path_[p-1]] = subtree;
+        else child_R_[path_[p-1]] = subtree;
+    }
+
+    // Subtrees with more nodes than this get a thread of their own
+    enum { kParallelBuild = 4096 };
+
+    // Links order[lo,hi) into a balanced subtree, splitting each node
+    // along the dimension with the largest spread. Returns the index of
+    // its root (-1 if empty). Up to threads threads are used
+    int Build(std::vector<int> &order, int lo, int hi, int threads=1)
+    {
+        if( lo >= hi ) return -1;
+        int split = 0;
+        double spread = -1.0;
+        for( int j = 0; j < Metric::kSplitDims; j++ ) {
+            double low = INF, high = -INF;
+            for( int i = lo; i < hi; i++ ) {
+                low = std::min(low, (double)positions_[order[i]](j));
+                high = std::max(high, (double)positions_[order[i]](j));
+            }
+            if( high - low > spread ) {
+                spread = high - low;
+                split = j;
+            }
+        }
+        int m = MedianSplit(order, lo, hi, [this, split](int i)
+                            { return positions_[i](split); });
+
+        int index = order[m];
+        split_dim_[index] = split;
+        split_value_[index] = positions_[index](split);
+        size_[index] = hi - lo;
+        if( handles_[index] ) handles_[index]->kd_split_ = split;
+        if( threads > 1 && hi - lo > kParallelBuild ) {
+            std::future<int> left = std::async(std::launch::async,
+                                               &StaticKDTree::Build, this,
+                                               std::ref(order), lo, m,
+                                               threads/2);
+            child_R_[index] = Build(order, m + 1, hi, threads - threads/2);
+            child_L_[index] = left.get();
+            return index;
+        }
+        child_L_[index] = Build(order, lo, m);
+        child_R_[index] = Build(order, m + 1, hi);
+        return index;
+    }
+
+    // Pushes the children of index onto the traversal stack, the far side
+    // first (bounded by the hyperplane distance) so the near side is
+    // searched first
+    void PushChildren(const Point &queryPoint, int index, double bound,
+                      KDQueryScratch &scratch) const
+    {
+        double hyperPlaneDist = queryPoint(split_dim_[index])
+                                - split_value_[index];
+        int nearChild = child_R_[index];
+        int farChild = child_L_[index];
+        if( hyperPlaneDist < 0 ) std::swap(nearChild, farChild);
+
+        if( farChild != -1 ) {
+            scratch.stack_.push_back(
+                        std::make_pair(farChild, std::abs(hyperPlaneDist)));
+        }
+        if( nearChild != -1 ) {
+            scratch.stack_.push_back(std::make_pair(nearChild, bound));
+        }
+    }
+};
+
+// The fixed size tree used for the [x,y,theta] Dubin's space
+typedef StaticKDTree<3, DubinsMetric> DubinsKDTree;
+
+#endif // STATICKDTREE_H
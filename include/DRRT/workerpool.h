@@ -0,0 +1,47 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Threads that are started once and then run one job after another, for
+ * work that is split over threads often and in small pieces, where starting
+ * threads every time would cost as much as the work. Run(job) calls job(i)
+ * for every i below Size(), job(0) on the calling thread and the others on
+ * the pool's threads, and returns once all of them have returned. Calls to
+ * Run from several threads take turns
+ */
+class WorkerPool {
+public:
+    // Constructor, starts threads-1 threads
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Returns how many calls of the job Run makes
+    int Size() const { return (int)threads_.size() + 1; }
+
+    // Calls job(i) for every i below Size() and waits for them
+    void Run(const std::function<void(int)> &job);
+
+private:
+    std::vector<std::thread> threads_;
+    std::mutex run_mutex_;              // held for a whole Run
+    std::mutex mutex_;                  // guards everything below
+    std::condition_variable start_;     // a job is posted or stop_ is set
+    std::condition_variable finished_;  // running_ reached 0
+    const std::function<void(int)> *job_;
+    long generation_;                   // counts the jobs posted
+    int running_;                       // pool threads still in the job
+    bool stop_;
+
+    // Loop of the pool thread that calls job(index)
+    void Work(int index);
+};
+
+#endif // WORKERPOOL_H
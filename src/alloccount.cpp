@@ -0,0 +1,69 @@
+#include <DRRT/alloccount.h>
+
+#ifdef DRRT_COUNT_ALLOCATIONS
+
+#include <new>
+#include <cstdlib>
+
+namespace {
+
+thread_local long allocation_count = 0;
+
+void* CountedAllocate(std::size_t size)
+{
+    allocation_count++;
+    if( size == 0 ) size = 1;
+    while( true ) {
+        void *block = std::malloc(size);
+        if( block ) return block;
+        std::new_handler handler = std::get_new_handler();
+        if( !handler ) throw std::bad_alloc();
+        handler();
+    }
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return CountedAllocate(size); }
+void* operator new[](std::size_t size) { return CountedAllocate(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return CountedAllocate(size);
+    } catch( const std::bad_alloc& ) {
+        return NULL;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return CountedAllocate(size);
+    } catch( const std::bad_alloc& ) {
+        return NULL;
+    }
+}
+
+void operator delete(void *block) noexcept { std::free(block); }
+void operator delete[](void *block) noexcept { std::free(block); }
+void operator delete(void *block, std::size_t) noexcept { std::free(block); }
+void operator delete[](void *block, std::size_t) noexcept { std::free(block); }
+void operator delete(void *block, const std::nothrow_t&) noexcept
+{ std::free(block); }
+void operator delete[](void *block, const std::nothrow_t&) noexcept
+{ std::free(block); }
+
+long AllocationCount()
+{
+    return allocation_count;
+}
+
+#else
+
+long AllocationCount()
+{
+    return -1;
+}
+
+#endif // DRRT_COUNT_ALLOCATIONS
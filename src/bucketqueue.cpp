@@ -0,0 +1,97 @@
+#include <DRRT/bucketqueue.h>
+#include <cmath>
+
+BucketQueue::BucketQueue(double max_key, double width)
+    : width_(width), lowest_(0), size_(0)
+{
+    int n = (max_key > 0.0) ? (int)std::floor(max_key/width) + 1 : 1;
+    this->buckets_.resize(n);
+    this->lowest_ = n;
+}
+
+bool BucketQueue::Add(const std::shared_ptr<KDTreeNode> &node, double key)
+{
+    if( node->in_priority_queue_ ) return false;
+
+    int slot;
+    if( this->free_slots_.empty() ) {
+        slot = (int)this->nodes_.size();
+        this->nodes_.push_back(node);
+        this->bucket_of_.push_back(-1);
+        this->position_of_.push_back(-1);
+    } else {
+        slot = this->free_slots_.back();
+        this->free_slots_.pop_back();
+        this->nodes_[slot] = node;
+    }
+
+    int bucket = BucketOf(key);
+    Entry entry = {key, slot};
+    this->bucket_of_[slot] = bucket;
+    this->position_of_[slot] = (int)this->buckets_[bucket].size();
+    this->buckets_[bucket].push_back(entry);
+    if( bucket < this->lowest_ ) this->lowest_ = bucket;
+    this->size_++;
+
+    node->priority_queue_index_ = slot;
+    node->in_priority_queue_ = true;
+    return true;
+}
+
+bool BucketQueue::Pop(std::shared_ptr<KDTreeNode> &node)
+{
+    if( this->size_ == 0 ) return false;
+    while( this->buckets_[this->lowest_].empty() ) this->lowest_++;
+
+    // Smallest key in the bucket
+    std::vector<Entry> &bucket = this->buckets_[this->lowest_];
+    int best = 0;
+    for( int i = 1; i < (int)bucket.size(); i++ ) {
+        if( bucket[i].key_ < bucket[best].key_ ) best = i;
+    }
+    node = this->nodes_[bucket[best].slot_];
+    Take(this->lowest_, best);
+    return true;
+}
+
+bool BucketQueue::Remove(const std::shared_ptr<KDTreeNode> &node)
+{
+    if( !node->in_priority_queue_ ) return false;
+    int slot = node->priority_queue_index_;
+    Take(this->bucket_of_[slot], this->position_of_[slot]);
+    return true;
+}
+
+void BucketQueue::Clear()
+{
+    for( int b = this->lowest_; b < (int)this->buckets_.size(); b++ ) {
+        while( !this->buckets_[b].empty() ) {
+            Take(b, (int)this->buckets_[b].size() - 1);
+        }
+    }
+    this->lowest_ = (int)this->buckets_.size();
+}
+
+int BucketQueue::BucketOf(double key) const
+{
+    if( !(key > 0.0) ) return 0;
+    double bucket = std::floor(key/this->width_);
+    int last = (int)this->buckets_.size() - 1;
+    return (bucket < last) ? (int)bucket : last;
+}
+
+void BucketQueue::Take(int bucket, int position)
+{
+    std::vector<Entry> &entries = this->buckets_[bucket];
+    int slot = entries[position].slot_;
+    entries[position] = entries.back();
+    this->position_of_[entries[position].slot_] = position;
+    entries.pop_back();
+
+    std::shared_ptr<KDTreeNode> &node = this->nodes_[slot];
+    node->in_priority_queue_ = false;
+    node->priority_queue_index_ = -1;
+    node.reset();
+    this->free_slots_.push_back(slot);
+    this->size_--;
+}
@@ -6,10 +6,16 @@
 
 #include <DRRT/drrt.h>
 #include <DRRT/obstacle.h>
+#include <DRRT/multiqueue.h>
+#include <DRRT/workerpool.h>
+#include <thread>
 
 using namespace std;
 
 bool timing = false;
+
+// Smallest queue that ReduceInconsistency hands to several threads
+static const int kParallelReduceSize = 64;
 int seg_dist_sqrd = 0;
 int dist_sqrd_point_seg = 0;
 
@@ -24,7 +30,7 @@ void PrintRrtxPath(shared_ptr<KDTreeNode> &leaf)
     while(leaf->rrt_parent_used_) {
         cout << "pose: " << leaf->rrt_LMC_ << "\n" << leaf->position_ << endl;
         cout << "VVVVVVVV" << endl;
-        leaf = leaf->rrt_parent_edge_->end_node_;
+        leaf = leaf->rrt_parent_edge_->end_node_->GetPointer();
     }
     cout << leaf->position_ << endl;
 }
@@ -50,7 +56,7 @@ double ExtractPathLength(shared_ptr<KDTreeNode> node,
             break;
         }
         pathLength += node->rrt_parent_edge_->dist_;
-        thisNode = thisNode->rrt_parent_edge_->end_node_;
+        thisNode = thisNode->rrt_parent_edge_->end_node_->GetPointer();
     }
 
     return pathLength;
@@ -62,8 +68,8 @@ bool CheckHeapForEdgeProblems( shared_ptr<Queue> &Q,
                                shared_ptr<KDTree> Tree )
 {
     shared_ptr<KDTreeNode> node;
-    for( int i = 0; i < Q->priority_queue->index_of_last_; i++ ) {
-        node = Q->priority_queue->heap_[i];
+    for( int i = 0; i < Q->priority_queue->Size(); i++ ) {
+        node = Q->priority_queue->Node(i);
         if( CheckNeighborsForEdgeProblems( Q->cspace, node, Tree ) ) return true;
     }
     return false;
@@ -76,26 +82,25 @@ bool CheckNeighborsForEdgeProblems(shared_ptr<ConfigSpace>& C,
     shared_ptr<Edge> this_edge_1, this_edge_2;
     if( thisNode->rrt_parent_used_ ) {
         this_edge_1 = Edge::NewEdge(C, Tree, thisNode,
-                                                   thisNode->rrt_parent_edge_->end_node_);
+                                    thisNode->rrt_parent_edge_->end_node_->GetPointer());
         if( ExplicitEdgeCheck(C, this_edge_1)) {
             return true;
         }
     }
 
-    shared_ptr<JListNode> listItem = thisNode->rrt_neighbors_out_->front_;
+    if( !thisNode->edges_ ) return false;
+    EdgeSet &out = thisNode->edges_->out_;
     shared_ptr<KDTreeNode> neighborNode;
-    while( listItem != listItem->child_ ) {
-        neighborNode = listItem->node_;
+    for( int i = 0; i < out.Size(); i++ ) {
+        neighborNode = out[i]->end_node_->GetPointer();
 
         this_edge_2 = Edge::NewEdge(C, Tree, neighborNode,
-                                  neighborNode->rrt_parent_edge_->end_node_);
+                                  neighborNode->rrt_parent_edge_->end_node_->GetPointer());
 
         if( neighborNode->rrt_parent_used_
                 && ExplicitEdgeCheck(C,this_edge_2)) {
             return true;
         }
-
-        listItem = listItem->child_; // iterate
     }
     return false;
 }
@@ -191,6 +196,24 @@ int FindIndexBeforeTime(Eigen::MatrixXd path, double timeToFind)
 
 /////////////////////// RRT Functions ///////////////////////
 
+// Takes back the links FindBestParent left at other nodes for a new_node
+// that does not go into the graph, they would point at it once it is
+// freed. The caller holds tree_mutex_
+static void DiscardNewNode(shared_ptr<KDTreeNode> &new_node,
+                           KDResults &near_nodes)
+{
+    if( new_node->rrt_parent_used_ ) {
+        new_node->RemoveFromSuccessors();
+        new_node->rrt_parent_used_ = false;
+        new_node->rrt_parent_edge_.reset();
+    }
+    for( int i = 0; i < (int)near_nodes.size(); i++ ) {
+        shared_ptr<Edge> &edge = near_nodes[i].first->temp_edge_;
+        if( edge && edge->start_node_ == new_node.get() ) edge.reset();
+    }
+    near_nodes.clear(); // do not keep the nodes alive
+}
+
 bool Extend(shared_ptr<KDTree> &Tree,
             shared_ptr<Queue> &Q,
             shared_ptr<KDTreeNode> &new_node,
@@ -205,40 +228,66 @@ bool Extend(shared_ptr<KDTree> &Tree,
     chrono::steady_clock::time_point t2, f2;
     double deltat;
 
+    // Skip samples that land next to a node already in the graph (the
+    // goal has to go in regardless)
+    if( Q->min_node_spacing > 0.0 && new_node != Q->cspace->goal_node_
+            && Tree->KDHasNodeWithin(new_node->position_,
+                                     Q->min_node_spacing) ) {
+        return false;
+    }
+
     // Find all nodes within the (shrinking) hyper ball of
-    // (saturated) new_node
-    // true argument for using KDTreeNodes as elements
-    shared_ptr<JList> node_list = make_shared<JList>(true);
+    // (saturated) new_node. Each thread reuses its own result vector
+    // (the KDTree takes its own shared lock, so this runs in parallel with
+    // the other threads' queries)
+    static thread_local KDResults near_nodes;
     t1 = chrono::steady_clock::now();
-    {
-        lock_guard<mutex> lock(Tree->tree_mutex_);
-        Tree->KDFindWithinRange(node_list, hyper_ball_rad, new_node->position_);
+    if( Q->k_nearest > 0 ) {
+        // k-nearest RRTx: use the k nearest nodes instead, which bounds the
+        // work per iteration. Edges are still at most saturation_delta_ long
+        Tree->KDFindKNearest(Q->k_nearest, new_node->position_, near_nodes);
+        int i = 0;
+        while( i < (int)near_nodes.size()
+               && near_nodes[i].second <= Q->cspace->saturation_delta_ ) i++;
+        near_nodes.erase(near_nodes.begin() + i, near_nodes.end());
+    } else {
+        // FindBestParent ranks the neighbors itself, so missing a few far
+        // ones is fine (see KDTree::SetApproximation)
+        Tree->KDFindWithinRange(hyper_ball_rad, new_node->position_,
+                                near_nodes, false, true);
     }
     t2 = chrono::steady_clock::now();
     deltat = chrono::duration_cast<chrono::duration<double> >(t2 - t1).count();
-    if(timing) cout << "KDFindWithinRange: " << deltat << " s" << endl;
+    if(timing) cout << "KDFindWithinRange: " << deltat << " s (error "
+                    << Tree->KDApproxError() << ")" << endl;
 
     // Try to find and link to best parent. This also saves
     // the edges from new_node to the neighbors in the field
     // "temp_edge_" of the neighbors. This saves time in the
     // case that trajectory calculation is complicated.
     t1 = chrono::steady_clock::now();
-    FindBestParent(Q->cspace, Tree, new_node, node_list, closest_node, true);
+    FindBestParent(Q->cspace, Tree, new_node, near_nodes, closest_node, true);
     t2 = chrono::steady_clock::now();
     deltat = chrono::duration_cast<chrono::duration<double> >(t2 - t1).count();
     if(timing) cout << "FindBestParent: " << deltat << " s" << endl;
 
     // If no parent was found then ignore this node
     if( !new_node->rrt_parent_used_ ) {
-        Tree->EmptyRangeList(node_list); // clean up
+        lock_guard<mutex> lock(Tree->tree_mutex_);
+        DiscardNewNode(new_node, near_nodes);
         return false;
     }
 
-    // Insert the new node into the KDTree
+    // Insert the new node into the KDTree, unless its parent was
+    // pruned (see PruneGraph) while we were looking for it
     t1 = chrono::steady_clock::now();
     {
         lock_guard<mutex> lock(Tree->tree_mutex_);
-        Tree->KDInsert(new_node);
+        if( !new_node->rrt_parent_edge_->end_node_->kd_in_tree_
+                || !Tree->KDInsert(new_node) ) {
+            DiscardNewNode(new_node, near_nodes);
+            return false;
+        }
     }
     t2 = chrono::steady_clock::now();
     deltat = chrono::duration_cast<chrono::duration<double> >(t2 - t1).count();
@@ -248,20 +297,19 @@ bool Extend(shared_ptr<KDTree> &Tree,
     // and rewire neighbors that would do better to use new_node as
     // their parent. Note that the edges -from- new_node -to- its
     // neighbors have been stored in "temp_edge_" field of the neighbors
-    shared_ptr<JListNode> list_item = node_list->front_;
     shared_ptr<KDTreeNode> near_node;
     shared_ptr<Edge> this_edge;
     double old_LMC;
 
-    for( int i = 0; i < node_list->length_; i++ ) {
-        near_node = list_item->node_;
+    for( int i = 0; i < (int)near_nodes.size(); i++ ) {
+        near_node = near_nodes[i].first;
 
         // If edge from new_node to nearNode was valid
-        if(list_item->key_ != -1.0) {
+        if(near_nodes[i].second != -1.0) {
             // Add to initial out neighbor list of new_node
             // (allows info propogation from new_node to nearNode always)
-            {
-                lock_guard<mutex> lock(Tree->tree_mutex_);
+            lock_guard<mutex> lock(Tree->tree_mutex_);
+            if( near_node->kd_in_tree_ ) {
                 MakeInitialOutNeighborOf(near_node,new_node,
                                          near_node->temp_edge_);
 
@@ -300,8 +348,8 @@ bool Extend(shared_ptr<KDTree> &Tree,
             // Add to initial in neighbor list of newnode
             // (allows information propogation from new_node to
             // nearNode always)
-            {
-                lock_guard<mutex> lock(Tree->tree_mutex_);
+            lock_guard<mutex> lock(Tree->tree_mutex_);
+            if( new_node->kd_in_tree_ && near_node->kd_in_tree_ ) {
                 t1 = chrono::steady_clock::now();
                 MakeInitialInNeighborOf( new_node, near_node, this_edge );
                 t2 = chrono::steady_clock::now();
@@ -317,7 +365,6 @@ bool Extend(shared_ptr<KDTree> &Tree,
             }
         } else {
             // Edge cannot be created
-            list_item = list_item->child_; // iterate through list
             continue;
         }
 
@@ -327,8 +374,9 @@ bool Extend(shared_ptr<KDTree> &Tree,
         t1 = chrono::steady_clock::now();
         {
             lock_guard<mutex> lock(Tree->tree_mutex_);
-            if( near_node->rrt_LMC_ > new_node->rrt_LMC_ + this_edge->dist_
-                    && new_node->rrt_parent_edge_->end_node_ != near_node
+            if( new_node->kd_in_tree_ && near_node->kd_in_tree_
+                    && near_node->rrt_LMC_ > new_node->rrt_LMC_ + this_edge->dist_
+                    && new_node->rrt_parent_edge_->end_node_ != near_node.get()
                     && new_node->rrt_LMC_ + this_edge->dist_ < move_goal->rrt_LMC_ ) {
                 // Make this node the parent of the neighbor node
                 MakeParentOf( new_node, near_node, this_edge);
@@ -350,10 +398,9 @@ bool Extend(shared_ptr<KDTree> &Tree,
                 (t2 - t1).count();
         if(timing) cout << "MakeParentOf: " << deltat << " s" << endl;
 
-        list_item = list_item->child_; // iterate through list
     }
 
-    Tree->EmptyRangeList(node_list); // clean up
+    near_nodes.clear(); // do not keep the nodes alive
 
     // Insert the node into the priority queue
     Q->priority_queue->AddToHeap(new_node);
@@ -367,7 +414,7 @@ bool Extend(shared_ptr<KDTree> &Tree,
 void FindBestParent(shared_ptr<ConfigSpace> &C,
                     shared_ptr<KDTree> &Tree,
                     shared_ptr<KDTreeNode>& new_node,
-                    shared_ptr<JList> &node_list,
+                    KDResults &near_nodes,
                     shared_ptr<KDTreeNode>& closest_node,
                     bool save_all_edges)
 {
@@ -379,8 +426,10 @@ void FindBestParent(shared_ptr<ConfigSpace> &C,
     // If the list is empty
     {
         lock_guard<mutex> lock(C->cspace_mutex_);
-        if(node_list->length_ == 0) {
-            if(C->goal_node_ != new_node) node_list->JListPush(closest_node);
+        if(near_nodes.empty()) {
+            if(C->goal_node_ != new_node) {
+                near_nodes.push_back(make_pair(closest_node, -1.0));
+            }
         }
     }
 
@@ -390,12 +439,11 @@ void FindBestParent(shared_ptr<ConfigSpace> &C,
     new_node->rrt_parent_used_ = false;
 
     // Find best parent (or if one even exists)
-    shared_ptr<JListNode> listItem = node_list->front_;
     shared_ptr<KDTreeNode> nearNode;
     shared_ptr<Edge> thisEdge;
     w1 = chrono::steady_clock::now();
-    while(listItem->child_ != listItem) {
-        nearNode = listItem->node_;
+    for(int i = 0; i < (int)near_nodes.size(); i++) {
+        nearNode = near_nodes[i].first;
 
         // First calculate the shortest trajectory (and its distance)
         // that gets from newNode to nearNode while obeying the
@@ -430,7 +478,6 @@ void FindBestParent(shared_ptr<ConfigSpace> &C,
                 lock_guard<mutex> lock(Tree->tree_mutex_);
                 if(save_all_edges) nearNode->temp_edge_->dist_ = INF;
             }
-            listItem = listItem->child_; // iterate through list
             continue;
         }
 
@@ -455,36 +502,66 @@ void FindBestParent(shared_ptr<ConfigSpace> &C,
         }
         w1 = chrono::steady_clock::now();
 
-        listItem = listItem->child_; // iterate thorugh list
     }
 }
 
 
 /////////////////////// RRT# Functions ///////////////////////
 
-void ResetNeighborIterator( shared_ptr<RrtNodeNeighborIterator> &It )
-{ It->list_flag = 0; }
+void ResetNeighborIterator( RrtNodeNeighborIterator &It )
+{ It.list_flag = 0; }
 
 void MakeNeighborOf(shared_ptr<KDTreeNode> &new_neighbor,
                     shared_ptr<KDTreeNode> &node,
                     shared_ptr<Edge> &edge)
 {
-    node->rrt_neighbors_out_->JListPush( edge );
-    edge->list_item_in_start_node_ = node->rrt_neighbors_out_->front_;
+    // The sets keep edge's index_in_start_node_/index_in_end_node_
+    const shared_ptr<GraphArena> &arena = edge->cspace_->arena_;
+    NodeEdges &edges = node->Edges(arena);
+    edges.out_.Push( edge );
+    edges.cull_radius_ = max(edges.cull_radius_, edge->dist_original_);
+    new_neighbor->Edges(arena).in_.Push( edge );
+}
+
+// Returns the node at the other end of edge from node
+static KDTreeNode* OtherEnd(const Edge *edge, const KDTreeNode *node)
+{ return (edge->start_node_ == node) ? edge->end_node_ : edge->start_node_; }
 
-    new_neighbor->rrt_neighbors_in_->JListPush( edge );
-    edge->list_item_in_end_node_ = new_neighbor->rrt_neighbors_in_->front_;
+// Takes edge out of the initial edges of node that hold it, returns false
+// if none do
+static bool RemoveInitialEdge(NodeEdges &edges, const Edge *edge)
+{
+    return edges.initial_out_.Remove(edge) || edges.initial_in_.Remove(edge)
+            || edges.initial_refs_.Remove(edge);
+}
+
+// Puts edge in set, initial_out_ or initial_in_ of node. The node at the
+// other end of edge holds on to it in initial_refs_, unless it already has
+// edge as an initial edge
+static void LinkInitialEdge(KDTreeNode *node, EdgeSet NodeEdges::*set,
+                            shared_ptr<Edge> &edge)
+{
+    const shared_ptr<GraphArena> &arena = edge->cspace_->arena_;
+    NodeEdges &edges = node->Edges(arena);
+    edges.initial_refs_.Remove(edge.get()); // it is node's own edge now
+    (edges.*set).Push(edge);
+
+    KDTreeNode *other = OtherEnd(edge.get(), node);
+    if( other == node ) return;
+    int index = (edge->start_node_ == other) ? edge->index_in_start_initial_
+                                             : edge->index_in_end_initial_;
+    if( index < 0 ) other->Edges(arena).initial_refs_.Push(edge);
 }
 
 void MakeInitialOutNeighborOf(shared_ptr<KDTreeNode> &new_neighbor,
                               shared_ptr<KDTreeNode> &node,
                               shared_ptr<Edge> &edge)
-{ node->initial_neighbor_list_out_->JListPush(edge); }
+{ LinkInitialEdge(node.get(), &NodeEdges::initial_out_, edge); }
 
 void MakeInitialInNeighborOf(shared_ptr<KDTreeNode> &new_neighbor,
                              shared_ptr<KDTreeNode> &node,
                              shared_ptr<Edge> &edge)
-{ node->initial_neighbor_list_in_->JListPush(edge); }
+{ LinkInitialEdge(node.get(), &NodeEdges::initial_in_, edge); }
 
 void UpdateQueue(shared_ptr<Queue> &Q,
                   shared_ptr<KDTreeNode> &new_node,
@@ -492,10 +569,7 @@ void UpdateQueue(shared_ptr<Queue> &Q,
                   double hyper_ball_rad )
 {
     RecalculateLMC( Q, new_node, root, hyper_ball_rad ); // internally ignores root
-    if( Q->priority_queue->markedQ( new_node ) ) {
-        Q->priority_queue->UpdateHeap( new_node );
-        Q->priority_queue->RemoveFromHeap( new_node );
-    }
+    Q->priority_queue->RemoveFromHeap( new_node );
     if( new_node->rrt_tree_cost_ != new_node->rrt_LMC_ ) {
         Q->priority_queue->AddToHeap( new_node );
     }
@@ -507,9 +581,16 @@ void ReduceInconsistency(shared_ptr<Queue> &Q,
                          shared_ptr<KDTreeNode> &root,
                          double hyper_ball_rad)
 {
+    if( Q->reduce_threads > 1
+            && Q->priority_queue->Size() >= kParallelReduceSize ) {
+        ParallelReduceInconsistency(Q, goal_node, robot_rad, root,
+                                    hyper_ball_rad, Q->reduce_threads);
+        return;
+    }
+
     shared_ptr<KDTreeNode> this_node;
     Q->priority_queue->TopHeap(this_node);
-    while( Q->priority_queue->index_of_last_ > 0
+    while( Q->priority_queue->Size() > 0
            && (Q->priority_queue->lessThan(this_node, goal_node)
                || goal_node->rrt_LMC_ == INF
                || goal_node->rrt_tree_cost_ == INF
@@ -528,6 +609,212 @@ void ReduceInconsistency(shared_ptr<Queue> &Q,
 }
 
 
+// State shared by the threads of ParallelReduceInconsistency
+struct ReduceWork {
+    MultiQueue queue;       // nodes to process, those with in_heap_ set count
+    NodeLocks locks;        // guard the costs, parents and successor lists
+    atomic<int> busy;       // threads that are processing a node
+    atomic<bool> done;      // set once nothing left comes before the goal
+
+    ReduceWork(int threads) : queue(threads), busy(0), done(false) {}
+};
+
+// Returns the parent of node (locked by the caller), NULL if it has none
+static KDTreeNode* ParentOf(const KDTreeNode *node)
+{
+    return node->rrt_parent_used_ ? node->rrt_parent_edge_->end_node_ : NULL;
+}
+
+// RecalculateLMC for ParallelReduceInconsistency, without culling
+static void ParallelRecalculateLMC(ReduceWork &work,
+                                   shared_ptr<KDTreeNode> &node)
+{
+    double best_LMC;
+    {
+        NodeLocks::Guard guard(work.locks, node.get());
+        best_LMC = node->rrt_LMC_;
+    }
+
+    // Look for the best parent with each neighbor locked on its own
+    shared_ptr<KDTreeNode> best_parent;
+    shared_ptr<Edge> best_edge;
+    RrtNodeNeighborIterator out_neighbors(node);
+    shared_ptr<Edge> *item;
+    while( (item = NextOutNeighbor(out_neighbors)) != NULL ) {
+        shared_ptr<Edge> &edge = *item;
+        KDTreeNode *neighbor = edge->end_node_;
+        if( !neighbor->in_OS_queue_ && edge->ValidMove() ) {
+            NodeLocks::Guard guard(work.locks, neighbor);
+            if( best_LMC > neighbor->rrt_LMC_ + edge->dist_
+                    && ParentOf(neighbor) != node.get() ) {
+                best_LMC = neighbor->rrt_LMC_ + edge->dist_;
+                best_parent = neighbor->GetPointer();
+                best_edge = edge;
+            }
+        }
+    }
+    if( !best_parent ) return;
+
+    // Then switch parents with node, the new and the old parent locked
+    while( true ) {
+        KDTreeNode *old_parent;
+        {
+            NodeLocks::Guard guard(work.locks, node.get());
+            old_parent = ParentOf(node.get());
+        }
+        NodeLocks::Guard guard(work.locks, node.get(), best_parent.get(),
+                               old_parent);
+        if( ParentOf(node.get()) != old_parent ) continue; // changed meanwhile
+
+        if( node->rrt_LMC_ > best_parent->rrt_LMC_ + best_edge->dist_
+                && ParentOf(best_parent.get()) != node.get() ) {
+            node->rrt_LMC_ = best_parent->rrt_LMC_ + best_edge->dist_;
+            MakeParentOf(best_parent, node, best_edge);
+        }
+        return;
+    }
+}
+
+// Rewire for ParallelReduceInconsistency, without culling. Returns the
+// LMC of node that its neighbors were rewired with
+static double ParallelRewire(ReduceWork &work, shared_ptr<Queue> &Q,
+                             shared_ptr<KDTreeNode> &node)
+{
+    double LMC;
+    {
+        NodeLocks::Guard guard(work.locks, node.get());
+        LMC = node->rrt_LMC_;
+        if( node->rrt_tree_cost_ - LMC <= Q->change_thresh ) return LMC;
+    }
+
+    RrtNodeNeighborIterator in_neighbors(node);
+    shared_ptr<Edge> *item;
+    while( (item = NextInNeighbor(in_neighbors)) != NULL ) {
+        shared_ptr<Edge> &edge = *item;
+        KDTreeNode *neighbor = edge->start_node_;
+        while( edge->ValidMove() ) {
+            KDTreeNode *old_parent;
+            {
+                NodeLocks::Guard guard(work.locks, neighbor);
+                if( neighbor->rrt_LMC_ <= LMC + edge->dist_ ) break;
+                old_parent = ParentOf(neighbor);
+            }
+            NodeLocks::Guard guard(work.locks, node.get(), neighbor,
+                                   old_parent);
+            if( ParentOf(neighbor) != old_parent ) continue;
+
+            // Ignore this node's parent, otherwise the same as Rewire
+            if( ParentOf(node.get()) != neighbor
+                    && neighbor->rrt_LMC_ > LMC + edge->dist_
+                    && old_parent != node.get() ) {
+                shared_ptr<KDTreeNode> rewired = neighbor->GetPointer();
+                neighbor->rrt_LMC_ = LMC + edge->dist_;
+                MakeParentOf(node, rewired, edge);
+                if( neighbor->rrt_tree_cost_ - neighbor->rrt_LMC_
+                        > Q->change_thresh ) {
+                    neighbor->in_heap_ = true;
+                    work.queue.Push(rewired);
+                }
+            }
+            break;
+        }
+    }
+    return LMC;
+}
+
+// Takes nodes near the top of the queue and processes them the way
+// ReduceInconsistency does until no node left comes before the goal
+static void ReduceWorker(ReduceWork &work, shared_ptr<Queue> &Q,
+                         shared_ptr<KDTreeNode> &goal_node,
+                         shared_ptr<KDTreeNode> &root)
+{
+    shared_ptr<KDTreeNode> node;
+    double key;
+    while( !work.done ) {
+        work.busy++;
+        if( !work.queue.Pop(node, key) ) {
+            // Empty, but a busy thread may still add nodes
+            work.busy--;
+            if( work.busy == 0 && work.queue.Size() == 0 ) return;
+            this_thread::yield();
+            continue;
+        }
+
+        bool rewire = false;
+        {
+            NodeLocks::Guard guard(work.locks, node.get(), goal_node.get());
+            if( !node->in_heap_ ) {
+                // Stale entry of a node that was already processed
+            } else if( !PriorityQueue::lessThan(node, goal_node)
+                       && goal_node->rrt_LMC_ != INF
+                       && goal_node->rrt_tree_cost_ != INF
+                       && !goal_node->in_heap_ ) {
+                // Put it back and stop if nothing in the queue comes before
+                // the goal (the pop was only near the top)
+                work.queue.Push(node);
+                double min_key;
+                int min_tie;
+                double goal_key = PriorityQueue::Key(*goal_node);
+                if( !work.queue.Min(min_key, min_tie)
+                        || min_key > goal_key
+                        || (min_key == goal_key && min_tie != 0) ) {
+                    work.done = true;
+                }
+            } else {
+                node->in_heap_ = false;
+                if( node->rrt_tree_cost_ - node->rrt_LMC_ > Q->change_thresh ) {
+                    rewire = true;
+                } else {
+                    node->rrt_tree_cost_ = node->rrt_LMC_;
+                }
+            }
+        }
+
+        if( rewire ) {
+            if( node != root ) ParallelRecalculateLMC(work, node);
+            double LMC = ParallelRewire(work, Q, node);
+
+            // Only as consistent as the LMC its neighbors saw, if that has
+            // gone down since then node is back in the queue
+            NodeLocks::Guard guard(work.locks, node.get());
+            node->rrt_tree_cost_ = LMC;
+        }
+        node.reset();
+        work.busy--;
+    }
+}
+
+void ParallelReduceInconsistency(shared_ptr<Queue> &Q,
+                                 shared_ptr<KDTreeNode> &goal_node,
+                                 double robot_rad,
+                                 shared_ptr<KDTreeNode> &root,
+                                 double hyper_ball_rad,
+                                 int threads)
+{
+    ReduceWork work(threads);
+    vector<shared_ptr<KDTreeNode>> nodes;
+    Q->priority_queue->CleanHeap(nodes);
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        nodes[i]->in_heap_ = true;
+        work.queue.Push(nodes[i]);
+    }
+
+    // The threads are kept in Q for the next call
+    if( !Q->reduce_pool || Q->reduce_pool->Size() != threads ) {
+        Q->reduce_pool = make_shared<WorkerPool>(threads);
+    }
+    Q->reduce_pool->Run([&](int) { ReduceWorker(work, Q, goal_node, root); });
+
+    // Whatever is left goes back to the priority queue
+    work.queue.Drain(nodes);
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        if( !nodes[i]->in_heap_ ) continue; // stale or already put back
+        nodes[i]->in_heap_ = false;
+        Q->priority_queue->AddToHeap(nodes[i]);
+    }
+}
+
+
 /////////////////////// RRTx Functions ///////////////////////
 
 void MarkOS( shared_ptr<KDTreeNode> &node )
@@ -547,7 +834,7 @@ bool MarkedOS( shared_ptr<KDTreeNode> node )
 
 bool VerifyInQueue(shared_ptr<Queue> &Q, shared_ptr<KDTreeNode> &node)
 {
-    if( Q->priority_queue->markedQ(node) ) {
+    if( Q->priority_queue->marked(node) ) {
        return Q->priority_queue->UpdateHeap(node);
     } else {
        return Q->priority_queue->AddToHeap(node);
@@ -556,10 +843,7 @@ bool VerifyInQueue(shared_ptr<Queue> &Q, shared_ptr<KDTreeNode> &node)
 
 bool VerifyInOSQueue(shared_ptr<Queue> &Q, shared_ptr<KDTreeNode> &node)
 {
-    if( Q->priority_queue->markedQ(node) ) {
-        Q->priority_queue->UpdateHeap(node);
-        Q->priority_queue->RemoveFromHeap(node);
-    }
+    Q->priority_queue->RemoveFromHeap(node);
     if( !MarkedOS(node) ) {
         MarkOS(node);
         Q->obs_successors->JListPush(node);
@@ -569,94 +853,85 @@ bool VerifyInOSQueue(shared_ptr<Queue> &Q, shared_ptr<KDTreeNode> &node)
 
 void CullCurrentNeighbors(shared_ptr<KDTreeNode> &node, double hyper_ball_rad )
 {
-    // Remove outgoing edges from node that are now too long
-    shared_ptr<JListNode> listItem = node->rrt_neighbors_out_->front_;
-    shared_ptr<JListNode> nextItem;
+    // Remove outgoing edges from node that are now too long. They are
+    // sorted by length, so they all sit at the end of the set
+    if( !node->edges_ ) return;
+    NodeEdges &edges = *node->edges_;
+    if( hyper_ball_rad >= edges.cull_radius_ ) return; // culled already
+
+    EdgeSet &out = edges.out_;
     shared_ptr<Edge> neighborEdge;
-    shared_ptr<KDTreeNode> neighborNode;
-    while( listItem != listItem->child_ ) {
-        nextItem = listItem->child_; // since we may remove listItem from list
-        if( listItem->edge_->dist_ > hyper_ball_rad ) {
-            neighborEdge = listItem->edge_;
-            neighborNode = neighborEdge->end_node_;
-            node->rrt_neighbors_out_->JListRemove(
-                        neighborEdge->list_item_in_start_node_);
-            neighborNode->rrt_neighbors_in_->JListRemove(
-                        neighborEdge->list_item_in_end_node_);
-        }
-        listItem = nextItem;
+    while( out.Size() > 0
+           && out[out.Size()-1]->dist_original_ > hyper_ball_rad ) {
+        neighborEdge = out[out.Size()-1];
+        out.RemoveAt(out.Size()-1);
+        NodeEdges *end_edges = neighborEdge->end_node_->edges_.get();
+        if( end_edges ) end_edges->in_.Remove(neighborEdge.get());
     }
+    edges.cull_radius_ = hyper_ball_rad;
 }
 
-shared_ptr<JListNode> NextOutNeighbor(shared_ptr<RrtNodeNeighborIterator> &It)
+shared_ptr<Edge>* NextOutNeighbor(RrtNodeNeighborIterator &It)
 {
-    if( It->list_flag == 0 ) {
-        It->current_item = It->this_node->initial_neighbor_list_out_->front_;
-        It->list_flag = 1;
-    } else {
-        It->current_item = It->current_item->child_;
+    NodeEdges *edges = It.this_node->edges_.get();
+    if( edges == NULL ) return NULL;
+    if( It.list_flag == 0 ) {
+        It.current_item = -1;
+        It.list_flag = 1;
     }
-    while( It->current_item == It->current_item->child_ ) {
-        // Go to the next place tha neighbors are stored
-        if( It->list_flag == 1 ) {
-            It->current_item = It->this_node->rrt_neighbors_out_->front_;
-        } else {
-            // Done with all neighbors
-            // Returns empty JListNode with empty KDTreeNode
-            // so can check for this by checking return_value->key == -1
-            return make_shared<JListNode>();
+    if( It.list_flag == 1 ) {
+        if( ++It.current_item < edges->initial_out_.Size() ) {
+            return &edges->initial_out_[It.current_item];
         }
-        It->list_flag += 1;
+        // Go to the next place that neighbors are stored
+        It.current_item = -1;
+        It.list_flag = 2;
     }
-    return It->current_item;
+    if( It.list_flag == 2 ) {
+        if( ++It.current_item < edges->out_.Size() ) {
+            return &edges->out_[It.current_item];
+        }
+        It.list_flag = 3; // done with all neighbors
+    }
+    return NULL;
 }
 
-shared_ptr<JListNode> NextInNeighbor(shared_ptr<RrtNodeNeighborIterator> &It)
+shared_ptr<Edge>* NextInNeighbor(RrtNodeNeighborIterator &It)
 {
-    if( It->list_flag == 0 ) {
-        It->current_item = It->this_node->initial_neighbor_list_in_->front_;
-        It->list_flag = 1;
-    } else {
-        It->current_item = It->current_item->child_;
+    NodeEdges *edges = It.this_node->edges_.get();
+    if( edges == NULL ) return NULL;
+    if( It.list_flag == 0 ) {
+        It.current_item = -1;
+        It.list_flag = 1;
     }
-    while( It->current_item == It->current_item->child_ ) {
+    if( It.list_flag == 1 ) {
+        if( ++It.current_item < edges->initial_in_.Size() ) {
+            return &edges->initial_in_[It.current_item];
+        }
         // Go to the next place that neighbors are stored
-        if( It->list_flag == 1 ) {
-            It->current_item = It->this_node->rrt_neighbors_in_->front_;
-        } else {
-            // Done with all neighbors
-            // Returns empty JListNode with empty KDTreeNode
-            // so can check for this by checking return_value->key == -1
-            return make_shared<JListNode>();
+        It.current_item = -1;
+        It.list_flag = 2;
+    }
+    if( It.list_flag == 2 ) {
+        if( ++It.current_item < edges->in_.Size() ) {
+            return &edges->in_[It.current_item];
         }
-        It->list_flag += 1;
+        It.list_flag = 3; // done with all neighbors
     }
-    return It->current_item;
+    return NULL;
 }
 
 void MakeParentOf(shared_ptr<KDTreeNode> &new_parent,
                   shared_ptr<KDTreeNode> &node,
                   shared_ptr<Edge> &edge)
 {
-    // Remove the node from its old parent's successor list
-    if( node->rrt_parent_used_ ) {
-        node->rrt_parent_edge_->end_node_->successor_list_->JListRemove(
-                    node->successor_list_item_in_parent_ );
-    }
-
     // Make newParent the parent of node
     node->rrt_parent_edge_ = edge;
     node->rrt_parent_used_ = true;
 
-    // Place a (non-trajectory) reverse edge into newParent's
-    // successor list and save a pointer to its position_ in
-    // that list. This edge is used to help keep track of
-    // successors and not for movement.
-    shared_ptr<Edge> backEdge
-            = Edge::Edge::NewEdge(edge->cspace_, edge->tree_, new_parent, node );
-    backEdge->dist_ = INF;
-    new_parent->successor_list_->JListPush( backEdge, INF );
-    node->successor_list_item_in_parent_ = new_parent->successor_list_->front_;
+    // And move node from its old parent's successor list to newParent's,
+    // the caller holds the locks of all three if that is needed
+    new_parent->AddSuccessor(node.get());
 }
 
 bool RecalculateLMC(shared_ptr<Queue> &Q,
@@ -672,42 +947,34 @@ bool RecalculateLMC(shared_ptr<Queue> &Q,
     double neighborDist;
     shared_ptr<KDTreeNode> rrtParent, neighborNode;
     shared_ptr<Edge> parentEdge, neighborEdge;
-    shared_ptr<JListNode> listItem, nextItem;
+    shared_ptr<Edge> *item;
 
     // Remove outdated nodes from current neighbors list
     CullCurrentNeighbors( node, hyper_ball_rad );
 
     // Get an iterator for this node's neighbors
-    shared_ptr<RrtNodeNeighborIterator> thisNodeOutNeighbors
-            = make_shared<RrtNodeNeighborIterator>(node);
-
-    // Set the iterator to the first neighbor
-    listItem = NextOutNeighbor( thisNodeOutNeighbors );
+    RrtNodeNeighborIterator thisNodeOutNeighbors(node);
 
-    while( listItem->key_ != -1.0 ) {
-        neighborEdge = listItem->edge_;
-        neighborNode = neighborEdge->end_node_;
+    while( (item = NextOutNeighbor( thisNodeOutNeighbors )) != NULL ) {
+        neighborEdge = *item;
+        neighborNode = neighborEdge->end_node_->GetPointer();
         neighborDist = neighborEdge->dist_;
-        nextItem = listItem->child_;
 
         if( MarkedOS(neighborNode) ) {
             // neighborNode is already in OS queue (orphaned) or unwired
-            listItem = NextOutNeighbor( thisNodeOutNeighbors );
             continue;
         }
 
         if( node->rrt_LMC_ > neighborNode->rrt_LMC_ + neighborDist
                 && (!neighborNode->rrt_parent_used_
-                    || neighborNode->rrt_parent_edge_->end_node_ != node)
+                    || neighborNode->rrt_parent_edge_->end_node_ != node.get())
                 && neighborEdge->ValidMove() ) {
             // Found a better parent
             node->rrt_LMC_ = neighborNode->rrt_LMC_ + neighborDist;
             rrtParent = neighborNode;
-            parentEdge = listItem->edge_;
+            parentEdge = neighborEdge;
             newParentFound = true;
         }
-
-        listItem = NextOutNeighbor( thisNodeOutNeighbors );
     }
 
     if( newParentFound ) { // this node found a viable parent
@@ -734,33 +1001,28 @@ bool Rewire(shared_ptr<Queue> &Q,
     CullCurrentNeighbors( node, hyper_ball_rad );
 
     // Get an iterator for this node's neighbors and iterate through list
-    shared_ptr<RrtNodeNeighborIterator> thisNodeInNeighbors
-            = make_shared<RrtNodeNeighborIterator>(node);
-    shared_ptr<JListNode> listItem
-            = NextInNeighbor( thisNodeInNeighbors );
+    RrtNodeNeighborIterator thisNodeInNeighbors(node);
+    shared_ptr<Edge> *item;
     shared_ptr<KDTreeNode> neighborNode;
     shared_ptr<Edge> neighborEdge;
 
-    while( listItem->key_ != -1.0 ) {
-        neighborEdge = listItem->edge_;
-        neighborNode = neighborEdge->start_node_;
+    while( (item = NextInNeighbor( thisNodeInNeighbors )) != NULL ) {
+        neighborEdge = *item;
+        neighborNode = neighborEdge->start_node_->GetPointer();
 
         // Ignore this node's parent and also nodes that cannot
         // reach node due to dynamics of robot or space
         // Not sure about second parent since neighbors are not
         // initially created that cannot reach this node
         if( (node->rrt_parent_used_
-             && node->rrt_parent_edge_->end_node_ == neighborNode)
+             && node->rrt_parent_edge_->end_node_ == neighborNode.get())
                 || !neighborEdge->ValidMove() ) {
-            listItem = NextInNeighbor( thisNodeInNeighbors );
             continue;
         }
 
-        neighborEdge = listItem->edge_;
-
         if( neighborNode->rrt_LMC_  > node->rrt_LMC_ + neighborEdge->dist_
                 && (!neighborNode->rrt_parent_used_
-                    || neighborNode->rrt_parent_edge_->end_node_ != node )
+                    || neighborNode->rrt_parent_edge_->end_node_ != node.get() )
                 && neighborEdge->ValidMove() ) {
             // neighborNode should use node as its parent (it might already)
             neighborNode->rrt_LMC_ = node->rrt_LMC_ + neighborEdge->dist_;
@@ -773,8 +1035,6 @@ bool Rewire(shared_ptr<Queue> &Q,
                 VerifyInQueue( Q, neighborNode );
             }
         }
-
-        listItem = NextInNeighbor( thisNodeInNeighbors );
     }
     return true;
 }
@@ -790,18 +1050,16 @@ bool PropogateDescendants(shared_ptr<Queue> &Q,
     // First pass, accumulate all such nodes in a single list, and mark
     // them as belonging in that list, we'll just use the OS stack we've
     // been using adding nodes to the front while moving from back to front
-    shared_ptr<JListNode> OS_list_item = Q->obs_successors->back_;
+    JListNode *OS_list_item = Q->obs_successors->back_;
     shared_ptr<KDTreeNode> thisNode, successorNode;
-    shared_ptr<JListNode> SuccessorList_item;
     while( OS_list_item != OS_list_item->parent_ ) {
         thisNode = OS_list_item->node_;
 
         // Add all of this node's successors to OS stack
-        SuccessorList_item = thisNode->successor_list_->front_;
-        while( SuccessorList_item != SuccessorList_item->child_ ) {
-            successorNode = SuccessorList_item->edge_->end_node_;
+        for( KDTreeNode *successor = thisNode->first_successor_;
+             successor != NULL; successor = successor->next_successor_ ) {
+            successorNode = successor->GetPointer();
             VerifyInOSQueue( Q, successorNode ); // pushes to front_ of OS
-            SuccessorList_item = SuccessorList_item->child_;
         }
 
         OS_list_item = OS_list_item->parent_;
@@ -812,24 +1070,21 @@ bool PropogateDescendants(shared_ptr<Queue> &Q,
     // Not going back to front makes Q adjustments slightly faster,
     // since nodes near the front tend to have higher costs
     OS_list_item = Q->obs_successors->back_;
-    shared_ptr<JListNode> listItem;
+    shared_ptr<Edge> *item;
     shared_ptr<KDTreeNode> neighborNode;
     while( OS_list_item != OS_list_item->parent_ ) {
         thisNode = OS_list_item->node_;
 
         // Get an iterator for this node's neighbors
-        shared_ptr<RrtNodeNeighborIterator> thisNodeOutNeighbors
-                = make_shared<RrtNodeNeighborIterator>(thisNode);
+        RrtNodeNeighborIterator thisNodeOutNeighbors(thisNode);
 
         // Now iterate through list (add all neighbors to the Q,
         // except those in OS
-        listItem = NextOutNeighbor( thisNodeOutNeighbors );
-        while( listItem->key_ != -1.0 ) {
-            neighborNode = listItem->edge_->end_node_;
+        while( (item = NextOutNeighbor( thisNodeOutNeighbors )) != NULL ) {
+            neighborNode = (*item)->end_node_->GetPointer();
 
             if( MarkedOS(neighborNode) ) {
                 // neighborNode already in OS queue (orphaned) or unwired
-                listItem = NextOutNeighbor( thisNodeOutNeighbors );
                 continue;
             }
 
@@ -839,15 +1094,15 @@ bool PropogateDescendants(shared_ptr<Queue> &Q,
                                              // propogate cost forward since
                                      // useful nodes have rrt_LMC_ < rrt_tree_cost_
             VerifyInQueue( Q, neighborNode );
-
-            listItem = NextOutNeighbor( thisNodeOutNeighbors );
         }
 
         // Add parent to the Q, unless it is in OS
         if( thisNode->rrt_parent_used_
-                && !MarkedOS((thisNode->rrt_parent_edge_->end_node_)) ) {
-            thisNode->kd_parent_->rrt_tree_cost_ = INF; // rrtParent = kd_parent_???
-            VerifyInQueue( Q, thisNode->rrt_parent_edge_->end_node_ );
+                && !thisNode->rrt_parent_edge_->end_node_->in_OS_queue_ ) {
+            shared_ptr<KDTreeNode> parent
+                    = thisNode->rrt_parent_edge_->end_node_->GetPointer();
+            parent->rrt_tree_cost_ = INF;
+            VerifyInQueue( Q, parent );
         }
 
         OS_list_item = OS_list_item->parent_;
@@ -866,8 +1121,7 @@ bool PropogateDescendants(shared_ptr<Queue> &Q,
 
         if( thisNode->rrt_parent_used_ ) {
             // Remove thisNode from its parent's successor list
-            thisNode->rrt_parent_edge_->end_node_->successor_list_->JListRemove(
-                        thisNode->successor_list_item_in_parent_ );
+            thisNode->RemoveFromSuccessors();
 
             // thisNode now has no parent
             thisNode->rrt_parent_edge_
@@ -905,7 +1159,7 @@ void AddOtherTimesToRoot(shared_ptr<ConfigSpace> &C,
         new_pose = root->position_;
         new_pose(2) = time_to_insert;
 
-        new_node = make_shared<KDTreeNode>(new_pose);
+        new_node = MakeInArena<KDTreeNode>(C->arena_, new_pose);
 
         // Edge from new_node to previous_node
         this_edge = Edge::NewEdge( C, Tree, new_node, previous_node );
@@ -981,7 +1235,7 @@ void FindNewTarget(shared_ptr<ConfigSpace> &C,
     Tree->KDFindWithinRange( L, searchBallRad, robPose );
 
     shared_ptr<KDTreeNode> dummyRobotNode
-            = make_shared<KDTreeNode>(robPose);
+            = MakeInArena<KDTreeNode>(C->arena_, robPose);
     shared_ptr<Edge> edgeToBestNeighbor
             = Edge::NewEdge(C,Tree,dummyRobotNode,dummyRobotNode);
 
@@ -992,9 +1246,9 @@ void FindNewTarget(shared_ptr<ConfigSpace> &C,
         // Searching for new target within radius searchBallRad
         bestDistToNeighbor = INF;
         bestDistToGoal = INF;
-        bestNeighbor = make_shared<KDTreeNode>();
+        bestNeighbor = MakeInArena<KDTreeNode>(C->arena_);
 
-        shared_ptr<JListNode> ptr = L->front_;
+        JListNode *ptr = L->front_;
         shared_ptr<Edge> thisEdge;
         double distToGoal;
         while( ptr != ptr->child_ ) {
@@ -1029,6 +1283,7 @@ void FindNewTarget(shared_ptr<ConfigSpace> &C,
             // Found a valid move target
 
             Robot->robot_edge = edgeToBestNeighbor; /** this edge is empty **/
+            Robot->robot_node = dummyRobotNode;
             Robot->robot_edge_used = true;
 
             if( C->space_has_time_ ) {
@@ -1068,3 +1323,141 @@ void FindNewTarget(shared_ptr<ConfigSpace> &C,
     }
     Tree->EmptyRangeList(L); // cleanup
 }
+
+// Takes the edges of node out of the nodes at their other ends, so no
+// edge is left pointing at node once it is freed
+static void UnlinkEdges(KDTreeNode *node)
+{
+    if( !node->edges_ ) return;
+    NodeEdges &edges = *node->edges_;
+    KDTreeNode *other;
+    for( int i = 0; i < edges.out_.Size(); i++ ) {
+        other = edges.out_[i]->end_node_;
+        if( other != node && other->edges_ ) {
+            other->edges_->in_.Remove(edges.out_[i].get());
+        }
+    }
+    for( int i = 0; i < edges.in_.Size(); i++ ) {
+        other = edges.in_[i]->start_node_;
+        if( other != node && other->edges_ ) {
+            other->edges_->out_.Remove(edges.in_[i].get());
+        }
+    }
+    EdgeSet *initial[] = { &edges.initial_out_, &edges.initial_in_,
+                           &edges.initial_refs_ };
+    for( EdgeSet *set : initial ) {
+        for( int i = 0; i < set->Size(); i++ ) {
+            other = OtherEnd((*set)[i].get(), node);
+            if( other != node && other->edges_ ) {
+                RemoveInitialEdge(*other->edges_, (*set)[i].get());
+            }
+        }
+    }
+}
+
+int PruneGraph(shared_ptr<Queue> &Q,
+               shared_ptr<KDTree> &Tree,
+               shared_ptr<RobotData> &Robot)
+{
+    PrunePolicy &policy = Q->prune_policy;
+    shared_ptr<KDTreeNode> move_goal = Q->cspace->move_goal_;
+    double cost_bound = (policy.prune_cost) ? move_goal->rrt_LMC_ : INF;
+
+    // Nodes that must stay, including the current path to the goal
+    vector<shared_ptr<KDTreeNode>> keep;
+    keep.push_back(Tree->root);
+    keep.push_back(Q->cspace->goal_node_);
+    shared_ptr<KDTreeNode> path_node = move_goal;
+    keep.push_back(path_node);
+    while( path_node->rrt_parent_used_
+           && (int)keep.size() <= Tree->tree_size_ ) { // in case of a cycle
+        path_node = path_node->rrt_parent_edge_->end_node_->GetPointer();
+        keep.push_back(path_node);
+    }
+    Eigen::VectorXd robot_pose;
+    {
+        lock_guard<mutex> lock(Robot->robot_mutex);
+        robot_pose = Robot->robot_pose;
+        keep.push_back(Robot->next_move_target);
+        if( Robot->robot_edge_used ) {
+            keep.push_back(Robot->robot_edge->start_node_->GetPointer());
+            keep.push_back(Robot->robot_edge->end_node_->GetPointer());
+        }
+    }
+    sort(keep.begin(),keep.end());
+
+    // Pick the nodes to remove
+    vector<shared_ptr<KDTreeNode>> nodes = Tree->KDNodes();
+    vector<shared_ptr<KDTreeNode>> pruned;
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        if( MarkedOS(nodes[i])
+                || binary_search(keep.begin(),keep.end(),nodes[i]) ) {
+            continue;
+        }
+        bool outside = policy.window > 0
+                && (nodes[i]->position_.head(2)
+                    - robot_pose.head(2)).norm() > policy.window;
+        if( nodes[i]->rrt_LMC_ > cost_bound || outside ) {
+            pruned.push_back(nodes[i]);
+        }
+    }
+    nodes.clear();
+    if( pruned.empty() ) return 0;
+
+    // From here on kd_in_tree_ is false for the removed nodes
+    Tree->KDRemove(pruned);
+
+    shared_ptr<KDTreeNode> node, successor;
+    for( int i = 0; i < (int)pruned.size(); i++ ) {
+        node = pruned[i];
+        Q->priority_queue->RemoveFromHeap(node);
+
+        // Remove it from its parent's successor list
+        node->RemoveFromSuccessors();
+
+        // Successors that are kept are now orphans, the removed ones are
+        // taken out of the list here too
+        while( node->first_successor_ != NULL ) {
+            successor = node->first_successor_->GetPointer();
+            successor->RemoveFromSuccessors();
+            if( successor->kd_in_tree_ ) {
+                VerifyInOSQueue(Q, successor);
+                successor->rrt_parent_edge_
+                        = Edge::NewEdge(Q->cspace,Tree,successor,successor);
+                successor->rrt_parent_edge_->dist_ = INF;
+                successor->rrt_parent_used_ = false;
+            }
+        }
+
+        // Every edge is held at both ends, so this finds all of them
+        // however long they are
+        UnlinkEdges(node.get());
+    }
+
+    // And let go of everything the removed nodes point at, so nothing
+    // keeps them alive
+    for( int i = 0; i < (int)pruned.size(); i++ ) {
+        node = pruned[i];
+        node->edges_.reset(); // drops its neighbor edges
+        node->rrt_parent_used_ = false;
+        node->rrt_parent_edge_.reset();
+        node->temp_edge_.reset();
+        node->rrt_LMC_ = INF;
+        node->rrt_tree_cost_ = INF;
+    }
+
+    // Orphaned successors look for new parents like nodes cut off by an
+    // obstacle (see CheckObstacles)
+    if( Q->obs_successors->length_ > 0 ) {
+        PropogateDescendants(Q,Tree,Robot);
+        if( !MarkedOS(Q->cspace->move_goal_) ) {
+            VerifyInQueue(Q,Q->cspace->move_goal_);
+        }
+    }
+
+    // Rebuild the KD-Tree once it is mostly removed nodes
+    if( Tree->num_indices_ - Tree->tree_size_ > Tree->tree_size_ ) {
+        Tree->KDCompact();
+    }
+    return pruned.size();
+}
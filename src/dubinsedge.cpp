@@ -1,22 +1,40 @@
 #include <DRRT/dubinsedge.h>
 #include <DRRT/drrt.h>
+#include <atomic>
 
 using namespace std;
 
 bool timinged = false;
 bool vis_traj = true;
 
+static std::atomic<unsigned long> next_path_id(0);
+
+// Length of the turn from a to b around center, turning right or left
+static double ArcLength(const Eigen::Vector2d &a, const Eigen::Vector2d &b,
+                        const Eigen::Vector2d &center, double r, bool right)
+{
+    double phi_start = atan2( a(1)-center(1), a(0)-center(0) );
+    double phi_end = atan2( b(1)-center(1), b(0)-center(0) );
+    if( right && phi_end > phi_start ) {
+        phi_end -= 2.0*PI;
+    } else if( !right && phi_end < phi_start ) {
+        phi_end += 2.0*PI;
+    }
+    return r*std::abs(phi_end-phi_start);
+}
+
 /////////////////////// Critical Functions ///////////////////////
 
 /////////////////////// Static Edge Functions ///////////////////////
 std::shared_ptr<Edge> Edge::NewEdge(std::shared_ptr<ConfigSpace> C,
                                     std::shared_ptr<KDTree> Tree,
-                                    std::shared_ptr<KDTreeNode>& start_node,
-                                    std::shared_ptr<KDTreeNode>& end_node)
+                                    const std::shared_ptr<KDTreeNode>& start_node,
+                                    const std::shared_ptr<KDTreeNode>& end_node)
 {
     std::shared_ptr<Edge> new_edge
-            = std::make_shared<DubinsEdge>(C,Tree,start_node,end_node);
+            = MakeInArena<DubinsEdge>(C->arena_,C,Tree,start_node,end_node);
     new_edge->dist_ = C->distanceFunction(start_node->position_,end_node->position_);
+    new_edge->dist_original_ = new_edge->dist_;
     return new_edge;
 }
 
@@ -85,8 +103,9 @@ bool DubinsEdge::ValidMove()
 
 Eigen::VectorXd DubinsEdge::PoseAtDistAlongEdge(double dist_along_edge)
 {
+    const Eigen::MatrixXd &trajectory = Trajectory();
     double distRemaining = dist_along_edge;
-    if( this->trajectory_.rows() < 2 || this->dist_ <= dist_along_edge ) {
+    if( trajectory.rows() < 2 || this->dist_ <= dist_along_edge ) {
         return this->end_node_->position_;
     }
 
@@ -94,12 +113,12 @@ Eigen::VectorXd DubinsEdge::PoseAtDistAlongEdge(double dist_along_edge)
     // at the desired distance
     int i = 1;
     double thisDist = INF;
-    bool timeInPath = this->trajectory_.cols() > 3;
-    while( i <= this->trajectory_.rows() ) {
-        double wtime = DubinsDistAlongTimePath( this->trajectory_.row(i-1),
-                                                this->trajectory_.row(i) );
-        double wotime = DubinsDistAlongPath( this->trajectory_.row(i-1),
-                                             this->trajectory_.row(i) );
+    bool timeInPath = trajectory.cols() > 3;
+    while( i < trajectory.rows() ) {
+        double wtime = DubinsDistAlongTimePath( trajectory.row(i-1),
+                                                trajectory.row(i) );
+        double wotime = DubinsDistAlongPath( trajectory.row(i-1),
+                                             trajectory.row(i) );
         if( timeInPath ) {
             thisDist = wtime;
         } else {
@@ -114,6 +133,11 @@ Eigen::VectorXd DubinsEdge::PoseAtDistAlongEdge(double dist_along_edge)
         i += 1;
     }
 
+    if( i == trajectory.rows() ) {
+        // The segments cut the arcs short, so dist_ can run past their end
+        i -= 1;
+    }
+
     if( distRemaining > thisDist ) {
         // In case of rare subtraction based precision errors
         distRemaining = thisDist;
@@ -121,10 +145,10 @@ Eigen::VectorXd DubinsEdge::PoseAtDistAlongEdge(double dist_along_edge)
 
     // Now calculate pose along that piece
     double ratio = distRemaining/thisDist;
-    Eigen::VectorXd ret = this->trajectory_.row(i-1)
-            + ratio*(this->trajectory_.row(i)-this->trajectory_.row(i-1));
-    double retTheta = atan2 (this->trajectory_(i,1) - this->trajectory_(i-1,1),
-                             this->trajectory_(i,0) - this->trajectory_(i-1,0) );
+    Eigen::VectorXd ret = trajectory.row(i-1)
+            + ratio*(trajectory.row(i)-trajectory.row(i-1));
+    double retTheta = atan2 (trajectory(i,1) - trajectory(i-1,1),
+                             trajectory(i,0) - trajectory(i-1,0) );
 
     Eigen::Vector3d vec;
     vec(0) = ret(0); // x-coordinate
@@ -136,7 +160,8 @@ Eigen::VectorXd DubinsEdge::PoseAtDistAlongEdge(double dist_along_edge)
 
 Eigen::VectorXd DubinsEdge::PoseAtTimeAlongEdge(double time_along_edge)
 {
-    if( this->trajectory_.rows() < 2 || (this->start_node_->position_(2)
+    const Eigen::MatrixXd &trajectory = Trajectory();
+    if( trajectory.rows() < 2 || (this->start_node_->position_(2)
                                         - this->end_node_->position_(2))
             <= time_along_edge ) {
         return this->end_node_->position_;
@@ -145,20 +170,20 @@ Eigen::VectorXd DubinsEdge::PoseAtTimeAlongEdge(double time_along_edge)
     // Find the piece of the trajectory_ that contains the time at the
     // desired distance
     int i = 1;
-    while( this->trajectory_(i,2)
+    while( trajectory(i,2)
            > this->start_node_->position_(2) - time_along_edge ) {
         i += 1;
     }
 
     // Now calculate pose along that piece
-    double ratio = (this->trajectory_(i-1,2)
+    double ratio = (trajectory(i-1,2)
                     - (this->start_node_->position_(2)-time_along_edge))
-            / (this->trajectory_(i-1,2) - this->trajectory_(i,2));
-    Eigen::VectorXd ret = this->trajectory_.row(i-1)
-            + ratio*(this->trajectory_.row(i) - this->trajectory_.row(i-1));
+            / (trajectory(i-1,2) - trajectory(i,2));
+    Eigen::VectorXd ret = trajectory.row(i-1)
+            + ratio*(trajectory.row(i) - trajectory.row(i-1));
     double retTime = this->start_node_->position_(2) - time_along_edge;
-    double retTheta = atan2( this->trajectory_(i,1) - this->trajectory_(i-1,1),
-                             this->trajectory_(i,0) - this->trajectory_(i-1,0) );
+    double retTheta = atan2( trajectory(i,1) - trajectory(i-1,1),
+                             trajectory(i,0) - trajectory(i-1,0) );
 
     Eigen::VectorXd vec;
     vec(0) = ret(0); // x-coordinate
@@ -449,24 +474,15 @@ void DubinsEdge::CalculateTrajectory()
         bestTrajType = "0s0";
 
     /// END determine best path
-    /// BEGIN calculate trajectory from path
-    // Now save the best path in the trajectory field
-
-    double delta_phi = 0.1; // this is the angle granularity (in radians)
-                            // used for discritizing the arcs of the paths
-                            // (straight lines are saved as a single segment
-
-    Eigen::ArrayXd phis;    // This array contains 1 element or a sequence of elements
+    /// BEGIN save the path
+    // Only the lengths of the parts of the best path are kept,
+    // Trajectory() samples it from them
     Eigen::Vector2d p, p1, p2;
-    Eigen::VectorXd first_path_x, first_path_y,
-                    second_path_x, second_path_y,
-                    third_path_x, third_path_y;
-    double phi_start, phi_end, val;
-    int i;
+    double lengths[3] = {0.0, 0.0, 0.0};
+    double start_theta = initial_theta;
 
-    // Calculate the first part of the path
+    // First part of the path
     if( bestTrajType[0] == 'r' ) {
-        // First part of the path is a right hand turn
         if( bestTrajType == "rsl" ) {
             p(0) = rsl_tangent_x(0);
             p(1) = rsl_tangent_y(0);
@@ -476,35 +492,8 @@ void DubinsEdge::CalculateTrajectory()
         } else { // bestTrajType == "rlr"
             p = rlr_rl_tangent;
         }
-
-        phi_start = atan2( initial_location(1)-irc_center(1),
-                           initial_location(0)-irc_center(0) );
-        phi_end = atan2( p(1)-irc_center(1), p(0)-irc_center(0) );
-
-        if( phi_end > phi_start ) {
-            phi_end -= 2.0*PI;
-        }
-
-        phis = Eigen::VectorXd::Zero(std::ceil(std::abs(phi_end-phi_start)
-                                               / delta_phi)+1);
-
-        if( phi_end == phi_start ) {
-            phis(0) = phi_start;
-        } else {
-            val = phi_start;
-            i = 0;
-            while( val >= phi_end ) {
-                phis(i) = val;
-                val -= delta_phi;
-                i += 1;
-            }
-            phis(i) = phi_end;
-        }
-
-        first_path_x = irc_center(0) + r_min*phis.cos();
-        first_path_y = irc_center(1) + r_min*phis.sin();
+        lengths[0] = ArcLength( initial_location, p, irc_center, r_min, true );
     } else if( bestTrajType[0] == 'l' ) {
-        // First part of the path is a left hand turn
         if( bestTrajType == "lsl" ) {
             p(0) = lsl_tangent_x(0);
             p(1) = lsl_tangent_y(0);
@@ -514,39 +503,11 @@ void DubinsEdge::CalculateTrajectory()
         } else { // bestTrajType == "lrl"
             p = lrl_lr_tangent;
         }
-
-        phi_start = atan2( initial_location(1)-ilc_center(1),
-                           initial_location(0)-ilc_center(0) );
-        phi_end = atan2( p(1)-ilc_center(1), p(0)-ilc_center(0) );
-
-        if( phi_end < phi_start ) {
-            phi_end += 2.0*PI;
-        }
-
-        phis = Eigen::VectorXd::Zero(std::ceil(std::abs(phi_end-phi_start)
-                                               / delta_phi)+1);
-
-        if( phi_end == phi_start ) {
-            phis(0) = phi_start;
-        } else {
-            val = phi_start;
-            i = 0;
-            while( val <= phi_end ) {
-                phis(i) = val;
-                val += delta_phi;
-                i += 1;
-            }
-            phis(i) = phi_end;
-        }
-
-        first_path_x = ilc_center(0) + r_min*phis.cos();
-        first_path_y = ilc_center(1) + r_min*phis.sin();
+        lengths[0] = ArcLength( initial_location, p, ilc_center, r_min, false );
     }
 
-
-    // Calculate the second part of the path
+    // Second part of the path
     if( bestTrajType[1] == 's' ) {
-        // Second part of the path is a straight line
         if( bestTrajType == "lsr" ) {
             p1(0) = lsr_tangent_x(0);
             p1(1) = lsr_tangent_y(0);
@@ -568,84 +529,24 @@ void DubinsEdge::CalculateTrajectory()
             p2(0) = rsl_tangent_x(1);
             p2(1) = rsl_tangent_y(1);
         } else { // bestTrajType = "0s0"
-            p1(0) = this->start_node_->position_(0);
-            p1(1) = this->start_node_->position_(1);
-            p2(0) = this->end_node_->position_(0);
-            p2(1) = this->end_node_->position_(1);
+            p1 = initial_location;
+            p2 = goal_location;
+            // The line is all there is, it sets the heading
+            start_theta = atan2( p2(1)-p1(1), p2(0)-p1(0) );
         }
-
-        Eigen::Vector2d ptemp1, ptemp2;
-
-        ptemp1 << p1(0), p2(0);
-        second_path_x = ptemp1;
-//        second_path_x(1) = p2(0);
-        ptemp2 << p1(1), p2(1);
-        second_path_y = ptemp2;
-//        second_path_y(1) = p2(1);
+        lengths[1] = (p2-p1).norm();
     } else if( bestTrajType[1] == 'r' ) {
-        // Second part of teh path is a right turn
-        phi_start = atan2( lrl_lr_tangent(1)-lrl_r_circle_center(1),
-                           lrl_lr_tangent(0)-lrl_r_circle_center(0) );
-        phi_end = atan2( lrl_rl_tangent(1)-lrl_r_circle_center(1),
-                         lrl_rl_tangent(0)-lrl_r_circle_center(0) );
-
-        if( phi_end > phi_start ) {
-            phi_end -= 2.0*PI;
-        }
-
-        phis = Eigen::VectorXd::Zero(std::ceil(std::abs(phi_end-phi_start)
-                                               / delta_phi)+1);
-
-        if( phi_end == phi_start ) {
-            phis(0) = phi_start;
-        } else {
-            val = phi_start;
-            i = 0;
-            while( val >= phi_end ) {
-                phis(i) = val;
-                val -= delta_phi;
-                i += 1;
-            }
-            phis(i) = phi_end;
-        }
-
-        second_path_x = lrl_r_circle_center(0) + r_min*phis.cos();
-        second_path_y = lrl_r_circle_center(1) + r_min*phis.sin();
+        lengths[1] = ArcLength( lrl_lr_tangent.matrix(),
+                                lrl_rl_tangent.matrix(),
+                                lrl_r_circle_center, r_min, true );
     } else if( bestTrajType[1] == 'l' ) {
-        // Second part of the path is a left turn
-        phi_start = atan2( rlr_rl_tangent(1)-rlr_l_circle_center(1),
-                           rlr_rl_tangent(0)-rlr_l_circle_center(0) );
-        phi_end = atan2( rlr_lr_tangent(1)-rlr_l_circle_center(1),
-                         rlr_lr_tangent(0)-rlr_l_circle_center(0) );
-
-        if( phi_end < phi_start ) {
-            phi_end += 2.0*PI;
-        }
-
-        phis = Eigen::VectorXd::Zero(std::ceil(std::abs(phi_end-phi_start)
-                                               / delta_phi)+1);
-
-        if( phi_end == phi_start ) {
-            phis(0) = phi_start;
-        } else {
-            val = phi_start;
-            i = 0;
-            while( val <= phi_end ) {
-                phis(i) = val;
-                val += delta_phi;
-                i += 1;
-            }
-            phis(i) = phi_end;
-        }
-
-        second_path_x = rlr_l_circle_center(0) + r_min*phis.cos();
-        second_path_y = rlr_l_circle_center(1) + r_min*phis.sin();
+        lengths[1] = ArcLength( rlr_rl_tangent.matrix(),
+                                rlr_lr_tangent.matrix(),
+                                rlr_l_circle_center, r_min, false );
     }
 
-
-    // Calculate the third part of the path
+    // Third part of the path
     if( bestTrajType[2] == 'r' ) {
-        // Third part of path is a right hand turn
         if( bestTrajType == "rsr" ) {
             p(0) = rsr_tangent_x(1);
             p(1) = rsr_tangent_y(1);
@@ -655,35 +556,8 @@ void DubinsEdge::CalculateTrajectory()
         } else { // bestTrajType == "rlr"
             p = rlr_lr_tangent;
         }
-
-        phi_start = atan2( p(1)-grc_center(1), p(0)-grc_center(0) );
-        phi_end = atan2( goal_location(1)-grc_center(1),
-                         goal_location(0)-grc_center(0) );
-
-        if( phi_end > phi_start ) {
-            phi_end -= 2.0*PI;
-        }
-
-        phis = Eigen::VectorXd::Zero(std::ceil(std::abs(phi_end-phi_start)
-                                               / delta_phi)+1);
-
-        if( phi_end == phi_start ) {
-            phis(0) = phi_start;
-        } else {
-            val = phi_start;
-            i = 0;
-            while( val >= phi_end ) {
-                phis(i) = val;
-                val -= delta_phi;
-                i += 1;
-            }
-            phis(i) = phi_end;
-        }
-
-        third_path_x = grc_center(0) + r_min*phis.cos();
-        third_path_y = grc_center(1) + r_min*phis.sin();
+        lengths[2] = ArcLength( p, goal_location, grc_center, r_min, true );
     } else if( bestTrajType[2] == 'l' ) {
-        // Third part of path is a left hand turn
         if( bestTrajType == "lsl" ) {
             p(0) = lsl_tangent_x(1);
             p(1) = lsl_tangent_y(1);
@@ -693,43 +567,19 @@ void DubinsEdge::CalculateTrajectory()
         } else { // bestTrajType = "lrl"
             p = lrl_rl_tangent;
         }
-
-        phi_start = atan2( p(1)-glc_center(1), p(0)-glc_center(0) );
-        phi_end = atan2( goal_location(1)-glc_center(1),
-                         goal_location(0)-glc_center(0) );
-
-        if( phi_end < phi_start ) {
-            phi_end += 2.0*PI;
-        }
-
-        phis = Eigen::VectorXd::Zero(std::ceil(std::abs(phi_end-phi_start)
-                                               / delta_phi)+1);
-
-        if( phi_end == phi_start ) {
-            phis(0) = phi_start;
-        } else {
-            val = phi_start;
-            i = 0;
-            while( val <= phi_end ) {
-                phis(i) = val;
-                val += delta_phi;
-                i += 1;
-            }
-            phis(i) = phi_end;
-        }
-
-        third_path_x = glc_center(0) + r_min*phis.cos();
-        third_path_y = glc_center(1) + r_min*phis.sin();
+        lengths[2] = ArcLength( p, goal_location, glc_center, r_min, false );
     }
 
     this->edge_type_ = bestTrajType;
     this->w_dist_ = bestDist; // distance that the robot moves in the workspace
 
-    int trajLength = first_path_x.size()
-                   + second_path_x.size()
-                   + third_path_x.size();
-    Eigen::VectorXd traj1(trajLength), traj2(trajLength);
-    this->trajectory_.resize(trajLength,Eigen::NoChange_t());
+    this->path_start_[0] = initial_location(0);
+    this->path_start_[1] = initial_location(1);
+    this->path_start_[2] = start_theta;
+    for( int k = 0; k < 3; k++ ) this->segment_length_[k] = lengths[k];
+    this->turn_radius_ = r_min;
+    this->path_id_ = ++next_path_id;
+    this->trajectory_.resize(0,3);
 
     if( this->w_dist_ == INF ) {
         this->dist_ = INF;
@@ -749,81 +599,13 @@ void DubinsEdge::CalculateTrajectory()
          * of the end points. ALSO NOTE: This function is not responsible
          * for determining if it is possible for the robot to actually
          * achieve this speed -- which is done in the function ValidMove().
-         * FINALLY, we allso assume that the trajectory is sampled well
-         * enough in "curvy" parts that the distance between points can
-         * be approximated by the straight line distance between these
-         * points i.e. the sum of the segment lengths is close enough to
-         * this->w_dist_ that problems will not occur.
+         * The times themselves are filled in when the path is sampled
          */
 
         this->velocity_ = this->w_dist_
                 / (this->start_node_->position_(2)-this->end_node_->position_(2));
-
-        // Build trajectory with 0 for times
-        Eigen::VectorXd zeros(first_path_x.size()
-                              + second_path_x.size()
-                              + third_path_x.size());
-
-
-        traj1.block(0,0, first_path_x.size(),1) = first_path_x;
-        traj1.block(first_path_x.size(),0,
-                    second_path_x.size(),1) = second_path_x;
-        traj1.block(first_path_x.size()+second_path_x.size(),0,
-                    third_path_x.size(),1) = third_path_x;
-
-        traj2.block(0,0, first_path_y.size(),1) = first_path_y;
-        traj2.block(first_path_y.size(),0,
-                    second_path_y.size(),1) = second_path_y;
-        traj2.block(first_path_y.size()+second_path_y.size(),0,
-                    third_path_y.size(),1) = third_path_y;
-
-        zeros = Eigen::VectorXd::Zero(first_path_x.size()
-                                      + second_path_x.size()
-                                      + third_path_x.size());
-
-
-        this->trajectory_.block(0,0,
-            first_path_x.size() + second_path_x.size() + third_path_x.size(),
-                               1) = traj1;
-        this->trajectory_.block(0,1,
-            first_path_x.size() + second_path_x.size() + third_path_x.size(),
-                               1) = traj2;
-        this->trajectory_.block(0,2,
-            first_path_x.size() + second_path_x.size() + third_path_x.size(),
-                               1) = zeros;
-
-        // Now calculate times
-        this->trajectory_(0,2) = this->start_node_->position_(2);
-        double cumulativeDist = 0.0;
-        for( int j = 1; j < this->trajectory_.rows()-1; j++ ) {
-            cumulativeDist += this->tree_->distanceFunction(
-                        this->trajectory_.row(j-1).head(2),
-                        this->trajectory_.row(j).head(2));
-            this->trajectory_(j,2) = this->start_node_->position_(2)
-                    - cumulativeDist/this->velocity_;
-        }
-        this->trajectory_.row(this->trajectory_.rows()-1).head(3)
-                = this->end_node_->position_.head(3); // make end point exact
     } else {
         this->dist_ = bestDist;
-
-        traj1.block(0,0, first_path_x.size(),1) = first_path_x;
-        traj1.block(first_path_x.size(),0,
-                    second_path_x.size(),1) = second_path_x;
-        traj1.block(first_path_x.size()+second_path_x.size(),0,
-                    third_path_x.size(),1) = third_path_x;
-
-        traj2.block(0,0, first_path_y.size(),1) = first_path_y;
-        traj2.block(first_path_y.size(),0,
-                    second_path_y.size(),1) = second_path_y;
-        traj2.block(first_path_y.size()+second_path_y.size(),0,
-                    third_path_y.size(),1) = third_path_y;
-
-
-        this->trajectory_.block(0,0, first_path_x.size() + second_path_x.size()
-                               + third_path_x.size(),1) = traj1;
-        this->trajectory_.block(0,1, first_path_x.size() + second_path_x.size()
-                               + third_path_x.size(),1) = traj2;
     }
 
     this->dist_original_ = this->dist_;
@@ -834,14 +616,115 @@ void DubinsEdge::CalculateHoverTrajectory()
     this->edge_type_ = "xxx";
     this->w_dist_ = 0.0;
     this->dist_ = 0.0;
+    this->dist_original_ = 0.0;
+    this->path_id_ = 0;
 
+    this->trajectory_ = Eigen::MatrixXd::Zero(2,3);
     if( this->cspace_->space_has_time_ ) {
         this->velocity_ = this->cspace_->dubins_min_velocity_;
         this->trajectory_.row(0) = this->start_node_->position_.head(3);
         this->trajectory_.row(1) = this->end_node_->position_.head(3);
     } else {
-        this->trajectory_.row(0) = this->start_node_->position_.head(2);
-        this->trajectory_.row(1) = this->end_node_->position_.head(2);
+        this->trajectory_.row(0).head(2) = this->start_node_->position_.head(2);
+        this->trajectory_.row(1).head(2) = this->end_node_->position_.head(2);
+    }
+}
+
+const Eigen::MatrixXd& DubinsEdge::Trajectory()
+{
+    if( this->path_id_ == 0 ) return this->trajectory_;
+
+    // Repeated calls for the same edge (collision checks against several
+    // obstacles, drawing) sample it once
+    struct Samples {
+        unsigned long path_id_ = 0;
+        Eigen::MatrixXd path_;
+    };
+    thread_local Samples samples;
+    if( samples.path_id_ != this->path_id_ ) {
+        SamplePath(samples.path_);
+        samples.path_id_ = this->path_id_;
+    }
+    return samples.path_;
+}
+
+void DubinsEdge::SamplePath(Eigen::MatrixXd &samples)
+{
+    double delta_phi = 0.1; // this is the angle granularity (in radians)
+                            // used for discritizing the arcs of the paths
+                            // (straight lines are saved as a single segment
+
+    // Count the rows first so samples is only resized once
+    int rows = 0;
+    for( int k = 0; k < 3; k++ ) {
+        char part = this->edge_type_[k];
+        if( part == 's' ) {
+            rows += 2;
+        } else if( part == 'r' || part == 'l' ) {
+            // Divided in double as below, so the counts match
+            double turn = (double)this->segment_length_[k]/this->turn_radius_;
+            rows += (turn == 0.0) ? 1 : (int)std::floor(turn/delta_phi) + 2;
+        }
+    }
+    samples.resize(rows,3);
+    samples.col(2).setZero();
+
+    // Follow the path from its start
+    double x = this->path_start_[0];
+    double y = this->path_start_[1];
+    double theta = this->path_start_[2];
+    int i = 0;
+    for( int k = 0; k < 3; k++ ) {
+        char part = this->edge_type_[k];
+        double length = this->segment_length_[k];
+        if( part == 's' ) {
+            samples(i,0) = x;
+            samples(i,1) = y;
+            x += length*cos(theta);
+            y += length*sin(theta);
+            samples(i+1,0) = x;
+            samples(i+1,1) = y;
+            i += 2;
+        } else if( part == 'r' || part == 'l' ) {
+            double r = this->turn_radius_;
+            double side = (part == 'l') ? 1.0 : -1.0;
+            double center_x = x + r*cos(theta + side*PI/2.0);
+            double center_y = y + r*sin(theta + side*PI/2.0);
+            double turn = length/r;
+            double phi_start = theta - side*PI/2.0;
+            double phi_end = phi_start + side*turn;
+
+            if( turn != 0.0 ) {
+                int steps = (int)std::floor(turn/delta_phi);
+                for( int m = 0; m <= steps; m++ ) {
+                    double val = phi_start + side*m*delta_phi;
+                    samples(i,0) = center_x + r*cos(val);
+                    samples(i,1) = center_y + r*sin(val);
+                    i += 1;
+                }
+            }
+            samples(i,0) = center_x + r*cos(phi_end);
+            samples(i,1) = center_y + r*sin(phi_end);
+            i += 1;
+
+            x = samples(i-1,0);
+            y = samples(i-1,1);
+            theta += side*turn;
+        }
+    }
+
+    if( this->cspace_->space_has_time_ && rows > 0 ) {
+        // Times, assuming the robot goes at velocity_ the whole way
+        samples(0,2) = this->start_node_->position_(2);
+        double cumulativeDist = 0.0;
+        for( int j = 1; j < rows-1; j++ ) {
+            cumulativeDist += this->tree_->distanceFunction(
+                        samples.row(j-1).head(2), samples.row(j).head(2));
+            samples(j,2) = this->start_node_->position_(2)
+                    - cumulativeDist/this->velocity_;
+        }
+        samples.row(rows-1).head(3)
+                = this->end_node_->position_.head(3); // make end point exact
     }
 }
 
@@ -868,19 +751,20 @@ bool DubinsEdge::ExplicitEdgeCheck(std::shared_ptr<Obstacle> obstacle)
     // check of the trajectory segments
     // Could be improved using a function that can check arcs of the
     // Dubin's path at once instead of just line segments stored in trajectory
+    const Eigen::MatrixXd &trajectory = Trajectory();
     int count = 0;
     chrono::steady_clock::time_point t1, t2, f1, f2;
     double delta;
     f1 = chrono::steady_clock::now();
-    for(int i = 1; i < this->trajectory_.rows(); i++) {
+    for(int i = 1; i < trajectory.rows(); i++) {
         count++;
         t1 = chrono::steady_clock::now();
         if(DetectBulletCollision(obstacle,
-                                 this->trajectory_.row(i-1),
-                                 this->trajectory_.row(i))
+                                 trajectory.row(i-1),
+                                 trajectory.row(i))
                 /*ExplicitEdgeCheck2D(obstacle,
-                               this->trajectory_.row(i-1),
-                               this->trajectory_.row(i),
+                               trajectory.row(i-1),
+                               trajectory.row(i),
                                this->cspace_->robot_radius_)*/) {
             t2 = chrono::steady_clock::now();
             delta = chrono::duration_cast<chrono::duration<double> >(t2 - t1).count();
@@ -0,0 +1,137 @@
+#include <DRRT/edgeset.h>
+#include <DRRT/kdtreenode.h>
+#include <DRRT/edge.h>
+#include <DRRT/grapharena.h>
+#include <utility>
+#include <new>
+
+EdgeSet::~EdgeSet()
+{
+    Clear();
+    if( this->data_ != this->inline_ ) {
+        DeleteData(this->data_, this->capacity_);
+    }
+}
+
+void EdgeSet::Push(const std::shared_ptr<Edge> &edge)
+{
+    if( this->size_ == this->capacity_ ) {
+        int capacity = 2*this->capacity_;
+        std::shared_ptr<Edge> *data = NewData(capacity);
+        for( int i = 0; i < this->size_; i++ ) {
+            data[i] = std::move(this->data_[i]);
+        }
+        if( this->data_ != this->inline_ ) {
+            DeleteData(this->data_, this->capacity_);
+        }
+        this->data_ = data;
+        this->capacity_ = capacity;
+    }
+    int i = this->size_;
+    if( this->sorted_ ) {
+        // Shift the longer edges up, neighbor sets are small
+        while( i > 0 && this->data_[i-1]->dist_original_
+               > edge->dist_original_ ) {
+            this->data_[i] = std::move(this->data_[i-1]);
+            SetIndex(i, i);
+            i--;
+        }
+    }
+    this->data_[i] = edge;
+    SetIndex(i, i);
+    this->size_++;
+}
+
+void EdgeSet::RemoveAt(int i)
+{
+    SetIndex(i, -1);
+    int last = this->size_ - 1;
+    if( this->sorted_ ) {
+        std::shared_ptr<Edge> removed = std::move(this->data_[i]);
+        for( ; i < last; i++ ) {
+            this->data_[i] = std::move(this->data_[i+1]);
+            SetIndex(i, i);
+        }
+        this->data_[last] = std::move(removed);
+    } else if( i != last ) {
+        this->data_[i] = std::move(this->data_[last]);
+        SetIndex(i, i);
+    }
+    // Let go of the edge only after the set is in order again, dropping
+    // it may free more of the graph
+    std::shared_ptr<Edge> gone = std::move(this->data_[last]);
+    this->size_--;
+}
+
+bool EdgeSet::Remove(const Edge *edge)
+{
+    int i = IndexOf(edge);
+    if( i < 0 || i >= this->size_ || this->data_[i].get() != edge ) {
+        return false;
+    }
+    RemoveAt(i);
+    return true;
+}
+
+void EdgeSet::Clear()
+{
+    while( this->size_ > 0 ) RemoveAt(this->size_ - 1);
+}
+
+void EdgeSet::SetIndex(int i, int index)
+{
+    Edge *edge = this->data_[i].get();
+    switch( this->kind_ ) {
+    case kOut:
+        edge->index_in_start_node_ = index;
+        break;
+    case kIn:
+        edge->index_in_end_node_ = index;
+        break;
+    case kInitial:
+        if( edge->start_node_ == this->node_ ) {
+            edge->index_in_start_initial_ = index;
+        } else {
+            edge->index_in_end_initial_ = index;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+int EdgeSet::IndexOf(const Edge *edge) const
+{
+    switch( this->kind_ ) {
+    case kOut:
+        return edge->index_in_start_node_;
+    case kIn:
+        return edge->index_in_end_node_;
+    case kInitial:
+        return (edge->start_node_ == this->node_)
+                ? edge->index_in_start_initial_ : edge->index_in_end_initial_;
+    default:
+        return -1;
+    }
+}
+
+std::shared_ptr<Edge>* EdgeSet::NewData(int capacity)
+{
+    std::size_t size = capacity*sizeof(std::shared_ptr<Edge>);
+    void *block = this->arena_ ? this->arena_->Allocate(size)
+                               : ::operator new(size);
+    std::shared_ptr<Edge> *data = static_cast<std::shared_ptr<Edge>*>(block);
+    for( int i = 0; i < capacity; i++ ) new(&data[i]) std::shared_ptr<Edge>();
+    return data;
+}
+
+void EdgeSet::DeleteData(std::shared_ptr<Edge> *data, int capacity)
+{
+    for( int i = 0; i < capacity; i++ ) data[i].~shared_ptr<Edge>();
+    if( this->arena_ ) {
+        this->arena_->Deallocate(data,
+                                 capacity*sizeof(std::shared_ptr<Edge>));
+    } else {
+        ::operator delete(data);
+    }
+}
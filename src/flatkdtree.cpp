@@ -0,0 +1,385 @@
+#include <DRRT/flatkdtree.h>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <thread>
+
+void FlatKDTree::Reserve(int n)
+{
+    this->positions_.reserve(n*this->dimensions_);
+    this->split_dim_.reserve(n);
+    this->split_value_.reserve(n);
+    this->child_L_.reserve(n);
+    this->child_R_.reserve(n);
+    this->parent_.reserve(n);
+    this->handles_.reserve(n);
+}
+
+int FlatKDTree::Insert(std::shared_ptr<KDTreeNode> &node)
+{
+    int index = this->tree_size_;
+    for( int i = 0; i < this->dimensions_; i++ ) {
+        this->positions_.push_back(node->position_(i));
+    }
+    this->child_L_.push_back(-1);
+    this->child_R_.push_back(-1);
+    this->size_.push_back(1);
+    this->handles_.push_back(node);
+    node->kd_index_ = index;
+
+    if( index == 0 ) {
+        this->root_ = 0;
+        this->parent_.push_back(-1);
+        this->split_dim_.push_back(0);
+        this->split_value_.push_back(node->position_(0));
+        this->tree_size_ = 1;
+        node->kd_split_ = 0;
+        return index;
+    }
+
+    // Figure out where to put this node, counting it in every
+    // subtree on the way down
+    int parent = this->root_;
+    int depth = 1;
+    while( true ) {
+        this->size_[parent] += 1;
+        if( (Coord)node->position_(this->split_dim_[parent])
+                < this->split_value_[parent] ) {
+            // Traverse tree to the left
+            if( this->child_L_[parent] == -1 ) {
+                this->child_L_[parent] = index;
+                break;
+            }
+            parent = this->child_L_[parent];
+        } else {
+            // Traverse tree to the right
+            if( this->child_R_[parent] == -1 ) {
+                this->child_R_[parent] = index;
+                break;
+            }
+            parent = this->child_R_[parent];
+        }
+        depth += 1;
+    }
+
+    int split = this->split_dim_[parent] + 1;
+    if( split == this->dimensions_ ) split = 0;
+    this->parent_.push_back(parent);
+    this->split_dim_.push_back(split);
+    this->split_value_.push_back(node->position_(split));
+
+    this->tree_size_ += 1;
+    if( depth > std::log(this->tree_size_)/std::log(1.0/this->balance_) ) {
+        Rebalance(index);
+    }
+    node->kd_split_ = this->split_dim_[index];
+    return index;
+}
+
+void FlatKDTree::BulkInsert(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                            bool parallel)
+{
+    // Append the nodes unlinked, then link the whole tree up from scratch
+    const int size = this->tree_size_ + (int)nodes.size();
+    Reserve(size);
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        for( int j = 0; j < this->dimensions_; j++ ) {
+            this->positions_.push_back(nodes[i]->position_(j));
+        }
+        this->handles_.push_back(nodes[i]);
+        nodes[i]->kd_index_ = this->tree_size_ + i;
+    }
+    this->tree_size_ = size;
+    this->split_dim_.resize(size);
+    this->split_value_.resize(size);
+    this->child_L_.resize(size);
+    this->child_R_.resize(size);
+    this->parent_.resize(size);
+    this->size_.resize(size);
+
+    std::vector<int> all(size);
+    for( int i = 0; i < size; i++ ) all[i] = i;
+    int threads = parallel ? (int)std::thread::hardware_concurrency() : 1;
+    this->root_ = Build(all, 0, size, -1, std::max(threads, 1));
+}
+
+void FlatKDTree::Renumber(const std::vector<int> &order)
+{
+    // Copy the nodes that are left over in their new order
+    const int d = this->dimensions_;
+    const int size = (int)order.size();
+    std::vector<Coord> positions(size*d);
+    std::vector<std::shared_ptr<KDTreeNode>> handles(size);
+    for( int i = 0; i < size; i++ ) {
+        std::copy(&this->positions_[order[i]*d],
+                  &this->positions_[order[i]*d] + d, &positions[i*d]);
+        handles[i] = std::move(this->handles_[order[i]]);
+        handles[i]->kd_index_ = i;
+    }
+    this->tree_size_ = size;
+    this->positions_.swap(positions);
+    this->handles_.swap(handles);
+    this->split_dim_.resize(size);
+    this->split_value_.resize(size);
+    this->child_L_.resize(size);
+    this->child_R_.resize(size);
+    this->parent_.resize(size);
+    this->size_.resize(size);
+
+    // And link them up again from scratch
+    std::vector<int> all(size);
+    for( int i = 0; i < size; i++ ) all[i] = i;
+    this->root_ = Build(all, 0, size, -1);
+}
+
+void FlatKDTree::Rebalance(int index)
+{
+    // Walk up to the first subtree with too many nodes on one side
+    int n = this->parent_[index];
+    while( n != -1 ) {
+        int left = (this->child_L_[n] == -1) ? 0 : this->size_[this->child_L_[n]];
+        int right = (this->child_R_[n] == -1) ? 0 : this->size_[this->child_R_[n]];
+        if( std::max(left, right) > this->balance_*this->size_[n] ) break;
+        n = this->parent_[n];
+    }
+    if( n == -1 ) return;
+
+    // Collect the subtree and link it back up balanced
+    std::vector<int> order;
+    order.reserve(this->size_[n]);
+    order.push_back(n);
+    for( int i = 0; i < (int)order.size(); i++ ) {
+        if( this->child_L_[order[i]] != -1 ) order.push_back(this->child_L_[order[i]]);
+        if( this->child_R_[order[i]] != -1 ) order.push_back(this->child_R_[order[i]]);
+    }
+    int parent = this->parent_[n];
+    int subtree = Build(order, 0, (int)order.size(), parent);
+    if( parent == -1 ) this->root_ = subtree;
+    else if( this->child_L_[parent] == n ) this->child_L_[parent] = subtree;
+    else this->child_R_[parent] = subtree;
+}
+
+int FlatKDTree::Build(std::vector<int> &order, int lo, int hi, int parent,
+                      int threads)
+{
+    if( lo >= hi ) return -1;
+
+    // Split along the dimension with the largest spread
+    const std::vector<Coord> &positions = this->positions_;
+    const int d = this->dimensions_;
+    int split = 0;
+    double spread = -1.0;
+    for( int j = 0; j < d; j++ ) {
+        double low = INF, high = -INF;
+        for( int i = lo; i < hi; i++ ) {
+            low = std::min(low, (double)positions[order[i]*d + j]);
+            high = std::max(high, (double)positions[order[i]*d + j]);
+        }
+        if( high - low > spread ) {
+            spread = high - low;
+            split = j;
+        }
+    }
+    int m = MedianSplit(order, lo, hi, [&positions, d, split](int i)
+                        { return positions[i*d + split]; });
+
+    int index = order[m];
+    this->split_dim_[index] = split;
+    this->split_value_[index] = positions[index*d + split];
+    this->parent_[index] = parent;
+    this->size_[index] = hi - lo;
+    if( this->handles_[index] ) this->handles_[index]->kd_split_ = split;
+
+    // The two sides touch disjoint nodes, so big ones can be built at once
+    if( threads > 1 && hi - lo > kParallelBuild ) {
+        std::future<int> left = std::async(std::launch::async,
+                                           &FlatKDTree::Build, this,
+                                           std::ref(order), lo, m, index,
+                                           threads/2);
+        this->child_R_[index] = Build(order, m + 1, hi, index,
+                                      threads - threads/2);
+        this->child_L_[index] = left.get();
+        return index;
+    }
+    this->child_L_[index] = Build(order, lo, m, index);
+    this->child_R_[index] = Build(order, m + 1, hi, index);
+    return index;
+}
+
+int FlatKDTree::FindExact(const Eigen::VectorXd &pos) const
+{
+    // Nodes are stored rounded to Coord, so look for pos rounded the same
+    Stored stored = pos.cast<Coord>();
+    int index = this->root_;
+    while( index != -1 ) {
+        if( this->handles_[index] && Position(index) == stored ) return index;
+        if( stored(this->split_dim_[index]) < this->split_value_[index] ) {
+            index = this->child_L_[index];
+        } else {
+            index = this->child_R_[index];
+        }
+    }
+    return -1;
+}
+
+void FlatKDTree::FindNearest(const Eigen::VectorXd &queryPoint,
+                             int &nearest, double &nearestDist,
+                             KDQueryScratch &scratch) const
+{
+    if( this->tree_size_ == 0 ) return;
+
+    scratch.stack_.clear();
+    scratch.stack_.push_back(std::make_pair(this->root_, 0.0));
+    while( !scratch.stack_.empty() ) {
+        int index = scratch.stack_.back().first;
+        double bound = scratch.stack_.back().second;
+        scratch.stack_.pop_back();
+
+        // Everything in this subtree is on the far side of a hyperplane
+        // that is further away than the best node found since it was pushed
+        // (or not enough closer for an approximate query)
+        if( scratch.Skip(bound, nearestDist) ) continue;
+
+        // Removed nodes are only kept for their splitting hyperplane, and
+        // only the live ones count against the budget
+        if( this->handles_[index] ) {
+            scratch.visits_++;
+            double newDist = this->distanceFunction(
+                        queryPoint, Position(index).cast<double>());
+            if( newDist < nearestDist ) {
+                nearest = index;
+                nearestDist = newDist;
+            }
+        }
+
+        double hyperPlaneDist = queryPoint(this->split_dim_[index])
+                                - this->split_value_[index];
+        int nearChild, farChild;
+        if( hyperPlaneDist < 0 ) {
+            nearChild = this->child_L_[index];
+            farChild = this->child_R_[index];
+        } else {
+            nearChild = this->child_R_[index];
+            farChild = this->child_L_[index];
+        }
+
+        // Push the far side first so the near side is searched first
+        if( farChild != -1 ) {
+            scratch.stack_.push_back(std::make_pair(farChild,
+                                                    std::abs(hyperPlaneDist)));
+        }
+        if( nearChild != -1 ) {
+            scratch.stack_.push_back(std::make_pair(nearChild, bound));
+        }
+    }
+}
+
+void FlatKDTree::FindWithinRange(const Eigen::VectorXd &queryPoint, double range,
+                                 KDQueryScratch &scratch) const
+{
+    if( this->tree_size_ == 0 ) return;
+
+    scratch.stack_.clear();
+    scratch.stack_.push_back(std::make_pair(this->root_, 0.0));
+    while( !scratch.stack_.empty() ) {
+        int index = scratch.stack_.back().first;
+        double bound = scratch.stack_.back().second;
+        scratch.stack_.pop_back();
+        if( bound >= range || scratch.Skip(bound, range) ) continue;
+
+        if( this->handles_[index] ) {
+            scratch.visits_++;
+            double newDist = this->distanceFunction(
+                        queryPoint, Position(index).cast<double>());
+            if( newDist < range ) {
+                scratch.hits_.push_back(std::make_pair(index, newDist));
+            }
+        }
+
+        double hyperPlaneDist = queryPoint(this->split_dim_[index])
+                                - this->split_value_[index];
+        int nearChild, farChild;
+        if( hyperPlaneDist < 0 ) {
+            nearChild = this->child_L_[index];
+            farChild = this->child_R_[index];
+        } else {
+            nearChild = this->child_R_[index];
+            farChild = this->child_L_[index];
+        }
+
+        // The other side is only searched if the hyperplane is within range
+        if( farChild != -1 ) {
+            scratch.stack_.push_back(std::make_pair(farChild,
+                                                    std::abs(hyperPlaneDist)));
+        }
+        if( nearChild != -1 ) {
+            scratch.stack_.push_back(std::make_pair(nearChild, bound));
+        }
+    }
+}
+
+void FlatKDTree::FindKNearest(const Eigen::VectorXd &queryPoint, int k,
+                              KDQueryScratch &scratch) const
+{
+    if( this->tree_size_ == 0 || k <= 0 ) return;
+
+    scratch.stack_.clear();
+    scratch.stack_.push_back(std::make_pair(this->root_, 0.0));
+    while( !scratch.stack_.empty() ) {
+        int index = scratch.stack_.back().first;
+        double bound = scratch.stack_.back().second;
+        scratch.stack_.pop_back();
+
+        double worstDist = scratch.WorstKNN(k);
+        if( bound > worstDist ) continue;
+
+        if( this->handles_[index] ) {
+            double newDist = this->distanceFunction(
+                        queryPoint, Position(index).cast<double>());
+            if( newDist < worstDist ) scratch.OfferKNN(newDist, index, k);
+        }
+
+        double hyperPlaneDist = queryPoint(this->split_dim_[index])
+                                - this->split_value_[index];
+        int nearChild, farChild;
+        if( hyperPlaneDist < 0 ) {
+            nearChild = this->child_L_[index];
+            farChild = this->child_R_[index];
+        } else {
+            nearChild = this->child_R_[index];
+            farChild = this->child_L_[index];
+        }
+
+        if( farChild != -1 ) {
+            scratch.stack_.push_back(std::make_pair(farChild,
+                                                    std::abs(hyperPlaneDist)));
+        }
+        if( nearChild != -1 ) {
+            scratch.stack_.push_back(std::make_pair(nearChild, bound));
+        }
+    }
+}
+
+void FlatKDTree::PrintTree(int index, int indent, char type)
+{
+    if( index == -1 ) index = this->root_;
+    if( index == -1 ) return;
+    std::shared_ptr<KDTreeNode> node = this->handles_[index];
+    if(indent) std::cout << std::string(indent-1,' ') << type;
+    std::cout << Position(index)(0) << ","
+              << Position(index)(1) << ": ";
+    if( node ) std::cout << node->rrt_LMC_;
+    else std::cout << "removed";
+    std::cout << " [" << index << "]";
+    if( this->child_L_[index] == -1 && this->child_R_[index] == -1 ) {
+        std::cout << " | leaf" << std::endl;
+    } else {
+        std::cout << std::endl;
+        if( this->child_L_[index] != -1 ) {
+            PrintTree(this->child_L_[index], indent+4, '<');
+        }
+        if( this->child_R_[index] != -1 ) {
+            PrintTree(this->child_R_[index], indent+4, '>');
+        }
+    }
+}
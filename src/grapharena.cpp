@@ -0,0 +1,170 @@
+#include <DRRT/grapharena.h>
+#include <new>
+
+namespace {
+
+// Threads that are alive hold distinct slots, a slot is handed to a new
+// thread once the thread that had it exits
+std::mutex slot_mutex;
+std::vector<int> free_slots;
+int next_slot = 0;
+
+struct ThreadSlot {
+    int index_;
+
+    ThreadSlot()
+    {
+        std::lock_guard<std::mutex> lock(slot_mutex);
+        if( free_slots.empty() ) {
+            this->index_ = next_slot++;
+        } else {
+            this->index_ = free_slots.back();
+            free_slots.pop_back();
+        }
+    }
+
+    ~ThreadSlot()
+    {
+        std::lock_guard<std::mutex> lock(slot_mutex);
+        free_slots.push_back(this->index_);
+        // Anything the thread frees from here on takes the locked way
+        this->index_ = GraphArena::kThreads;
+    }
+};
+
+thread_local ThreadSlot thread_slot;
+
+}
+
+GraphArena::GraphArena() : slab_count_(0)
+{
+    for( int t = 0; t < kThreads; t++ ) {
+        for( int c = 0; c < kClasses; c++ ) {
+            this->caches_[t].free_[c] = NULL;
+            this->caches_[t].count_[c] = 0;
+        }
+        this->caches_[t].taken_ = 0;
+        this->caches_[t].given_ = 0;
+    }
+    for( int c = 0; c < kClasses; c++ ) {
+        this->overflow_.free_[c] = NULL;
+        this->overflow_.count_[c] = 0;
+        this->shared_[c] = NULL;
+    }
+    this->overflow_.taken_ = 0;
+    this->overflow_.given_ = 0;
+}
+
+GraphArena::~GraphArena()
+{
+    for( int i = 0; i < (int)this->slabs_.size(); i++ ) {
+        ::operator delete(this->slabs_[i]);
+    }
+}
+
+void* GraphArena::Allocate(std::size_t size)
+{
+    int c = (int)((size + kGranule - 1)/kGranule) - 1;
+    if( c < 0 ) c = 0;
+    if( c >= kClasses ) return ::operator new(size);
+
+    int slot = thread_slot.index_;
+    if( slot >= kThreads ) {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        Cache &cache = this->overflow_;
+        if( cache.free_[c] == NULL ) Refill(cache, c);
+        Block *block = cache.free_[c];
+        cache.free_[c] = block->next_;
+        cache.count_[c]--;
+        cache.taken_++;
+        return block;
+    }
+
+    Cache &cache = this->caches_[slot];
+    if( cache.free_[c] == NULL ) {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        Refill(cache, c);
+    }
+    Block *block = cache.free_[c];
+    cache.free_[c] = block->next_;
+    cache.count_[c]--;
+    cache.taken_++;
+    return block;
+}
+
+void GraphArena::Deallocate(void *block, std::size_t size)
+{
+    int c = (int)((size + kGranule - 1)/kGranule) - 1;
+    if( c < 0 ) c = 0;
+    if( c >= kClasses ) {
+        ::operator delete(block);
+        return;
+    }
+
+    Block *b = static_cast<Block*>(block);
+    int slot = thread_slot.index_;
+    if( slot >= kThreads ) {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        Cache &cache = this->overflow_;
+        b->next_ = cache.free_[c];
+        cache.free_[c] = b;
+        cache.count_[c]++;
+        cache.given_++;
+        return;
+    }
+
+    Cache &cache = this->caches_[slot];
+    b->next_ = cache.free_[c];
+    cache.free_[c] = b;
+    cache.count_[c]++;
+    cache.given_++;
+    if( cache.count_[c] > 2*kBatch ) {
+        // This thread frees more than it makes, let others have them
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        Spill(cache, c);
+    }
+}
+
+long GraphArena::BlocksInUse() const
+{
+    long in_use = this->overflow_.taken_ - this->overflow_.given_;
+    for( int t = 0; t < kThreads; t++ ) {
+        in_use += this->caches_[t].taken_ - this->caches_[t].given_;
+    }
+    return in_use;
+}
+
+void GraphArena::Refill(Cache &cache, int c)
+{
+    // Take a batch of the blocks other threads gave up first
+    for( int i = 0; i < kBatch && this->shared_[c] != NULL; i++ ) {
+        Block *block = this->shared_[c];
+        this->shared_[c] = block->next_;
+        block->next_ = cache.free_[c];
+        cache.free_[c] = block;
+        cache.count_[c]++;
+    }
+    if( cache.free_[c] != NULL ) return;
+
+    std::size_t block_size = (std::size_t)(c + 1)*kGranule;
+    char *slab = static_cast<char*>(::operator new(block_size*kBatch));
+    this->slabs_.push_back(slab);
+    this->slab_count_++;
+    for( int i = kBatch - 1; i >= 0; i-- ) {
+        Block *block = reinterpret_cast<Block*>(slab + i*block_size);
+        block->next_ = cache.free_[c];
+        cache.free_[c] = block;
+    }
+    cache.count_[c] += kBatch;
+}
+
+void GraphArena::Spill(Cache &cache, int c)
+{
+    for( int i = 0; i < kBatch; i++ ) {
+        Block *block = cache.free_[c];
+        cache.free_[c] = block->next_;
+        block->next_ = this->shared_[c];
+        this->shared_[c] = block;
+    }
+    cache.count_[c] -= kBatch;
+}
@@ -0,0 +1,284 @@
+#include <DRRT/hashgrid.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+HashGrid::HashGrid(double cell_size, int theta_bins)
+    :   cell_size_(cell_size),
+        theta_bins_(std::max(1, std::min(theta_bins, (int)kMaxBins))),
+        min_x_(INT_MAX), max_x_(INT_MIN), min_y_(INT_MAX), max_y_(INT_MIN)
+{}
+
+void HashGrid::Reserve(int n)
+{
+    this->positions_.reserve(n);
+    this->handles_.reserve(n);
+}
+
+int HashGrid::Insert(std::shared_ptr<KDTreeNode> &node)
+{
+    int index = this->tree_size_;
+    this->positions_.push_back(Stored(node->position_.cast<Coord>()));
+    this->handles_.push_back(node);
+    node->kd_index_ = index;
+    AddToGrid(index);
+    this->tree_size_ += 1;
+    return index;
+}
+
+int HashGrid::FindExact(const Eigen::VectorXd &pos) const
+{
+    Stored point = pos.cast<Coord>();
+    int cell = FindCell(CellOf(point(0)), CellOf(point(1)));
+    if( cell == -1 ) return -1;
+    const Bin &bin = this->bins_[cell*this->theta_bins_ + BinOf(point(2))];
+    for( int i = 0; i < (int)bin.ids_.size(); i++ ) {
+        if( this->positions_[bin.ids_[i]] == point ) return bin.ids_[i];
+    }
+    return -1;
+}
+
+void HashGrid::Remove(int index)
+{
+    const Stored &point = this->positions_[index];
+    int cell = FindCell(CellOf(point(0)), CellOf(point(1)));
+    Bin &bin = this->bins_[cell*this->theta_bins_ + BinOf(point(2))];
+    this->handles_[index].reset();
+
+    // Move the last point of the bin into the slot of the removed one
+    int slot = std::find(bin.ids_.begin(), bin.ids_.end(), index)
+               - bin.ids_.begin();
+    int last = (int)bin.ids_.size() - 1;
+    int capacity = bin.Capacity();
+    for( int j = 0; j < 3; j++ ) {
+        bin.coords_[j*capacity + slot] = bin.coords_[j*capacity + last];
+    }
+    bin.ids_[slot] = bin.ids_[last];
+    bin.ids_.pop_back();
+}
+
+void HashGrid::Renumber(const std::vector<int> &order)
+{
+    const int size = (int)order.size();
+    std::vector<Stored, Eigen::aligned_allocator<Stored>> positions(size);
+    std::vector<std::shared_ptr<KDTreeNode>> handles(size);
+    for( int i = 0; i < size; i++ ) {
+        positions[i] = this->positions_[order[i]];
+        handles[i] = std::move(this->handles_[order[i]]);
+        handles[i]->kd_index_ = i;
+    }
+    this->tree_size_ = size;
+    this->positions_.swap(positions);
+    this->handles_.swap(handles);
+
+    // Empty cells are dropped too
+    this->cells_.clear();
+    this->bins_.clear();
+    this->min_x_ = this->min_y_ = INT_MAX;
+    this->max_x_ = this->max_y_ = INT_MIN;
+    for( int i = 0; i < size; i++ ) AddToGrid(i);
+}
+
+void HashGrid::FindNearest(const Eigen::VectorXd &queryPoint,
+                           int &nearest, double &nearestDist,
+                           KDQueryScratch &scratch) const
+{
+    if( this->tree_size_ == 0 || this->cells_.empty() ) return;
+    const Point q = queryPoint;
+    double binBound[kMaxBins];
+    BinBounds(q(2), binBound);
+
+    // Points in ring k are at least (k-1) cells and the distance from q
+    // to the side of its own cell away
+    int cx = CellOf(q(0)), cy = CellOf(q(1));
+    double edge = std::min(std::min(q(0) - cx*this->cell_size_,
+                                    (cx + 1)*this->cell_size_ - q(0)),
+                           std::min(q(1) - cy*this->cell_size_,
+                                    (cy + 1)*this->cell_size_ - q(1)));
+    int first = std::max(std::max(this->min_x_ - cx, cx - this->max_x_),
+                         std::max(this->min_y_ - cy, cy - this->max_y_));
+    for( int k = std::max(first, 0); ; k++ ) {
+        double ringBound = (k == 0) ? 0.0 : (k - 1)*this->cell_size_ + edge;
+        if( scratch.Skip(ringBound, nearestDist) ) break;
+
+        bool inUse = VisitRing(cx, cy, k, [&](int cell, int x, int y) {
+            double cellBound = CellBound(q, x, y);
+            if( scratch.Skip(cellBound, nearestDist) ) return;
+            bool scored = false;
+            for( int b = 0; b < this->theta_bins_; b++ ) {
+                int bin = cell*this->theta_bins_ + b;
+                if( this->bins_[bin].ids_.empty() ) continue;
+                double bound = std::sqrt(cellBound*cellBound
+                                         + binBound[b]*binBound[b]);
+                if( scratch.Skip(bound, nearestDist) ) continue;
+                scored = true;
+                ScoreBin(q, bin, [&](int index, double dist) {
+                    if( dist < nearestDist ) {
+                        nearest = index;
+                        nearestDist = dist;
+                    }
+                });
+            }
+            // Cells whose bins were all emptied do not count
+            if( scored ) scratch.visits_++;
+        });
+        if( !inUse ) break;
+    }
+}
+
+void HashGrid::FindWithinRange(const Eigen::VectorXd &queryPoint,
+                               double range, KDQueryScratch &scratch) const
+{
+    if( this->tree_size_ == 0 || this->cells_.empty() ) return;
+    const Point q = queryPoint;
+    double binBound[kMaxBins];
+    BinBounds(q(2), binBound);
+
+    // Only the cells that the range overlaps along x and y (clamped in
+    // double first, the range may be INF)
+    double span = range/this->cell_size_;
+    int lowX = (int)std::max(std::floor(q(0)/this->cell_size_ - span),
+                             (double)this->min_x_);
+    int highX = (int)std::min(std::floor(q(0)/this->cell_size_ + span),
+                              (double)this->max_x_);
+    int lowY = (int)std::max(std::floor(q(1)/this->cell_size_ - span),
+                             (double)this->min_y_);
+    int highY = (int)std::min(std::floor(q(1)/this->cell_size_ + span),
+                              (double)this->max_y_);
+    for( int x = lowX; x <= highX; x++ ) {
+        for( int y = lowY; y <= highY; y++ ) {
+            int cell = FindCell(x, y);
+            if( cell == -1 ) continue;
+            double cellBound = CellBound(q, x, y);
+            if( cellBound >= range || scratch.Skip(cellBound, range) ) continue;
+
+            bool scored = false;
+            for( int b = 0; b < this->theta_bins_; b++ ) {
+                int bin = cell*this->theta_bins_ + b;
+                if( this->bins_[bin].ids_.empty() ) continue;
+                double bound = std::sqrt(cellBound*cellBound
+                                         + binBound[b]*binBound[b]);
+                if( bound >= range || scratch.Skip(bound, range) ) continue;
+                scored = true;
+                ScoreBin(q, bin, [&](int index, double dist) {
+                    if( dist < range ) {
+                        scratch.hits_.push_back(std::make_pair(index, dist));
+                    }
+                });
+            }
+            if( scored ) scratch.visits_++;
+        }
+    }
+}
+
+void HashGrid::FindKNearest(const Eigen::VectorXd &queryPoint, int k,
+                            KDQueryScratch &scratch) const
+{
+    if( this->tree_size_ == 0 || this->cells_.empty() || k <= 0 ) return;
+    const Point q = queryPoint;
+    double binBound[kMaxBins];
+    BinBounds(q(2), binBound);
+
+    // Same rings as FindNearest, bounded by the worst node in the heap
+    int cx = CellOf(q(0)), cy = CellOf(q(1));
+    double edge = std::min(std::min(q(0) - cx*this->cell_size_,
+                                    (cx + 1)*this->cell_size_ - q(0)),
+                           std::min(q(1) - cy*this->cell_size_,
+                                    (cy + 1)*this->cell_size_ - q(1)));
+    int first = std::max(std::max(this->min_x_ - cx, cx - this->max_x_),
+                         std::max(this->min_y_ - cy, cy - this->max_y_));
+    for( int ring = std::max(first, 0); ; ring++ ) {
+        double ringBound = (ring == 0) ? 0.0
+                                       : (ring - 1)*this->cell_size_ + edge;
+        if( ringBound > scratch.WorstKNN(k) ) break;
+
+        bool inUse = VisitRing(cx, cy, ring, [&](int cell, int x, int y) {
+            double cellBound = CellBound(q, x, y);
+            if( cellBound > scratch.WorstKNN(k) ) return;
+            for( int b = 0; b < this->theta_bins_; b++ ) {
+                int bin = cell*this->theta_bins_ + b;
+                double bound = std::sqrt(cellBound*cellBound
+                                         + binBound[b]*binBound[b]);
+                if( bound > scratch.WorstKNN(k) ) continue;
+                ScoreBin(q, bin, [&](int index, double dist) {
+                    if( dist < scratch.WorstKNN(k) ) {
+                        scratch.OfferKNN(dist, index, k);
+                    }
+                });
+            }
+        });
+        if( !inUse ) break;
+    }
+}
+
+int HashGrid::BinOf(double theta) const
+{
+    theta = std::fmod(theta, 2.0*PI);
+    if( theta < 0.0 ) theta += 2.0*PI;
+    int b = (int)(theta*this->theta_bins_/(2.0*PI));
+    return std::min(b, this->theta_bins_ - 1);
+}
+
+void HashGrid::AddToGrid(int index)
+{
+    const Stored &point = this->positions_[index];
+    int cx = CellOf(point(0)), cy = CellOf(point(1));
+    int cell = FindCell(cx, cy);
+    if( cell == -1 ) {
+        cell = (int)this->cells_.size();
+        this->cells_[Key(cx, cy)] = cell;
+        this->bins_.resize(this->bins_.size() + this->theta_bins_);
+        this->min_x_ = std::min(this->min_x_, cx);
+        this->max_x_ = std::max(this->max_x_, cx);
+        this->min_y_ = std::min(this->min_y_, cy);
+        this->max_y_ = std::max(this->max_y_, cy);
+    }
+    Bin &bin = this->bins_[cell*this->theta_bins_ + BinOf(point(2))];
+
+    // Grow the struct-of-arrays block when it is full
+    int n = (int)bin.ids_.size();
+    int capacity = bin.Capacity();
+    if( n == capacity ) {
+        int grown = std::max(4, 2*capacity);
+        std::vector<Coord> coords(3*grown);
+        for( int j = 0; j < 3; j++ ) {
+            std::copy(bin.coords_.begin() + j*capacity,
+                      bin.coords_.begin() + j*capacity + n,
+                      coords.begin() + j*grown);
+        }
+        bin.coords_.swap(coords);
+        capacity = grown;
+    }
+    for( int j = 0; j < 3; j++ ) bin.coords_[j*capacity + n] = point(j);
+    bin.ids_.push_back(index);
+}
+
+void HashGrid::BinBounds(double theta, double *bound) const
+{
+    // Outside its slice, the closest angle of a slice is one of its ends
+    int own = BinOf(theta);
+    double width = 2.0*PI/this->theta_bins_;
+    for( int b = 0; b < this->theta_bins_; b++ ) {
+        if( b == own ) {
+            bound[b] = 0.0;
+            continue;
+        }
+        double low = std::abs(theta - b*width);
+        double high = std::abs(theta - (b + 1)*width);
+        low = std::fmod(low, 2.0*PI);
+        high = std::fmod(high, 2.0*PI);
+        bound[b] = std::min(std::min(low, 2.0*PI - low),
+                            std::min(high, 2.0*PI - high));
+    }
+}
+
+double HashGrid::CellBound(const Point &queryPoint, int cx, int cy) const
+{
+    double low = cx*this->cell_size_;
+    double dx = std::max(0.0, std::max(low - queryPoint(0),
+                                       queryPoint(0) - low - this->cell_size_));
+    low = cy*this->cell_size_;
+    double dy = std::max(0.0, std::max(low - queryPoint(1),
+                                       queryPoint(1) - low - this->cell_size_));
+    return std::sqrt(dx*dx + dy*dy);
+}
@@ -6,10 +6,100 @@
 #include <DRRT/jlist.h>
 #include <DRRT/kdtreenode.h>
 #include <DRRT/edge.h>
+#include <mutex>
+#include <atomic>
+
+namespace {
+
+// Cells no thread holds on to, linked through child_
+std::mutex pool_mutex;
+JListNode *pool_free = NULL;
+std::atomic<long> slab_count(0);
+
+// The free cells of one thread, linked through child_
+struct FreeCells {
+    JListNode *head_;
+
+    FreeCells() : head_(NULL) {}
+
+    // Hands the cells back when the thread exits
+    ~FreeCells()
+    {
+        if( this->head_ == NULL ) return;
+        JListNode *tail = this->head_;
+        while( tail->child_ != NULL ) tail = tail->child_;
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        tail->child_ = pool_free;
+        pool_free = this->head_;
+    }
+};
+
+thread_local FreeCells free_cells;
+
+}
+
+JListNode* JListPool::New()
+{
+    if( free_cells.head_ == NULL ) {
+        // Take a slab's worth of cells, from other threads if they left
+        // some, otherwise from a new slab
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        for( int i = 0; i < kSlabSize && pool_free != NULL; i++ ) {
+            JListNode *cell = pool_free;
+            pool_free = cell->child_;
+            cell->child_ = free_cells.head_;
+            free_cells.head_ = cell;
+        }
+        if( free_cells.head_ == NULL ) {
+            JListNode *slab = new JListNode[kSlabSize];
+            slab_count++;
+            for( int i = 0; i < kSlabSize; i++ ) {
+                slab[i].child_ = free_cells.head_;
+                free_cells.head_ = &slab[i];
+            }
+        }
+    }
+
+    JListNode *cell = free_cells.head_;
+    free_cells.head_ = cell->child_;
+    cell->child_ = cell;
+    cell->parent_ = cell;
+    return cell;
+}
+
+long JListPool::SlabCount()
+{
+    return slab_count.load();
+}
+
+void JListPool::Delete(JListNode *cell)
+{
+    // Dropping the node or edge may free lists that give back cells too,
+    // so the cell is done with before that
+    std::shared_ptr<KDTreeNode> node;
+    std::shared_ptr<Edge> edge;
+    node.swap(cell->node_);
+    edge.swap(cell->edge_);
+    cell->key_ = -1.0;
+    cell->list_ = NULL;
+    cell->parent_ = cell;
+    cell->child_ = free_cells.head_;
+    free_cells.head_ = cell;
+}
+
+JList::~JList()
+{
+    JListNode *ptr = front_;
+    while( ptr != ptr->child_ ) {
+        JListNode *next = ptr->child_;
+        JListPool::Delete(ptr);
+        ptr = next;
+    }
+}
 
 bool JList::JListContains(std::shared_ptr<KDTreeNode> &t)
 {
-    std::shared_ptr<JListNode> ptr = front_;
+    JListNode *ptr = front_;
     while( ptr != ptr->child_ ) {
         if( t == ptr->node_ ) {
             return true;
@@ -19,11 +109,13 @@ bool JList::JListContains(std::shared_ptr<KDTreeNode> &t)
     return false;
 }
 
-void JList::JListPush( std::shared_ptr<KDTreeNode> &t )
+JListNode* JList::PushCell()
 {
-    std::shared_ptr<JListNode> newNode = std::make_shared<JListNode>( t );
+    JListNode *newNode = JListPool::New();
     newNode->parent_ = front_->parent_;
     newNode->child_ = front_;
+    newNode->list_ = this;
+    newNode->key_ = 0.0;
 
     if( length_ == 0 ) {
         back_ = newNode;
@@ -33,56 +125,46 @@ void JList::JListPush( std::shared_ptr<KDTreeNode> &t )
 
     front_ = newNode;
     length_ += 1;
+    return newNode;
 }
 
-void JList::JListPush( std::shared_ptr<Edge> &e )
+JListNode* JList::PopCell()
 {
-    std::shared_ptr<JListNode> newNode = std::make_shared<JListNode>( e );
-    newNode->parent_ = front_->parent_;
-    newNode->child_ = front_;
-
-    if( length_ == 0 ) {
-        back_ = newNode;
-    } else {
-        front_->parent_ = newNode;
+    JListNode *oldTop = front_;
+    if( length_ > 1 ) {
+        front_->child_->parent_ = front_->parent_;
+        front_ = front_->child_;
+    } else if( length_ == 1 ) {
+        back_ = bound_;
+        front_ = bound_;
     }
 
-    front_ = newNode;
-    length_ += 1;
+    length_ -= 1;
+    return oldTop;
 }
 
-void JList::JListPush( std::shared_ptr<KDTreeNode> &t, double k )
+void JList::JListPush( std::shared_ptr<KDTreeNode> &t )
 {
-    std::shared_ptr<JListNode> newNode = std::make_shared<JListNode>( t );
-    newNode->parent_ = front_->parent_;
-    newNode->child_ = front_;
+    PushCell()->node_ = t;
+}
 
-    if( length_ == 0 ) {
-        back_ = newNode;
-    } else {
-        front_->parent_ = newNode;
-    }
+void JList::JListPush( std::shared_ptr<Edge> &e )
+{
+    PushCell()->edge_ = e;
+}
 
+void JList::JListPush( std::shared_ptr<KDTreeNode> &t, double k )
+{
+    JListNode *newNode = PushCell();
+    newNode->node_ = t;
     newNode->key_ = k;
-    front_ = newNode;
-    length_ += 1;
 }
 
 void JList::JListPush( std::shared_ptr<Edge> &e, double k )
 {
-    std::shared_ptr<JListNode> newNode = std::make_shared<JListNode>( e );
-    newNode->parent_ = front_->parent_;
-    newNode->child_ = front_;
-
-    if( length_ == 0 ) {
-        back_ = newNode;
-    } else {
-        front_->parent_ = newNode;
-    }
-
+    JListNode *newNode = PushCell();
+    newNode->edge_ = e;
     newNode->key_ = k;
-    front_ = newNode;
-    length_ += 1;
 }
 
 void JList::JListTop( std::shared_ptr<KDTreeNode> &t )
@@ -135,21 +217,9 @@ void JList::JListPop( std::shared_ptr<KDTreeNode> &t )
         // Jlist is empty
         t = std::make_shared<KDTreeNode>();
     } else {
-        std::shared_ptr<JListNode> oldTop = front_;
-        if( length_ > 1 ) {
-            front_->child_->parent_ = front_->parent_;
-            front_ = front_->child_;
-        } else if( length_ == 1 ) {
-            back_ = bound_;
-            front_ = bound_;
-        }
-
-        length_ -= 1;
-
-        oldTop->child_ = oldTop; // added in case Jlist nodes hang around after this
-        oldTop->parent_ = oldTop;
-
+        JListNode *oldTop = PopCell();
         t = oldTop->node_;
+        JListPool::Delete(oldTop);
     }
 }
 
@@ -159,21 +229,9 @@ void JList::JListPop( std::shared_ptr<Edge> &e )
         // Jlist is empty
         e->dist_ = -1;
     } else {
-        std::shared_ptr<JListNode> oldTop = front_;
-        if( length_ > 1 ) {
-            front_->child_->parent_ = front_->parent_;
-            front_ = front_->child_;
-        } else if( length_ == 1 ) {
-            back_ = bound_;
-            front_ = bound_;
-        }
-
-        length_ -= 1;
-
-        oldTop->child_ = oldTop; // added in case Jlist nodes hang around after this
-        oldTop->parent_ = oldTop;
-
+        JListNode *oldTop = PopCell();
         e = oldTop->edge_;
+        JListPool::Delete(oldTop);
     }
 }
 
@@ -185,22 +243,10 @@ void JList::JListPopKey( std::shared_ptr<KDTreeNode> &n,
         n = std::make_shared<KDTreeNode>();
         *k = -1.0;
     } else {
-        std::shared_ptr<JListNode> oldTop = front_;
-        if( length_ > 1 ) {
-            front_->child_->parent_ = front_->parent_;
-            front_ = front_->child_;
-        } else if( length_ == 1 ) {
-            back_ = bound_;
-            front_ = bound_;
-        }
-
-        length_ -= 1;
-
-        oldTop->child_ = oldTop;
-        oldTop->parent_ = oldTop;
-
+        JListNode *oldTop = PopCell();
         n = oldTop->node_;
         *k = oldTop->key_;
+        JListPool::Delete(oldTop);
     }
 }
 
@@ -211,31 +257,19 @@ void JList::JListPopKey(std::shared_ptr<Edge> &e, std::shared_ptr<double> k)
         e->dist_ = -1;
         *k = -1.0;
     } else {
-        std::shared_ptr<JListNode> oldTop = front_;
-        if( length_ > 1 ) {
-            front_->child_->parent_ = front_->parent_;
-            front_ = front_->child_;
-        } else if( length_ == 1 ) {
-            back_ = bound_;
-            front_ = bound_;
-        }
-
-        length_ -= 1;
-
-        oldTop->child_ = oldTop;
-        oldTop->parent_ = oldTop;
-
+        JListNode *oldTop = PopCell();
         e = oldTop->edge_;
         *k = oldTop->key_;
+        JListPool::Delete(oldTop);
     }
 }
 
-// Removes node_ from the list
-bool JList::JListRemove(std::shared_ptr<JListNode> &node )
+// Removes node_ from the list, returns false if it is not in this list
+bool JList::JListRemove(JListNode *node )
 {
-    if( length_ == 0 ) {
+    if( node == NULL || node->list_ != this ) {
         // Node not in Jlist
-        return true;
+        return false;
     }
 
     if( front_ == node ) {
@@ -245,8 +279,8 @@ bool JList::JListRemove(std::shared_ptr<JListNode> &node )
         back_ = node->parent_;
     }
 
-    std::shared_ptr<JListNode> nextNode = node->child_;
-    std::shared_ptr<JListNode> previousNode = node->parent_;
+    JListNode *nextNode = node->child_;
+    JListNode *previousNode = node->parent_;
 
     if( length_ > 1 && previousNode != previousNode->child_ ) {
         previousNode->child_ = nextNode;
@@ -262,8 +296,7 @@ bool JList::JListRemove(std::shared_ptr<JListNode> &node )
         front_ = bound_; // dummy node_
     }
 
-    node->parent_ = node;
-    node->child_ = node;
+    JListPool::Delete(node);
 
     return true;
 }
@@ -272,7 +305,7 @@ void JList::JListPrint()
 {
     if( this->length_ == 0 ) std::cout << "NOTHING";
     std::cout << std::endl;
-    std::shared_ptr<JListNode> ptr = front_;
+    JListNode *ptr = front_;
     int i = 1;
     while( ptr != ptr->child_ ) {
         if( use_nodes_ ) {
@@ -293,7 +326,7 @@ void JList::JListPrint()
 Eigen::Matrix<double,Eigen::Dynamic,2> JList::JListAsMatrix()
 {
     Eigen::Matrix<double,Eigen::Dynamic,2> matrix(length_,2);
-    std::shared_ptr<JListNode> ptr = front_;
+    JListNode *ptr = front_;
     int row_count = 0;
     while( ptr != ptr->child_ ) {
         matrix.row(row_count) = ptr->node_->position_.head(2);
@@ -305,10 +338,7 @@ Eigen::Matrix<double,Eigen::Dynamic,2> JList::JListAsMatrix()
 
 void JList::JListEmpty()
 {
-    std::shared_ptr<KDTreeNode> temp
-            = std::make_shared<KDTreeNode>();
-    JListPop(temp);
-    while( temp->dist_ != -1.0 ) JListPop(temp);
+    while( length_ > 0 ) JListPool::Delete(PopCell());
 }
 
 /* Test case
@@ -8,8 +8,32 @@
 #define KDTREE_CPP
 
 #include <DRRT/kdtree.h>
+#include <algorithm>
 #include <iostream>
 
+// Each thread searches with its own scratch so queries can run in parallel
+static KDQueryScratch& ThreadScratch()
+{
+    static thread_local KDQueryScratch scratch;
+    return scratch;
+}
+
+KDTree::~KDTree()
+{
+    // Parents own their kd children, so dropping the root would free a
+    // deep tree one recursive call per level. Unlink it level by level
+    if( !this->root ) return;
+    std::vector<std::shared_ptr<KDTreeNode>> nodes(1, this->root);
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        KDTreeNode *node = nodes[i].get();
+        if( node->kd_child_L_ ) nodes.push_back(std::move(node->kd_child_L_));
+        if( node->kd_child_R_ ) nodes.push_back(std::move(node->kd_child_R_));
+        node->kd_child_L_exist_ = false;
+        node->kd_child_R_exist_ = false;
+        node->kd_parent_ = NULL;
+    }
+}
+
 void KDTree::AddVizNode(std::shared_ptr<KDTreeNode> node)
 {
     // This lock_guard causes a hang up because it is waiting for the mutex
@@ -28,9 +52,141 @@ void KDTree::RemoveVizNode(std::shared_ptr<KDTreeNode> &node)
                 this->nodes_.end());
 }
 
+std::vector<std::shared_ptr<KDTreeNode>> KDTree::CollectNodes()
+{
+    std::vector<std::shared_ptr<KDTreeNode>> nodes;
+    if( this->storage_ ) {
+        // Skip the nodes that were removed
+        for( int i = 0; i < this->num_indices_; i++ ) {
+            if( Handle(i) ) nodes.push_back(Handle(i));
+        }
+    } else if( this->tree_size_ > 0 ) {
+        std::vector<std::shared_ptr<KDTreeNode>> stack;
+        stack.push_back(this->root);
+        while( !stack.empty() ) {
+            std::shared_ptr<KDTreeNode> node = stack.back();
+            stack.pop_back();
+            if( node->kd_child_R_exist_ ) stack.push_back(node->kd_child_R_);
+            if( node->kd_child_L_exist_ ) stack.push_back(node->kd_child_L_);
+            nodes.push_back(node);
+        }
+    }
+    return nodes;
+}
+
+std::vector<std::shared_ptr<KDTreeNode>> KDTree::KDNodes()
+{
+    std::shared_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    return CollectNodes();
+}
+
+std::vector<std::shared_ptr<KDTreeNode>> KDTree::TakeNodes()
+{
+    std::vector<std::shared_ptr<KDTreeNode>> nodes = CollectNodes();
+    this->storage_.reset();
+    this->num_indices_ = (int)nodes.size();
+
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        nodes[i]->kd_parent_exist_ = false;
+        nodes[i]->kd_child_L_exist_ = false;
+        nodes[i]->kd_child_R_exist_ = false;
+        nodes[i]->kd_parent_ = NULL;
+        nodes[i]->kd_child_L_.reset();
+        nodes[i]->kd_child_R_.reset();
+        nodes[i]->kd_index_ = -1;
+    }
+    return nodes;
+}
+
+void KDTree::UseFlatStorage(int reserve)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    std::vector<std::shared_ptr<KDTreeNode>> nodes = TakeNodes();
+
+    // Move the nodes already in the tree over, parents before children
+    this->storage_ = std::make_shared<FlatKDTree>(this->dimensions_);
+    this->storage_->SetDistanceFunction(this->distanceFunction);
+    FillStorage(nodes, reserve);
+}
+
+void KDTree::UseDubinsStorage(int reserve)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    if( this->dimensions_ != 3 ) {
+        std::cout << "ERROR: Dubin's storage needs a [x,y,theta] space"
+                  << std::endl;
+        return;
+    }
+    std::vector<std::shared_ptr<KDTreeNode>> nodes = TakeNodes();
+
+    // Move the nodes already in the tree over, parents before children
+    this->storage_ = std::make_shared<DubinsKDTree>();
+    FillStorage(nodes, reserve);
+}
+
+void KDTree::UseBucketStorage(int reserve)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    if( this->dimensions_ != 3 ) {
+        std::cout << "ERROR: Dubin's storage needs a [x,y,theta] space"
+                  << std::endl;
+        return;
+    }
+    std::vector<std::shared_ptr<KDTreeNode>> nodes = TakeNodes();
+
+    // Move the nodes already in the tree over (leaves have no kd_split_)
+    this->storage_ = std::make_shared<DubinsBucketKDTree>();
+    FillStorage(nodes, reserve);
+}
+
+void KDTree::UseGridStorage(double cell_size, int theta_bins, int reserve)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    if( this->dimensions_ != 3 || cell_size <= 0.0 ) {
+        std::cout << "ERROR: grid storage needs a [x,y,theta] space and "
+                  << "a positive cell size" << std::endl;
+        return;
+    }
+    std::vector<std::shared_ptr<KDTreeNode>> nodes = TakeNodes();
+
+    this->storage_ = std::make_shared<HashGrid>(cell_size, theta_bins);
+    FillStorage(nodes, reserve);
+}
+
+void KDTree::UsePositionIndex(double cell_size)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    if( cell_size <= 0.0 ) {
+        std::cout << "ERROR: position index needs a positive cell size"
+                  << std::endl;
+        return;
+    }
+    this->position_index_ = std::make_shared<PositionIndex>(
+                this->dimensions_, cell_size, this->wraps_, this->wrap_points_);
+    std::vector<std::shared_ptr<KDTreeNode>> nodes = CollectNodes();
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        this->position_index_->Insert(nodes[i]);
+    }
+}
+
+void KDTree::FillStorage(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                         int reserve)
+{
+    this->storage_->Reserve(std::max(reserve, (int)nodes.size()));
+    this->storage_->BulkInsert(nodes);
+}
+
 void KDTree::PrintTree(std::shared_ptr<KDTreeNode> node,
                        int indent, char type)
 {
+    if( this->storage_ ) {
+        // Rebalancing may have moved the first node away from the top
+        int index = node->kd_index_;
+        if( node == this->root ) index = -1;
+        this->storage_->PrintTree(index, indent, type);
+        return;
+    }
+
     if(indent) std::cout << std::string(indent-1,' ') << type;
     std::cout << node->position_(0) << ","
               << node->position_(1) << ": "
@@ -56,6 +212,20 @@ void KDTree::PrintTree(std::shared_ptr<KDTreeNode> node,
 void KDTree::GetNodeAt(Eigen::VectorXd pos,
                        std::shared_ptr<KDTreeNode>& node)
 {
+    std::shared_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    if( this->position_index_ ) {
+        std::shared_ptr<KDTreeNode> found = this->position_index_->Find(pos);
+        if( !found ) std::cout << "no node at position" << std::endl;
+        else node = found;
+        return;
+    }
+    if( this->storage_ ) {
+        int index = this->storage_->FindExact(pos);
+        if( index == -1 ) std::cout << "no node at position" << std::endl;
+        else node = Handle(index);
+        return;
+    }
+
     std::shared_ptr<KDTreeNode> parent = this->root;
     node = parent;
     while( true ) {
@@ -84,13 +254,49 @@ void KDTree::GetNodeAt(Eigen::VectorXd pos,
     }
 }
 
+bool KDTree::KDHasNodeWithin(const Eigen::VectorXd &pos, double radius)
+{
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+        if( this->tree_size_ == 0 ) return false;
+        if( this->position_index_
+                && radius <= this->position_index_->cell_size_ ) {
+            return this->position_index_->FindWithin(pos, radius,
+                                                     this->distanceFunction);
+        }
+    }
+
+    // Without a (fine enough) index, ask the tree
+    std::shared_ptr<KDTreeNode> nearest;
+    std::shared_ptr<double> dist = std::make_shared<double>(INF);
+    KDFindNearest(nearest, dist, pos);
+    return *dist < radius;
+}
+
 bool KDTree::KDInsert(std::shared_ptr<KDTreeNode>& node)
 {
+    std::unique_lock<std::shared_timed_mutex> lock(this->query_mutex_);
     if( node->kd_in_tree_ ) return false;
+    if( this->position_index_ ) {
+        if( this->position_index_->Find(node->position_) ) return false;
+        this->position_index_->Insert(node);
+    }
     node->kd_in_tree_ = true;
     // Add node to visualizer
     AddVizNode(node);
 
+    if( this->storage_ ) {
+        if( this->tree_size_ == 0 ) this->root = node;
+        this->storage_->Insert(node);
+        this->tree_size_ += 1;
+        this->num_indices_ += 1;
+        return true;
+    }
+
+    // Index used to mark this node in query scratch
+    node->kd_index_ = this->num_indices_;
+    this->num_indices_ += 1;
+
     if( this->tree_size_ == 0 ) {
         this->root = node;
         this->root->kd_split_ = 0;
@@ -98,6 +304,124 @@ bool KDTree::KDInsert(std::shared_ptr<KDTreeNode>& node)
         return true;
     }
 
+    KDLink(node);
+    this->tree_size_ += 1;
+    return true;
+}
+
+int KDTree::KDBulkBuild(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                        bool parallel, bool visualize)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    std::vector<std::shared_ptr<KDTreeNode>> added;
+    added.reserve(nodes.size());
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        if( nodes[i]->kd_in_tree_ ) continue;
+        if( this->position_index_ ) {
+            if( this->position_index_->Find(nodes[i]->position_) ) continue;
+            this->position_index_->Insert(nodes[i]);
+        }
+        nodes[i]->kd_in_tree_ = true;
+        if( visualize ) AddVizNode(nodes[i]);
+        added.push_back(nodes[i]);
+    }
+    if( added.empty() ) return 0;
+    const int count = (int)added.size();
+
+    if( this->storage_ ) {
+        if( this->tree_size_ == 0 ) this->root = added[0];
+        this->storage_->BulkInsert(added, parallel);
+        this->tree_size_ += count;
+        this->num_indices_ += count;
+        return count;
+    }
+
+    // Unlink everything below the root and build it up again with the
+    // new nodes, the root has to stay on top since it is the planner's
+    for( int i = 0; i < count; i++ ) {
+        added[i]->kd_index_ = this->num_indices_ + i;
+    }
+    this->num_indices_ += count;
+    std::vector<std::shared_ptr<KDTreeNode>> all;
+    if( this->tree_size_ == 0 ) {
+        this->root = added[0];
+        all.swap(added);
+    } else {
+        all = CollectNodes();
+        all.insert(all.end(), added.begin(), added.end());
+    }
+    this->tree_size_ += count;
+    for( int i = 0; i < (int)all.size(); i++ ) {
+        all[i]->kd_parent_exist_ = false;
+        all[i]->kd_child_L_exist_ = false;
+        all[i]->kd_child_R_exist_ = false;
+        all[i]->kd_parent_ = NULL;
+        all[i]->kd_child_L_.reset();
+        all[i]->kd_child_R_.reset();
+    }
+
+    // The root splits the others along their largest spread, each
+    // side is then built balanced below it (all[0] is the root)
+    std::vector<int> order(all.size() - 1);
+    for( int i = 0; i < (int)order.size(); i++ ) order[i] = i + 1;
+    this->root->kd_split_ = SplitDimension(all, order, 0, (int)order.size());
+    const int split = this->root->kd_split_;
+    const double value = this->root->position_(split);
+    int middle = std::partition(order.begin(), order.end(),
+                                [&all, split, value](int i)
+                                { return all[i]->position_(split) < value; })
+                 - order.begin();
+    LinkBalanced(all, order, 0, middle, this->root, true);
+    LinkBalanced(all, order, middle, (int)order.size(), this->root, false);
+    return count;
+}
+
+int KDTree::SplitDimension(const std::vector<std::shared_ptr<KDTreeNode>>
+                           &nodes, const std::vector<int> &order,
+                           int lo, int hi) const
+{
+    int split = 0;
+    double spread = -1.0;
+    for( int j = 0; j < this->dimensions_; j++ ) {
+        double low = INF, high = -INF;
+        for( int i = lo; i < hi; i++ ) {
+            low = std::min(low, nodes[order[i]]->position_(j));
+            high = std::max(high, nodes[order[i]]->position_(j));
+        }
+        if( high - low > spread ) {
+            spread = high - low;
+            split = j;
+        }
+    }
+    return split;
+}
+
+void KDTree::LinkBalanced(std::vector<std::shared_ptr<KDTreeNode>> &nodes,
+                          std::vector<int> &order, int lo, int hi,
+                          std::shared_ptr<KDTreeNode> parent, bool left)
+{
+    if( lo >= hi ) return;
+    int split = SplitDimension(nodes, order, lo, hi);
+    int m = MedianSplit(order, lo, hi, [&nodes, split](int i)
+                        { return nodes[i]->position_(split); });
+
+    std::shared_ptr<KDTreeNode> &node = nodes[order[m]];
+    node->kd_split_ = split;
+    node->kd_parent_ = parent.get();
+    node->kd_parent_exist_ = true;
+    if( left ) {
+        parent->kd_child_L_ = node;
+        parent->kd_child_L_exist_ = true;
+    } else {
+        parent->kd_child_R_ = node;
+        parent->kd_child_R_exist_ = true;
+    }
+    LinkBalanced(nodes, order, lo, m, node, true);
+    LinkBalanced(nodes, order, m + 1, hi, node, false);
+}
+
+void KDTree::KDLink(std::shared_ptr<KDTreeNode> &node)
+{
     // Figure out where to put this node
     std::shared_ptr<KDTreeNode> parent = this->root;
     while( true ) {
@@ -126,15 +450,118 @@ bool KDTree::KDInsert(std::shared_ptr<KDTreeNode>& node)
         }
     }
 
-    node->kd_parent_ = parent;
+    node->kd_parent_ = parent.get();
     node->kd_parent_exist_ = true;
     if( parent->kd_split_ == this->dimensions_-1 ) { node->kd_split_ = 0; }
     else { node->kd_split_ = parent->kd_split_ + 1; }
+}
 
-    this->tree_size_ += 1;
+bool KDTree::KDRemove(std::shared_ptr<KDTreeNode> &node)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    if( !KDDetach(node) ) return false;
+    RemoveVizNode(node);
     return true;
 }
 
+int KDTree::KDRemove(std::vector<std::shared_ptr<KDTreeNode>> &nodes)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    int removed = 0;
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        if( KDDetach(nodes[i]) ) removed++;
+    }
+
+    // Drop them from the visualizer in one pass
+    this->nodes_.erase(
+                std::remove_if(this->nodes_.begin(), this->nodes_.end(),
+                               [](const std::shared_ptr<KDTreeNode> &n)
+                               { return !n->kd_in_tree_; }),
+                this->nodes_.end());
+    return removed;
+}
+
+bool KDTree::KDDetach(std::shared_ptr<KDTreeNode> &node)
+{
+    if( !node->kd_in_tree_ ) return false;
+    if( node == this->root ) {
+        std::cout << "ERROR: can not remove the root of the KDTree"
+                  << std::endl;
+        return false;
+    }
+
+    if( this->position_index_ ) this->position_index_->Remove(node);
+    if( this->storage_ ) {
+        this->storage_->Remove(node->kd_index_);
+    } else {
+        // Cut the node's subtree off, parents come before children
+        KDTreeNode *parent = node->kd_parent_;
+        if( parent->kd_child_L_exist_ && parent->kd_child_L_ == node ) {
+            parent->kd_child_L_.reset();
+            parent->kd_child_L_exist_ = false;
+        } else {
+            parent->kd_child_R_.reset();
+            parent->kd_child_R_exist_ = false;
+        }
+        std::vector<std::shared_ptr<KDTreeNode>> subtree(1, node);
+        for( int i = 0; i < (int)subtree.size(); i++ ) {
+            std::shared_ptr<KDTreeNode> n = subtree[i];
+            if( n->kd_child_L_exist_ ) subtree.push_back(n->kd_child_L_);
+            if( n->kd_child_R_exist_ ) subtree.push_back(n->kd_child_R_);
+            n->kd_parent_exist_ = false;
+            n->kd_child_L_exist_ = false;
+            n->kd_child_R_exist_ = false;
+            n->kd_parent_ = NULL;
+            n->kd_child_L_.reset();
+            n->kd_child_R_.reset();
+        }
+
+        // And link everything below the node back in
+        for( int i = 1; i < (int)subtree.size(); i++ ) KDLink(subtree[i]);
+    }
+
+    node->kd_in_tree_ = false;
+    node->kd_index_ = -1;
+    this->tree_size_ -= 1;
+    return true;
+}
+
+void KDTree::KDCompact(bool relayout)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    if( this->storage_ ) {
+        this->storage_->Compact(relayout);
+    } else {
+        // The pointer tree has no gaps, only the indices need compacting
+        std::vector<std::shared_ptr<KDTreeNode>> nodes = CollectNodes();
+        if( relayout ) {
+            std::vector<unsigned long long> keys = NNStorage::MortonKeys(nodes);
+            for( int i = 0; i < (int)nodes.size(); i++ ) {
+                nodes[i]->kd_index_ = i;
+            }
+            std::stable_sort(nodes.begin(), nodes.end(),
+                             [&keys](const std::shared_ptr<KDTreeNode> &a,
+                                     const std::shared_ptr<KDTreeNode> &b)
+                             { return keys[a->kd_index_] < keys[b->kd_index_]; });
+        }
+        for( int i = 0; i < (int)nodes.size(); i++ ) nodes[i]->kd_index_ = i;
+    }
+    this->num_indices_ = this->tree_size_;
+
+    if( relayout ) {
+        // Keep the visualizer's list in the same order as the storage
+        std::sort(this->nodes_.begin(), this->nodes_.end(),
+                  [](const std::shared_ptr<KDTreeNode> &a,
+                     const std::shared_ptr<KDTreeNode> &b)
+                  { return a->kd_index_ < b->kd_index_; });
+    }
+}
+
+double KDTree::KDApproxError() const
+{
+    return ThreadScratch().error_;
+}
+
 /////////////////////// Nearest ///////////////////////
 
 bool KDTree::KDFindNearestInSubtree(std::shared_ptr<KDTreeNode>& nearestNode,
@@ -196,7 +623,7 @@ bool KDTree::KDFindNearestInSubtree(std::shared_ptr<KDTreeNode>& nearestNode,
                 return true;
             }
 
-            parent = parent->kd_parent_;
+            parent = parent->kd_parent_->GetPointer();
             continue;
         }
 
@@ -257,14 +684,40 @@ bool KDTree::KDFindNearestInSubtree(std::shared_ptr<KDTreeNode>& nearestNode,
             *nearestNodeDist = *currentClosestDist;
             return true;
         }
-        parent = parent->kd_parent_;
+        parent = parent->kd_parent_->GetPointer();
     }
 }
 
 bool KDTree::KDFindNearest(std::shared_ptr<KDTreeNode>& nearestNode,
                            std::shared_ptr<double> nearestNodeDist,
-                           Eigen::VectorXd queryPoint)
+                           Eigen::VectorXd queryPoint,
+                           bool approximate)
 {
+    std::shared_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    KDQueryScratch &scratch = ThreadScratch();
+    if( approximate ) {
+        scratch.Approximate(this->approx_epsilon_, this->approx_budget_);
+    } else {
+        scratch.Approximate(0.0, 0);
+    }
+
+    if( this->storage_ ) {
+        int nearest = -1;
+        double nearestDist = INF;
+        StorageFindNearest(queryPoint, nearest, nearestDist, scratch);
+        if( nearest == -1 && approximate ) {
+            // The budget ran out before a live node was found
+            scratch.Approximate(0.0, 0);
+            StorageFindNearest(queryPoint, nearest, nearestDist, scratch);
+        }
+        if( nearest == -1 ) return false;  // no live nodes in the tree
+
+        nearestNode = Handle(nearest);
+        *nearestNodeDist = nearestDist;
+        scratch.Finish(nearestDist);
+        return true;
+    }
+
     // Initial search (only search if the space does not wrap around)
     double distToRoot = this->distanceFunction(queryPoint,
                                                this->root->position_);
@@ -303,9 +756,29 @@ bool KDTree::KDFindNearest(std::shared_ptr<KDTreeNode>& nearestNode,
     }
     nearestNode = Lnode;
     *nearestNodeDist = *Ldist;
+    scratch.Finish(*Ldist);
     return true;
 }
 
+void KDTree::StorageFindNearest(const Eigen::VectorXd &queryPoint,
+                                int &nearest, double &nearestDist,
+                                KDQueryScratch &scratch)
+{
+    this->storage_->FindNearest(queryPoint, nearest, nearestDist, scratch);
+    if( !SearchGhosts() ) return;
+
+    // If dimensions wrap around, we need to search vs. identities
+    std::shared_ptr<GhostPointIterator> pointIterator
+            = std::make_shared<GhostPointIterator>(this, queryPoint);
+    Eigen::VectorXd thisGhostPoint;
+    while( true ) {
+        thisGhostPoint = GetNextGhostPoint(pointIterator, nearestDist);
+        if( thisGhostPoint.isZero(0) ) break;
+        this->storage_->FindNearest(thisGhostPoint, nearest, nearestDist,
+                                    scratch);
+    }
+}
+
 bool KDTree::KDFindNearestinSubtreeWithGuess(std::shared_ptr<KDTreeNode>
                                                             nearestNode,
                                              std::shared_ptr<double>
@@ -366,7 +839,7 @@ bool KDTree::KDFindNearestinSubtreeWithGuess(std::shared_ptr<KDTreeNode>
                 return true;
             }
 
-            parent = parent->kd_parent_;
+            parent = parent->kd_parent_->GetPointer();
             continue;
         }
 
@@ -435,7 +908,7 @@ bool KDTree::KDFindNearestinSubtreeWithGuess(std::shared_ptr<KDTreeNode>
             return true;
         }
 
-        parent = parent->kd_parent_;
+        parent = parent->kd_parent_->GetPointer();
     }
 }
 
@@ -444,6 +917,12 @@ bool KDTree::KDFindNearestWithGuess(std::shared_ptr<KDTreeNode> nearestNode,
                                     Eigen::VectorXd queryPoint,
                                     std::shared_ptr<KDTreeNode> guess )
 {
+    // The storages do not walk parent links, so a guess does not help
+    if( this->storage_ ) {
+        return KDFindNearest(nearestNode, nearestNodeDist, queryPoint);
+    }
+    std::shared_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+
     double distToGuess = this->distanceFunction(queryPoint, guess->position_);
     if( guess == this->root ) {
         KDFindNearestInSubtree( nearestNode, nearestNodeDist, this->root,
@@ -490,203 +969,146 @@ bool KDTree::KDFindNearestWithGuess(std::shared_ptr<KDTreeNode> nearestNode,
 }
 
 /////////////////////// K Nearest ///////////////////////
-std::shared_ptr<KDTreeNode> KDTree::AddToKNNHeap(std::shared_ptr<BinaryHeap> H,
-                                              std::shared_ptr<KDTreeNode> node,
-                                                 double key,
-                                                 int k)
-{
-    std::vector<std::shared_ptr<KDTreeNode>> heap;
-    H->GetHeap(heap);
-    std::shared_ptr<KDTreeNode> top = std::make_shared<KDTreeNode>();
-    if( node->in_heap_ ) {
-        H->TopHeapB(top);
-        if( top->dist_ == -1 ) {
-            std::cout << "Heap node has no reference tree node!" << std::endl;
-        }
-        return top;
-    } else if( *H->GetIndexOfLast() < k ) {
-        // Just insert
-        node->dist_ = key;
-        H->AddToHeapB(node);
-    } else if( heap[1]->dist_ > key ) {
-        H->PopHeapB(top);
-        node->dist_ = key;
-        H->AddToHeapB(node);
-    }
-    H->TopHeapB(top);
-    if( top->dist_ == -1 ) {
-        std::cout << "Heap node has no reference tree node!" << std::endl;
-    }
-    return top;
-}
-
-bool KDTree::KDFindKNearestInSubtree(std::shared_ptr<KDTreeNode> farthestNode,
-                                     std::shared_ptr<double> farthestNodeDist,
-                                     std::shared_ptr<KDTreeNode> root,
-                                     int k,
-                                     Eigen::VectorXd queryPoint,
-                                     std::shared_ptr<BinaryHeap> nearestHeap)
+double KDTree::AddToKNNHeap(KDQueryScratch &scratch,
+                            std::shared_ptr<KDTreeNode> &node,
+                            double key, int k)
 {
-    // Walk down the tree as if the node would be inserted
-    std::shared_ptr<KDTreeNode> parent = root;
-    std::shared_ptr<KDTreeNode> currentWorstClosestNode;
-    nearestHeap->TopHeapB(currentWorstClosestNode);
-    std::shared_ptr<double> currentWorstClosestDist
-            = std::make_shared<double>(currentWorstClosestNode->dist_);
-    while( true ) {
-        if( queryPoint(parent->kd_split_) < parent->position_(parent->kd_split_) ) {
-            // Traverse the tree to the left
-            if( !parent->kd_child_L_exist_ ) {
-                // The queryPoint would be inserted as the left child of the parent
-                break;
-            }
-            parent = parent->kd_child_L_;
-            continue;
-        } else {
-            // Traverse the tree to the right
-            if( !parent->kd_child_R_exist_ ) {
-                // The queryPoint would be inserted as the right child of the parent
-                break;
-            }
-            parent = parent->kd_child_R_;
-            continue;
-        }
-    }
-
-    double newDist = this->distanceFunction( queryPoint, parent->position_);
-    if( newDist < *currentWorstClosestDist ) {
-        currentWorstClosestNode = AddToKNNHeap(nearestHeap, parent,
-                                               newDist, k);
-        *currentWorstClosestDist = currentWorstClosestNode->dist_;
+    if( scratch.OfferKNN(key, node->kd_index_, k) ) {
+        scratch.found_.push_back(node);
     }
+    return scratch.WorstKNN(k);
+}
 
-    // Now walk back up the tree (will break out when done)
-    while( true ) {
-        // Now check if there could possibly be any closer nodes on the other
-        // side of the parent (and the parent itself is also too far away)
+void KDTree::KDFindKNearestInSubtree(std::shared_ptr<KDTreeNode> &root,
+                                     int k,
+                                     Eigen::VectorXd &queryPoint,
+                                     KDQueryScratch &scratch)
+{
+    double worstDist = scratch.WorstKNN(k);
 
-        double parentHyperPlaneDist
-                = queryPoint(parent->kd_split_)
-                - parent->position_(parent->kd_split_);
+    double newDist = this->distanceFunction(queryPoint, root->position_);
+    if( newDist < worstDist ) {
+        worstDist = AddToKNNHeap(scratch, root, newDist, k);
+    }
 
-        if( parentHyperPlaneDist > *currentWorstClosestDist ) {
-            // Then there could not be any closer nodes on the other side
-            // of the parent (and the parent itself is also too far away)
-            if( parent == root ) {
-                // The parent is te root and we are done
-                *farthestNode = *currentWorstClosestNode;
-                *farthestNodeDist = *currentWorstClosestDist;
-                return true;
-            }
-            parent = parent->kd_parent_;
-            continue;
+    // Search the side of root that queryPoint is on first, then the
+    // other side if the hyperplane is closer than the worst node in the heap
+    double hyperPlaneDist = queryPoint(root->kd_split_)
+                            - root->position_(root->kd_split_);
+    if( hyperPlaneDist < 0 ) {
+        if( root->kd_child_L_exist_ ) {
+            KDFindKNearestInSubtree(root->kd_child_L_, k, queryPoint, scratch);
         }
-
-        // If we are here, then there could be a closer node on the other side
-        // of the parent (including the parent itself)
-
-        // First check the parent itself (if it is not already one of
-        // the closest nodes)
-        if( !parent->in_heap_ ) {
-            newDist = this->distanceFunction(queryPoint, parent->position_);
-            if( newDist < *currentWorstClosestDist ) {
-                currentWorstClosestNode = AddToKNNHeap( nearestHeap, parent,
-                                                        newDist, k );
-                *currentWorstClosestDist = currentWorstClosestNode->dist_;
-            }
+        if( root->kd_child_R_exist_ && -hyperPlaneDist <= scratch.WorstKNN(k) ) {
+            KDFindKNearestInSubtree(root->kd_child_R_, k, queryPoint, scratch);
         }
-
-        // Now check the other side of the parent
-        if( queryPoint(parent->kd_split_)
-                < parent->position_(parent->kd_split_) && parent->kd_child_R_exist_ ) {
-            // queryPoint is on the left side of the parent, so we need to look
-            // at the right side of it (if it exists)
-            KDFindKNearestInSubtree( currentWorstClosestNode,
-                                     currentWorstClosestDist,
-                                     parent->kd_child_R_, k, queryPoint,
-                                     nearestHeap );
-            *currentWorstClosestDist = currentWorstClosestNode->dist_;
-        } else if( parent->position_(parent->kd_split_)
-                   <= queryPoint(parent->kd_split_) && parent->kd_child_L_exist_ ) {
-            // queryPoint is on the right side of the parent, so we need to
-            // look at the left side of it (if it exists)
-            KDFindKNearestInSubtree( currentWorstClosestNode,
-                                     currentWorstClosestDist,
-                                     parent->kd_child_L_, k, queryPoint,
-                                     nearestHeap );
-            *currentWorstClosestDist = currentWorstClosestNode->dist_;
+    } else {
+        if( root->kd_child_R_exist_ ) {
+            KDFindKNearestInSubtree(root->kd_child_R_, k, queryPoint, scratch);
         }
-
-        if( parent == root ) {
-            // The parent is the root and we are done
-            *farthestNode = *currentWorstClosestNode;
-            *farthestNodeDist = *currentWorstClosestDist;
+        if( root->kd_child_L_exist_ && hyperPlaneDist <= scratch.WorstKNN(k) ) {
+            KDFindKNearestInSubtree(root->kd_child_L_, k, queryPoint, scratch);
         }
-
-        parent = parent->kd_parent_;
     }
 }
 
 std::vector<std::shared_ptr<KDTreeNode>> KDTree::KDFindKNearest(int k,
                                                 Eigen::VectorXd queryPoint)
 {
-    std::shared_ptr<BinaryHeap> Heap = std::make_shared<BinaryHeap>(true);
-    // true >> use heap functions (key not keyQ) not priority queue functions
+    KDResults result;
+    KDFindKNearest(k, queryPoint, result);
 
-    // Insert root node in heap
-    this->root->dist_ = this->distanceFunction(queryPoint, this->root->position_);
-    Heap->AddToHeapB( this->root );
+    std::vector<std::shared_ptr<KDTreeNode>> nodes;
+    nodes.reserve(result.size());
+    for( int i = 0; i < (int)result.size(); i++ ) {
+        nodes.push_back(result[i].first);
+    }
+    return nodes;
+}
+
+void KDTree::KDFindKNearest(int k, Eigen::VectorXd &queryPoint,
+                            KDResults &result)
+{
+    std::shared_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    KDQueryScratch &scratch = ThreadScratch();
+    scratch.Begin(this->num_indices_);
 
-    // Insert a dummy node in the heap with INF key
-    std::shared_ptr<KDTreeNode> dummyNode
-            = std::make_shared<KDTreeNode>((double)INF);
-    Heap->AddToHeapB( dummyNode );
+    result.clear();
+    if( this->tree_size_ == 0 || k <= 0 ) return;
 
     // Find k nearest neighbors
-    std::shared_ptr<KDTreeNode> farthestNearestNode
-            = std::make_shared<KDTreeNode>();
-    std::shared_ptr<double> farthestNearestNodeDist
-            = std::make_shared<double>(0);
-    KDFindKNearestInSubtree( farthestNearestNode, farthestNearestNodeDist,
-                             this->root, k,
-                             queryPoint, Heap );
+    if( this->storage_ ) {
+        this->storage_->FindKNearest(queryPoint, k, scratch);
+    } else {
+        KDFindKNearestInSubtree(this->root, k, queryPoint, scratch);
+    }
 
-    if( this->num_wraps_ > 0 ) {
-        std::cout << "ERROR: knn search not implemented for wrapped space"
-                  << std::endl;
+    if( SearchGhosts() ) {
+        // If dimensions wrap around, need to search vs. identities (ghosts)
+        // that are closer than the worst node found so far
+        GhostPointIterator pointIterator(this, queryPoint);
+        Eigen::VectorXd thisGhostPoint;
+        while( true ) {
+            thisGhostPoint = GetNextGhostPoint(pointIterator,
+                                               scratch.WorstKNN(k));
+            if( thisGhostPoint.isZero(0) ) break;
+
+            if( this->storage_ ) {
+                this->storage_->FindKNearest(thisGhostPoint, k, scratch);
+            } else {
+                KDFindKNearestInSubtree(this->root, k, thisGhostPoint, scratch);
+            }
+        }
     }
 
-    // Remove the dummy node if still there (guarenteed to be on top, due to INF key)
-    std::shared_ptr<KDTreeNode> topNode = std::make_shared<KDTreeNode>();
-    Heap->TopHeapB(topNode);
-    if( topNode == dummyNode ) Heap->PopHeapB(topNode);
-    std::vector<std::shared_ptr<KDTreeNode>> dHeap;
-    Heap->CleanHeapB(dHeap);
-    return dHeap;
+    // The heap pops the furthest node first, fill result from the back
+    int first = (int)result.size();
+    result.resize(first + scratch.heap_.Size());
+    for( int i = (int)result.size() - 1; i >= first; i-- ) {
+        HeapEntry entry = scratch.heap_.Pop();
+        result[i].second = entry.key_;
+        if( this->storage_ ) {
+            result[i].first = Handle(entry.id_);
+            continue;
+        }
+        // The pointer tree's node is the last one added with this index
+        for( int j = (int)scratch.found_.size() - 1; j >= 0; j-- ) {
+            if( scratch.found_[j]->kd_index_ == entry.id_ ) {
+                result[i].first = scratch.found_[j];
+                break;
+            }
+        }
+    }
 }
 
 /////////////////////// Within Range ///////////////////////
 
 bool KDTree::AddToRangeList(std::shared_ptr<JList> &S,
                             std::shared_ptr<KDTreeNode> &node,
-                            double key)
+                            double key, KDQueryScratch &scratch)
 {
-    // "in_heap_" is a misnomer because this is a list
-    if( node->in_heap_ ) {
+    if( !scratch.Mark(node->kd_index_) ) {
         // Node already in list
         return false;
     }
-    node->in_heap_ = true;
     S->JListPush( node, key );
     return true;
 }
 
+bool KDTree::AddToRangeList(KDResults &result,
+                            std::shared_ptr<KDTreeNode> &node,
+                            double key, KDQueryScratch &scratch)
+{
+    if( !scratch.Mark(node->kd_index_) ) return false;
+    result.push_back(std::make_pair(node, key));
+    return true;
+}
+
 void KDTree::PopFromRangeList(std::shared_ptr<JList> &S,
                               std::shared_ptr<KDTreeNode> &t,
                               std::shared_ptr<double> k)
 {
     S->JListPopKey(t,k);
-    t->in_heap_ = false;
 }
 
 void KDTree::EmptyRangeList(std::shared_ptr<JList>& S)
@@ -695,15 +1117,16 @@ void KDTree::EmptyRangeList(std::shared_ptr<JList>& S)
     std::shared_ptr<double> k = std::make_shared<double>(0);
     while( S->length_ > 0 ) {
         S->JListPopKey( n, k );
-        n->in_heap_ = false;
     }
 
 }
 
+template <class List>
 bool KDTree::KDFindWithinRangeInSubtree(std::shared_ptr<KDTreeNode> &root,
                                         double range,
                                         Eigen::VectorXd queryPoint,
-                                        std::shared_ptr<JList> &nodeList)
+                                        List &nodeList,
+                                        KDQueryScratch &scratch)
 {
     // Walk down the tree as if the node would be inserted
     std::shared_ptr<KDTreeNode> parent = root;
@@ -731,7 +1154,7 @@ bool KDTree::KDFindWithinRangeInSubtree(std::shared_ptr<KDTreeNode> &root,
 
     double newDist = this->distanceFunction(queryPoint, parent->position_);
     if(newDist < range) {
-        AddToRangeList(nodeList, parent, newDist);
+        AddToRangeList(nodeList, parent, newDist, scratch);
     }
 
     // Now walk back up the tree (will break out when done)
@@ -751,7 +1174,7 @@ bool KDTree::KDFindWithinRangeInSubtree(std::shared_ptr<KDTreeNode> &root,
                 // The parent is the root and we are done
                 return true;
             }
-            parent = parent->kd_parent_;
+            parent = parent->kd_parent_->GetPointer();
             continue;
         }
 
@@ -760,10 +1183,10 @@ bool KDTree::KDFindWithinRangeInSubtree(std::shared_ptr<KDTreeNode> &root,
 
         // First check the parent itself (if it is not already one
         // of the closest nodes)
-        if(!parent->in_heap_) { // in_heap_ is a misnomer since this is a list
+        if(!scratch.Marked(parent->kd_index_)) {
             newDist = this->distanceFunction(queryPoint, parent->position_);
             if(newDist < range) {
-                AddToRangeList(nodeList, parent, newDist);
+                AddToRangeList(nodeList, parent, newDist, scratch);
             }
         }
 
@@ -773,13 +1196,13 @@ bool KDTree::KDFindWithinRangeInSubtree(std::shared_ptr<KDTreeNode> &root,
             // The queryPoint is on the left side of the porent, so we need to
             // look at the right side of it (if it exists)
             KDFindWithinRangeInSubtree(parent->kd_child_R_, range,
-                                       queryPoint, nodeList);
+                                       queryPoint, nodeList, scratch);
         } else if(parent->position_(parent->kd_split_)
                   <= queryPoint(parent->kd_split_) && parent->kd_child_L_exist_) {
             // The queryPoint is on the right side of the parent, so we need to
             // look at the left side of it (if it exists)
             KDFindWithinRangeInSubtree(parent->kd_child_L_, range,
-                                       queryPoint, nodeList);
+                                       queryPoint, nodeList, scratch);
         }
 
         if(parent == root) {
@@ -787,67 +1210,154 @@ bool KDTree::KDFindWithinRangeInSubtree(std::shared_ptr<KDTreeNode> &root,
             return true;
         }
 
-        parent = parent->kd_parent_;
+        parent = parent->kd_parent_->GetPointer();
     }
 }
 
-void KDTree::KDFindWithinRange(std::shared_ptr<JList> &S,
-                               double range,
-                               Eigen::VectorXd queryPoint)
+template <class List>
+void KDTree::KDFindWithinRangeInTree(List &nodeList, double range,
+                                     Eigen::VectorXd &queryPoint,
+                                     KDQueryScratch &scratch)
 {
-//    std::cout << "KDFindWithinRange" << std::endl;
     // Insert root node in list if it is within range
     double distToRoot
             = this->distanceFunction(queryPoint, this->root->position_);
-    if(distToRoot <= range) AddToRangeList(S, this->root, distToRoot);
+    if( distToRoot <= range ) {
+        AddToRangeList(nodeList, this->root, distToRoot, scratch);
+    }
 
     // Find nodes within range
-    KDFindWithinRangeInSubtree(this->root, range, queryPoint, S);
+    KDFindWithinRangeInSubtree(this->root, range, queryPoint, nodeList,
+                               scratch);
 
-    if(this->num_wraps_ > 0) {
-        // If dimensions wrap around, we need to search vs. identities (ghosts)
-        std::shared_ptr<GhostPointIterator> pointIterator
-                = std::make_shared<GhostPointIterator>(this, queryPoint);
-        while(true) {
-            Eigen::VectorXd thisGhostPoint
-                    = GetNextGhostPoint(pointIterator, range);
-            if(thisGhostPoint.isZero(0)) break;
+    if( this->num_wraps_ > 0 ) {
+        // If dimensions wrap around, need to search vs. identities (ghosts)
+        GhostPointIterator pointIterator(this, queryPoint);
+        Eigen::VectorXd thisGhostPoint;
+        while( true ) {
+            thisGhostPoint = GetNextGhostPoint( pointIterator, range );
+            if( thisGhostPoint.isZero(0) ) break;
 
             // Now see if any points in the space are closer to this ghost
-            KDFindWithinRangeInSubtree(this->root, range, thisGhostPoint, S);
+            KDFindWithinRangeInSubtree(this->root, range, thisGhostPoint,
+                                       nodeList, scratch);
         }
     }
 }
 
+void KDTree::KDFindWithinRange(std::shared_ptr<JList> &S,
+                               double range,
+                               Eigen::VectorXd queryPoint,
+                               bool approximate)
+{
+//    std::cout << "KDFindWithinRange" << std::endl;
+    KDFindWithinRange(S, range, queryPoint, ThreadScratch(), approximate);
+}
+
 void KDTree::KDFindMoreWithinRange(std::shared_ptr<JList> &L,
                                    double range, Eigen::VectorXd queryPoint)
 {
-    // Insert root node in list if it is within range
-    double distToRoot
-            = this->distanceFunction(queryPoint, this->root->position_);
-    if( distToRoot <= range ) {
-        AddToRangeList( L, this->root, distToRoot );
+    KDFindWithinRange(L, range, queryPoint, ThreadScratch());
+}
+
+void KDTree::KDFindWithinRange(std::shared_ptr<JList> &S,
+                               double range,
+                               Eigen::VectorXd queryPoint,
+                               KDQueryScratch &scratch,
+                               bool approximate)
+{
+    std::shared_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    scratch.Begin(this->num_indices_);
+    if( approximate ) {
+        scratch.Approximate(this->approx_epsilon_, this->approx_budget_);
+    }
+    if( this->tree_size_ == 0 ) return;
+
+    // Mark the nodes that are already in the list so they are not added
+    // again (e.g. when called from KDFindMoreWithinRange)
+    JListNode *item = S->front_;
+    while( item != item->child_ ) {
+        if( item->node_->kd_index_ != -1 ) scratch.Mark(item->node_->kd_index_);
+        item = item->child_;
     }
 
-    // Find nodes within range
-    KDFindWithinRangeInSubtree( this->root, range, queryPoint, L );
+    if( this->storage_ ) {
+        KDFindRangeHits(range, queryPoint, scratch);
 
-    if( this->num_wraps_ > 0 ) {
+        // AddToRangeList skips nodes that are already in the list
+        for( int i = 0; i < (int)scratch.hits_.size(); i++ ) {
+            AddToRangeList(S, Handle(scratch.hits_[i].first),
+                           scratch.hits_[i].second, scratch);
+        }
+        scratch.Finish(range);
+        return;
+    }
+
+    KDFindWithinRangeInTree(S, range, queryPoint, scratch);
+    scratch.Finish(range);
+}
+
+void KDTree::KDFindRangeHits(double range, Eigen::VectorXd &queryPoint,
+                             KDQueryScratch &scratch)
+{
+    this->storage_->FindWithinRange(queryPoint, range, scratch);
+
+    if( SearchGhosts() ) {
         // If dimensions wrap around, need to search vs. identities (ghosts)
-        std::shared_ptr<GhostPointIterator> pointIterator
-                = std::make_shared<GhostPointIterator>(this, queryPoint);
+        GhostPointIterator pointIterator(this, queryPoint);
         Eigen::VectorXd thisGhostPoint;
         while( true ) {
             thisGhostPoint = GetNextGhostPoint( pointIterator, range );
-            if( thisGhostPoint.isZero(0) ) {
-                break;
-            }
+            if( thisGhostPoint.isZero(0) ) break;
+            this->storage_->FindWithinRange(thisGhostPoint, range, scratch);
+        }
+    }
+}
 
-            // Now see if any points in the space are closer to this ghost
-            KDFindWithinRangeInSubtree( this->root, range, thisGhostPoint, L );
+void KDTree::KDFindWithinRange(double range, Eigen::VectorXd &queryPoint,
+                               KDResults &result, bool sorted,
+                               bool approximate)
+{
+    result.clear();
+    std::shared_lock<std::shared_timed_mutex> lock(this->query_mutex_);
+    KDQueryScratch &scratch = ThreadScratch();
+    scratch.Begin(this->num_indices_);
+    if( approximate ) {
+        scratch.Approximate(this->approx_epsilon_, this->approx_budget_);
+    }
+    if( this->tree_size_ == 0 ) return;
+
+    if( !this->storage_ ) {
+        // Nodes are marked as they are added, so each shows up once
+        KDFindWithinRangeInTree(result, range, queryPoint, scratch);
+        scratch.Finish(range);
+    } else {
+        KDFindRangeHits(range, queryPoint, scratch);
+
+        // A node found through several ghosts keeps its smallest distance
+        std::vector<std::pair<int,double>> &hits = scratch.hits_;
+        bool ghosts = SearchGhosts();
+        if( sorted || ghosts ) {
+            std::sort(hits.begin(), hits.end(),
+                      [](const std::pair<int,double> &a,
+                         const std::pair<int,double> &b)
+                      { return a.second < b.second; });
         }
+        for( int i = 0; i < (int)hits.size(); i++ ) {
+            if( ghosts && !scratch.Mark(hits[i].first) ) continue;
+            result.push_back(std::make_pair(Handle(hits[i].first),
+                                            hits[i].second));
+        }
+        scratch.Finish(range);
+        return;
     }
 
+    if( sorted ) {
+        std::sort(result.begin(), result.end(),
+                  [](const std::pair<std::shared_ptr<KDTreeNode>,double> &a,
+                     const std::pair<std::shared_ptr<KDTreeNode>,double> &b)
+                  { return a.second < b.second; });
+    }
 }
 
 void KDTree::KDInsert(Eigen::VectorXd a)
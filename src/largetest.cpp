@@ -28,7 +28,7 @@ void printRRTxPath(shared_ptr<KDTreeNode> &leaf)
     while(leaf->rrt_parent_used_) {
         cout << "pose: " << leaf->rrt_LMC_ << "\n" << leaf->position_ << endl;
         cout << "VVVVVVVV" << endl;
-        leaf = leaf->rrt_parent_edge_->end_node_;
+        leaf = leaf->rrt_parent_edge_->end_node_->GetPointer();
     }
     cout << leaf->position_ << endl;
 }
@@ -45,7 +45,7 @@ shared_ptr<RobotData> RRTX(Problem p, shared_ptr<thread> &vis)
 
     /// Queue
     shared_ptr<Queue> Q = make_shared<Queue>();
-    Q->priority_queue = make_shared<BinaryHeap>(false); // priority queue use Q functions
+    Q->priority_queue = make_shared<PriorityQueue>(); // nodes to be rewired
     Q->obs_successors = make_shared<JList>(true); // obstacle stack uses KDTreeNodes
     Q->change_thresh = p.change_threshold;
     Q->type = p.search_type;
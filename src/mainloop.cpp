@@ -5,6 +5,7 @@
  */
 
 #include <DRRT/mainloop.h>
+#include <DRRT/alloccount.h>
 
 using namespace std;
 
@@ -38,6 +39,15 @@ void RrtMainLoop(shared_ptr<Queue> Q, shared_ptr<KDTree> Tree,
     double iter_start/*, iter_end*/;
 
     double old_rrt_LMC, current_distance, initial_distance;
+    double approx_error = 0.0; // worst error of the approximate searches
+    long slabs_at_start;       // memory taken for the graph before an
+                               // iteration
+    int growing_iterations = 0; // iterations that took more memory
+    long allocations_at_start; // operator new calls of this thread before
+                               // an iteration (see AllocationCount)
+    int allocating_iterations = 0; // iterations that called operator new
+    long most_allocations = 0; // most operator new calls in one iteration
+    int full_iterations = 0;   // iterations that ran to the end
     Eigen::Vector3d prev_pose;
 
     {
@@ -55,6 +65,10 @@ void RrtMainLoop(shared_ptr<Queue> Q, shared_ptr<KDTree> Tree,
                                               Tree->root->position_);
     bool reached_goal = false;
 
+    // Set by KDFindNearest every iteration
+    shared_ptr<KDTreeNode> closest_node;
+    shared_ptr<double> closest_dist = make_shared<double>(INF);
+
     int i = 0;
     while(!reached_goal) {
         // Calculate initial hyper ball radius
@@ -95,6 +109,9 @@ void RrtMainLoop(shared_ptr<Queue> Q, shared_ptr<KDTree> Tree,
                 cout << this_thread::get_id() << " Iteration " << i++
                  << "\n--------------------------------" << endl;
             i1 = chrono::steady_clock::now();
+            slabs_at_start = Q->cspace->arena_->SlabCount()
+                    + JListPool::SlabCount();
+            allocations_at_start = AllocationCount();
 
             {
                 lock_guard<mutex> lock(Q->queuetex);
@@ -102,6 +119,27 @@ void RrtMainLoop(shared_ptr<Queue> Q, shared_ptr<KDTree> Tree,
                     lock_guard<mutex> lock(Q->cspace->cspace_mutex_);
                     {
                         lock_guard<mutex> lock(Tree->tree_mutex_);
+
+                        // Drop the nodes that can no longer help (see PruneGraph)
+                        PrunePolicy &policy = Q->prune_policy;
+                        if( policy.period > 0
+                                && Q->cspace->time_elapsed_ - policy.last_prune
+                                   >= policy.period ) {
+                            policy.last_prune = Q->cspace->time_elapsed_;
+                            int pruned = PruneGraph(Q,Tree,Robot);
+                            if(timingml) cout << "Pruned " << pruned
+                                              << " nodes" << endl;
+                        }
+
+                        // Put the nodes that are close in space close in
+                        // the KD-Tree's storage again
+                        if( Q->relayout_period > 0
+                                && Q->cspace->time_elapsed_ - Q->last_relayout
+                                   >= Q->relayout_period ) {
+                            Q->last_relayout = Q->cspace->time_elapsed_;
+                            Tree->KDCompact(true);
+                        }
+
                         ReduceInconsistency(Q,Q->cspace->move_goal_,
                                             Q->cspace->robot_radius_,
                                             Tree->root, hyper_ball_rad);
@@ -113,9 +151,8 @@ void RrtMainLoop(shared_ptr<Queue> Q, shared_ptr<KDTree> Tree,
             } // unlock queuetex
 
             // Sample the free cspace
-            shared_ptr<KDTreeNode> new_node = make_shared<KDTreeNode>();
-            shared_ptr<KDTreeNode> closest_node = make_shared<KDTreeNode>();
-            shared_ptr<double> closest_dist = make_shared<double>(INF);
+            // new_node comes from RandNodeOrFromStack below
+            shared_ptr<KDTreeNode> new_node;
             Eigen::MatrixX2d sampling_area;
 
             if(RandDouble(0,1) > p_uniform) { // Sampling randomly
@@ -203,11 +240,11 @@ void RrtMainLoop(shared_ptr<Queue> Q, shared_ptr<KDTree> Tree,
             }
             new_node = RandNodeOrFromStack(Q->cspace);
             if(new_node->kd_in_tree_) continue;
-            {
-                lock_guard<mutex> lock(Tree->tree_mutex_);
-                Tree->KDFindNearest(closest_node,closest_dist,
-                                    new_node->position_);
-            }
+            // Only used to saturate new_node, so it may be approximate
+            // (see KDTree::SetApproximation)
+            if(!Tree->KDFindNearest(closest_node,closest_dist,
+                                    new_node->position_, true)) continue;
+            approx_error = max(approx_error, Tree->KDApproxError());
 
             // Saturate this node
             initial_distance = Tree->distanceFunction(new_node->position_,
@@ -281,6 +318,13 @@ void RrtMainLoop(shared_ptr<Queue> Q, shared_ptr<KDTree> Tree,
             i2 = chrono::steady_clock::now();
             delta = chrono::duration_cast<chrono::duration<double> >(i2 - i1).count();
             if(timingml) cout << "Duration: " << delta << " s\n" << endl;
+            if(Q->cspace->arena_->SlabCount() + JListPool::SlabCount()
+                    > slabs_at_start)
+                growing_iterations++;
+            long allocations = AllocationCount() - allocations_at_start;
+            if(allocations > 0) allocating_iterations++;
+            most_allocations = max(most_allocations, allocations);
+            full_iterations++;
             if(collect_timing_data)
                 time_file << i++ << " " << delta << "\n";
 
@@ -292,4 +336,16 @@ void RrtMainLoop(shared_ptr<Queue> Q, shared_ptr<KDTree> Tree,
     }
     if(collect_timing_data)
         time_file.close();
+    if(approx_error > 0.0)
+        cout << this_thread::get_id() << " worst approximate nearest error: "
+             << approx_error << endl;
+    cout << this_thread::get_id() << " graph memory: "
+         << Q->cspace->arena_->SlabCount() << " arena slabs, "
+         << JListPool::SlabCount() << " list slabs, taken in "
+         << growing_iterations << " iterations" << endl;
+    if(AllocationCount() >= 0)
+        cout << this_thread::get_id() << " heap allocations: "
+             << allocating_iterations << " of " << full_iterations
+             << " iterations called operator new, at most "
+             << most_allocations << " times" << endl;
 }
@@ -122,7 +122,7 @@ void MoveRobot(shared_ptr<Queue> &Q,
         // parent pointers back for appropriate distance (or root or dead end)
         while( nextDist <= distRemaining && nextNode != root
                && nextNode->rrt_parent_used_
-               && nextNode != nextNode->rrt_parent_edge_->end_node_ ) {
+               && nextNode.get() != nextNode->rrt_parent_edge_->end_node_ ) {
             // Can go all the way to nextNode and still have
             // some distance left to spare
 
@@ -144,7 +144,7 @@ void MoveRobot(shared_ptr<Queue> &Q,
             nextDist = R->robot_edge->dist_;
 
             // Update the next node (at the end of that trajectory)
-            nextNode = R->robot_edge->end_node_;
+            nextNode = R->robot_edge->end_node_->GetPointer();
         }
 
 
@@ -161,7 +161,7 @@ void MoveRobot(shared_ptr<Queue> &Q,
             R->dist_along_robot_edge = R->robot_edge->dist_;
         }
 
-        R->next_move_target = R->robot_edge->end_node_;
+        R->next_move_target = R->robot_edge->end_node_->GetPointer();
 
         // Remember last point in local path
         R->num_local_move_points += 1;
@@ -177,7 +177,7 @@ void MoveRobot(shared_ptr<Queue> &Q,
         targetTime = R->robot_pose(2) - slice_time;
         while( targetTime < R->robot_edge->end_node_->position_(2)
                && nextNode != root && nextNode->rrt_parent_used_
-               && nextNode != nextNode->rrt_parent_edge_->end_node_ ) {
+               && nextNode.get() != nextNode->rrt_parent_edge_->end_node_ ) {
             // Can go all the way to nextNode and still have some
             // time left to spare
 
@@ -190,7 +190,7 @@ void MoveRobot(shared_ptr<Queue> &Q,
             R->robot_edge_used = true;
 
             // Update the next node (at the end of that trajectory)
-            nextNode = nextNode->rrt_parent_edge_->end_node_;
+            nextNode = nextNode->rrt_parent_edge_->end_node_->GetPointer();
         }
 
         // either: 1) targetTime >= nextNode.position_(2)
@@ -209,7 +209,7 @@ void MoveRobot(shared_ptr<Queue> &Q,
                     - R->robot_edge->end_node_->position_(2);
         }
 
-        R->next_move_target = R->robot_edge->end_node_;
+        R->next_move_target = R->robot_edge->end_node_->GetPointer();
 
         // Remember the last point in the local path
         R->num_local_move_points += 1;
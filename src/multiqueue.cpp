@@ -0,0 +1,154 @@
+#include <DRRT/multiqueue.h>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <thread>
+
+MultiQueue::MultiQueue(int threads, int heaps_per_thread)
+    : size_(0)
+{
+    int n = std::max(2, std::max(1, threads)*std::max(1, heaps_per_thread));
+    for( int i = 0; i < n; i++ ) this->parts_.emplace_back(new Part());
+}
+
+void MultiQueue::Push(const std::shared_ptr<KDTreeNode> &node)
+{
+    Part &part = *this->parts_[RandomPart()];
+    std::lock_guard<std::mutex> lock(part.mutex_);
+
+    int slot;
+    if( part.free_slots_.empty() ) {
+        slot = (int)part.nodes_.size();
+        part.nodes_.push_back(node);
+    } else {
+        slot = part.free_slots_.back();
+        part.free_slots_.pop_back();
+        part.nodes_[slot] = node;
+    }
+    part.heap_.Push(PriorityQueue::Key(*node), slot, PriorityQueue::Tie(*node));
+    this->size_++;
+}
+
+bool MultiQueue::Pop(std::shared_ptr<KDTreeNode> &node, double &key)
+{
+    // Two random heaps, the one with the better top gives up its top
+    int a = RandomPart(), b = RandomPart();
+    HeapEntry top_a = {0.0, -1, 1}, top_b = {0.0, -1, 1};
+    {
+        std::lock_guard<std::mutex> lock(this->parts_[a]->mutex_);
+        if( !this->parts_[a]->heap_.Empty() ) top_a = this->parts_[a]->heap_.Top();
+    }
+    if( b != a ) {
+        std::lock_guard<std::mutex> lock(this->parts_[b]->mutex_);
+        if( !this->parts_[b]->heap_.Empty() ) top_b = this->parts_[b]->heap_.Top();
+    }
+    Order order;
+    int first = (top_b.id_ != -1 && (top_a.id_ == -1
+                                     || order.Before(top_b, top_a))) ? b : a;
+    {
+        Part &part = *this->parts_[first];
+        std::lock_guard<std::mutex> lock(part.mutex_);
+        if( !part.heap_.Empty() ) {
+            node = PopFrom(part, key);
+            return true;
+        }
+    }
+
+    // Both were empty (or were emptied meanwhile), take anything there is
+    for( int i = 0; i < (int)this->parts_.size() && this->size_.load() > 0;
+         i++ ) {
+        Part &part = *this->parts_[i];
+        std::lock_guard<std::mutex> lock(part.mutex_);
+        if( !part.heap_.Empty() ) {
+            node = PopFrom(part, key);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MultiQueue::Min(double &key, int &tie)
+{
+    Order order;
+    HeapEntry best = {0.0, -1, 1};
+    for( int i = 0; i < (int)this->parts_.size(); i++ ) {
+        Part &part = *this->parts_[i];
+        std::lock_guard<std::mutex> lock(part.mutex_);
+        if( !part.heap_.Empty() && (best.id_ == -1
+                                    || order.Before(part.heap_.Top(), best)) ) {
+            best = part.heap_.Top();
+        }
+    }
+    key = best.key_;
+    tie = best.tie_;
+    return best.id_ != -1;
+}
+
+void MultiQueue::Drain(std::vector<std::shared_ptr<KDTreeNode>> &nodes)
+{
+    nodes.clear();
+    for( int i = 0; i < (int)this->parts_.size(); i++ ) {
+        Part &part = *this->parts_[i];
+        std::lock_guard<std::mutex> lock(part.mutex_);
+        for( int j = 0; j < part.heap_.Size(); j++ ) {
+            nodes.push_back(part.nodes_[part.heap_.At(j).id_]);
+        }
+        part.heap_.Clear();
+        part.nodes_.clear();
+        part.free_slots_.clear();
+    }
+    this->size_ = 0;
+}
+
+int MultiQueue::RandomPart() const
+{
+    static thread_local std::minstd_rand random(
+                (unsigned)std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return (int)(random() % this->parts_.size());
+}
+
+std::shared_ptr<KDTreeNode> MultiQueue::PopFrom(Part &part, double &key)
+{
+    HeapEntry top = part.heap_.Pop();
+    std::shared_ptr<KDTreeNode> node = part.nodes_[top.id_];
+    part.nodes_[top.id_].reset();
+    part.free_slots_.push_back(top.id_);
+    key = top.key_;
+    this->size_--;
+    return node;
+}
+
+NodeLocks::Guard::Guard(NodeLocks &locks, const KDTreeNode *a,
+                        const KDTreeNode *b, const KDTreeNode *c)
+    : locks_(locks), count_(0)
+{
+    const KDTreeNode *nodes[3] = {a, b, c};
+    for( int i = 0; i < 3; i++ ) {
+        if( nodes[i] == NULL ) continue;
+        int stripe = StripeOf(nodes[i]);
+        bool seen = false;
+        for( int j = 0; j < this->count_; j++ ) {
+            if( this->stripes_[j] == stripe ) seen = true;
+        }
+        if( !seen ) this->stripes_[this->count_++] = stripe;
+    }
+    std::sort(this->stripes_, this->stripes_ + this->count_);
+    for( int i = 0; i < this->count_; i++ ) {
+        this->locks_.stripes_[this->stripes_[i]].lock();
+    }
+}
+
+NodeLocks::Guard::~Guard()
+{
+    for( int i = this->count_ - 1; i >= 0; i-- ) {
+        this->locks_.stripes_[this->stripes_[i]].unlock();
+    }
+}
+
+int NodeLocks::StripeOf(const KDTreeNode *node)
+{
+    // Nodes are far bigger than 64 bytes, the low bits say nothing
+    std::size_t bits = (std::size_t)node >> 6;
+    bits ^= bits >> 17;
+    return (int)(bits % kStripes);
+}
@@ -0,0 +1,136 @@
+/* nnbenchmark.cpp
+ * Times the nearest neighbor storages of KDTree on random nodes in the
+ * 50x50 Dubin's space of smalltest.cpp, inserted in random order, both
+ * before and after KDCompact(true) sorts them along a Z-order curve
+ * Usage: nnbenchmark [nodes] [queries] [range] [cell size] [storage]
+ * (all storages if none is given, the pointer tree is slow for many nodes)
+ */
+
+#include <DRRT/kdtree.h>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace std;
+
+// Same as distance_function in smalltest.cpp
+double distance_function( Eigen::VectorXd a, Eigen::VectorXd b )
+{
+    Eigen::ArrayXd temp = a.head(2) - b.head(2);
+    temp = temp*temp;
+    return sqrt( temp.sum()
+                 + pow( std::min( std::abs(a(2)-b(2)),
+                                  std::min(a(2),b(2)) + 2.0*PI
+                                    - std::max(a(2),b(2)) ), 2 ) );
+}
+
+// Returns seconds since start
+double Seconds( chrono::time_point<chrono::steady_clock> start )
+{
+    return chrono::duration<double>(chrono::steady_clock::now()
+                                    - start).count();
+}
+
+// Times the queries on tree and prints a row of the table
+void TimeQueries( KDTree &tree, string label, double build_time,
+                  vector<Eigen::VectorXd> &queries, double range )
+{
+    int num_queries = (int)queries.size();
+
+    // Sums of the distances found, they should match between storages
+    double nearest_sum = 0.0;
+    shared_ptr<KDTreeNode> nearest;
+    shared_ptr<double> dist = make_shared<double>(0.0);
+    chrono::time_point<chrono::steady_clock> start
+            = chrono::steady_clock::now();
+    for( int i = 0; i < num_queries; i++ ) {
+        tree.KDFindNearest(nearest, dist, queries[i]);
+        nearest_sum += *dist;
+    }
+    double nearest_time = Seconds(start);
+
+    long in_range = 0;
+    KDResults result;
+    start = chrono::steady_clock::now();
+    for( int i = 0; i < num_queries; i++ ) {
+        tree.KDFindWithinRange(range, queries[i], result);
+        in_range += result.size();
+    }
+    double range_time = Seconds(start);
+
+    double knn_sum = 0.0;
+    start = chrono::steady_clock::now();
+    for( int i = 0; i < num_queries; i++ ) {
+        tree.KDFindKNearest(10, queries[i], result);
+        if( !result.empty() ) knn_sum += result.back().second;
+    }
+    double knn_time = Seconds(start);
+
+    printf("%-9s %10.4f %10.4f %10.4f %10.4f %10ld  (%.6f %.6f)\n",
+           label.c_str(), build_time, nearest_time, range_time,
+           knn_time, in_range, nearest_sum, knn_sum);
+}
+
+int main( int argc, char* argv[] )
+{
+    int num_nodes = (argc > 1) ? atoi(argv[1]) : 10000;
+    int num_queries = (argc > 2) ? atoi(argv[2]) : 2000;
+    double range = (argc > 3) ? atof(argv[3]) : 5.0;    // delta in smalltest
+    double cell_size = (argc > 4) ? atof(argv[4]) : range;
+    string only = (argc > 5) ? argv[5] : "";
+    double envRad = 50.0;
+
+    // The same points and queries for every storage
+    mt19937 gen(1);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    vector<Eigen::VectorXd> points, queries;
+    for( int i = 0; i < num_nodes + num_queries; i++ ) {
+        Eigen::VectorXd p(3);
+        p << envRad*unit(gen), envRad*unit(gen), 2.0*PI*unit(gen);
+        if( i < num_nodes ) points.push_back(p);
+        else queries.push_back(p);
+    }
+
+    Eigen::VectorXi wraps(1);
+    Eigen::VectorXd wrap_points(1);
+    wraps(0) = 2;
+    wrap_points(0) = 2.0*PI;
+
+    printf("%d nodes, %d queries, range %.2f, grid cells %.2f\n",
+           num_nodes, num_queries, range, cell_size);
+    // build is the time to insert every node, or to relayout the storage
+    // for the rows ending in +z
+    printf("%-9s %10s %10s %10s %10s %10s\n", "storage", "build(s)",
+           "nearest(s)", "range(s)", "knn10(s)", "in range");
+
+    const char* storages[] = {"pointer", "flat", "dubins", "bucket", "grid"};
+    for( int s = 0; s < 5; s++ ) {
+        string storage = storages[s];
+        if( !only.empty() && storage != only ) continue;
+        KDTree tree(3, wraps, wrap_points);
+        tree.SetDistanceFunction(distance_function);
+        if( storage == "flat" ) tree.UseFlatStorage(num_nodes);
+        else if( storage == "dubins" ) tree.UseDubinsStorage(num_nodes);
+        else if( storage == "bucket" ) tree.UseBucketStorage(num_nodes);
+        else if( storage == "grid" ) tree.UseGridStorage(cell_size, 8,
+                                                          num_nodes);
+
+        vector<shared_ptr<KDTreeNode>> nodes;
+        for( int i = 0; i < num_nodes; i++ ) {
+            nodes.push_back(make_shared<KDTreeNode>(points[i]));
+        }
+        chrono::time_point<chrono::steady_clock> start
+                = chrono::steady_clock::now();
+        for( int i = 0; i < num_nodes; i++ ) tree.KDInsert(nodes[i]);
+        double insert_time = Seconds(start);
+
+        TimeQueries(tree, storage, insert_time, queries, range);
+
+        // Again with the storage sorted along a Z-order curve
+        start = chrono::steady_clock::now();
+        tree.KDCompact(true);
+        double relayout_time = Seconds(start);
+        TimeQueries(tree, storage + "+z", relayout_time, queries, range);
+    }
+    return 0;
+}
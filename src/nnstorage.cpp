@@ -0,0 +1,66 @@
+#include <DRRT/nnstorage.h>
+#include <algorithm>
+
+void NNStorage::Compact(bool relayout)
+{
+    std::vector<int> order;
+    for( int i = 0; i < this->tree_size_; i++ ) {
+        if( this->handles_[i] ) order.push_back(i);
+    }
+
+    if( relayout ) {
+        std::vector<std::shared_ptr<KDTreeNode>> nodes;
+        nodes.reserve(order.size());
+        for( int i = 0; i < (int)order.size(); i++ ) {
+            nodes.push_back(this->handles_[order[i]]);
+        }
+        std::vector<unsigned long long> keys = MortonKeys(nodes);
+        std::vector<int> sorted(order.size());
+        for( int i = 0; i < (int)sorted.size(); i++ ) sorted[i] = i;
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [&keys](int a, int b) { return keys[a] < keys[b]; });
+        for( int i = 0; i < (int)sorted.size(); i++ ) {
+            sorted[i] = order[sorted[i]];
+        }
+        order.swap(sorted);
+    }
+    Renumber(order);
+}
+
+std::vector<unsigned long long> NNStorage::MortonKeys(
+        const std::vector<std::shared_ptr<KDTreeNode>> &nodes)
+{
+    std::vector<unsigned long long> keys(nodes.size(), 0);
+    if( nodes.empty() ) return keys;
+
+    // Up to 63 bits per key, split evenly between the dimensions
+    int dims = std::min((int)nodes[0]->position_.size(), 63);
+    int bits = std::min(21, 63/std::max(dims, 1));
+    Eigen::VectorXd low = nodes[0]->position_.head(dims);
+    Eigen::VectorXd high = low;
+    for( int i = 1; i < (int)nodes.size(); i++ ) {
+        low = low.cwiseMin(nodes[i]->position_.head(dims));
+        high = high.cwiseMax(nodes[i]->position_.head(dims));
+    }
+    double cells = (double)((1ULL << bits) - 1);
+    Eigen::VectorXd scale(dims);
+    for( int j = 0; j < dims; j++ ) {
+        scale(j) = (high(j) > low(j)) ? cells/(high(j) - low(j)) : 0.0;
+    }
+
+    std::vector<unsigned long long> cell(dims);
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        for( int j = 0; j < dims; j++ ) {
+            cell[j] = (unsigned long long)((nodes[i]->position_(j) - low(j))
+                                           *scale(j));
+        }
+        unsigned long long key = 0;
+        for( int b = bits - 1; b >= 0; b-- ) {
+            for( int j = 0; j < dims; j++ ) {
+                key = (key << 1) | ((cell[j] >> b) & 1);
+            }
+        }
+        keys[i] = key;
+    }
+    return keys;
+}
@@ -182,14 +182,11 @@ void Obstacle::ReadDynamicTimeObstaclesFromFile(string obstacle_file)
 bool Obstacle::UpdateObstacles(shared_ptr<ConfigSpace> &C)
 {
     lock_guard<mutex> lock(C->cspace_mutex_);
-    shared_ptr<ListNode> obstacle_list_node = C->obstacles_->front_;
-    shared_ptr<Obstacle> this_obstacle;
-    Eigen::VectorXd new_position;
+    ObstacleRegistry &obstacles = *C->obstacles_;
     bool moved = false;
-    for(int i = 0; i < C->obstacles_->length_; i++) {
-        this_obstacle = obstacle_list_node->obstacle_;
-        moved = this_obstacle->NextOrigin();
-        obstacle_list_node = obstacle_list_node->child_;
+    for(int i = 0; i < obstacles.Size(); i++) {
+        moved = obstacles[i]->NextOrigin();
+        if(moved) obstacles.Refresh(i);
     }
     return moved;
 }
@@ -197,8 +194,7 @@ bool Obstacle::UpdateObstacles(shared_ptr<ConfigSpace> &C)
 void Obstacle::AddObsToConfigSpace(shared_ptr<ConfigSpace> &C)
 {
     lock_guard<mutex> lock(C->cspace_mutex_);
-    shared_ptr<Obstacle> this_obstacle = this->GetPointer();
-    C->obstacles_->ListPush(this_obstacle);
+    C->obstacles_->Add(this->GetPointer());
 }
 
 void Obstacle::ChangeObstacleDirection(std::shared_ptr<ConfigSpace> C,
@@ -286,6 +282,31 @@ void Obstacle::ChangeObstacleDirection(std::shared_ptr<ConfigSpace> C,
     }
 }
 
+// Sets ids to the obstacles that edge may be in conflict with. Each
+// segment of the trajectory is checked as a disc of radius robot_radius_
+// plus half its length around its center (see DetectBulletCollision),
+// these ids are the obstacles whose box overlaps the box around all of them
+static void ObstaclesNearEdge(shared_ptr<ConfigSpace> &C,
+                              shared_ptr<Edge> &edge,
+                              vector<int> &ids)
+{
+    const Eigen::MatrixXd &trajectory = edge->Trajectory();
+    double min_x = INF, min_y = INF, max_x = -INF, max_y = -INF;
+    double x, y, dx, dy, reach;
+    for(int i = 1; i < trajectory.rows(); i++) {
+        x = (trajectory(i-1,0) + trajectory(i,0))/2;
+        y = (trajectory(i-1,1) + trajectory(i,1))/2;
+        dx = trajectory(i,0) - trajectory(i-1,0);
+        dy = trajectory(i,1) - trajectory(i-1,1);
+        reach = C->robot_radius_ + sqrt(dx*dx + dy*dy)/2;
+        min_x = min(min_x, x - reach);
+        min_y = min(min_y, y - reach);
+        max_x = max(max_x, x + reach);
+        max_y = max(max_y, y + reach);
+    }
+    C->obstacles_->InBox(min_x, min_y, max_x, max_y, ids);
+}
+
 /// TO BE CALLED IN PLACE OF ExplicitEdgeCheck2D
 bool DetectBulletCollision(shared_ptr<Obstacle> &O,
                            Eigen::VectorXd start_point,
@@ -629,32 +650,24 @@ void AddObstacle(shared_ptr<KDTree> Tree,
         // See if this node's neighbors can be reached
 
         // Get an iterator for this node's out neighbors
-        shared_ptr<RrtNodeNeighborIterator> this_node_out_neighbors
-                = make_shared<RrtNodeNeighborIterator>(this_node);
+        RrtNodeNeighborIterator this_node_out_neighbors(this_node);
 
         // Iterate through list
-        shared_ptr<JListNode> list_item
-                = NextOutNeighbor(this_node_out_neighbors);
-        shared_ptr<JListNode> next_item;
-        shared_ptr<Edge> neighbor_edge;
-        while(list_item->key_ != -1.0) {
-            neighbor_edge = list_item->edge_;
-            next_item = NextOutNeighbor(this_node_out_neighbors);
-            if(neighbor_edge->ExplicitEdgeCheck(O))
+        shared_ptr<Edge> *item;
+        while((item = NextOutNeighbor(this_node_out_neighbors)) != NULL) {
+            if((*item)->ExplicitEdgeCheck(O))
                 // Mark edge to neighbor at INF cost
-                list_item->edge_->dist_ = INF;
-            list_item = next_item;
+                (*item)->dist_ = INF;
         }
 
         // See if this node's parent can be reached
         if(this_node->rrt_parent_used_
                 && this_node->rrt_parent_edge_->ExplicitEdgeCheck(O)) {
             // Remove this_node from it's parent's successor list
-            this_node->rrt_parent_edge_->end_node_->successor_list_->JListRemove(
-                        this_node->successor_list_item_in_parent_);
+            this_node->RemoveFromSuccessors();
 
             // This node now has no parent
-            this_node->rrt_parent_edge_->end_node_ = this_node;
+            this_node->rrt_parent_edge_->end_node_ = this_node.get();
             this_node->rrt_parent_edge_->dist_ = INF;
             this_node->rrt_parent_used_ = false;
 
@@ -681,7 +694,7 @@ void RemoveObstacle(std::shared_ptr<KDTree> Tree,
             = FindPointsInConflictWithObstacle(Q->cspace,Tree,O,root);
 
     // For all nodes that might be in conflict
-    shared_ptr<KDTreeNode> this_node = make_shared<KDTreeNode>();
+    shared_ptr<KDTreeNode> this_node;
     shared_ptr<double> key = make_shared<double>(0);
 //    cout << "points in conflict: " << node_list->length_ << endl;
     while(node_list->length_ > 0) {
@@ -693,33 +706,27 @@ void RemoveObstacle(std::shared_ptr<KDTree> Tree,
         // See if this node's out neighbors were blocked by the obstacle
 
         // Get an iterator for this node's out neighbors
-        shared_ptr<RrtNodeNeighborIterator> this_node_out_neighbors
-                = make_shared<RrtNodeNeighborIterator>(this_node);
+        RrtNodeNeighborIterator this_node_out_neighbors(this_node);
         neighbors_were_blocked = false;
 
         // Iterate through list
-        shared_ptr<JListNode> list_item
-                = NextOutNeighbor(this_node_out_neighbors);
-        shared_ptr<ListNode> o_list_item;
-        shared_ptr<JListNode> next_item;
+        shared_ptr<Edge> *item;
+        vector<int> other_ids;
         shared_ptr<Edge> neighbor_edge;
-        shared_ptr<KDTreeNode> neighbor_node;
-        while(list_item->key_ != -1.0) {
-            neighbor_edge = list_item->edge_;
-            neighbor_node = list_item->edge_->end_node_;
-            next_item = NextOutNeighbor(this_node_out_neighbors);
+        while((item = NextOutNeighbor(this_node_out_neighbors)) != NULL) {
+            neighbor_edge = *item;
             if(neighbor_edge->dist_ == INF
                     && neighbor_edge->ExplicitEdgeCheck(O)) {
                 // This edge used to be in collision with at least one
                 // obstacle (at least the obstacle in question)
                 // Need to check if could be in conflict with other obstacles
-
-                o_list_item = Q->cspace->obstacles_->front_;
+                // (only the ones near the edge can be)
+                ObstaclesNearEdge(Q->cspace, neighbor_edge, other_ids);
 
                 conflicts_with_other_obs = false;
                 shared_ptr<Obstacle> other_obstacle;
-                while(o_list_item != o_list_item->child_) {
-                    other_obstacle = o_list_item->obstacle_;
+                for(int i = 0; i < (int)other_ids.size(); i++) {
+                    other_obstacle = (*Q->cspace->obstacles_)[other_ids[i]];
                     if(other_obstacle != O
                             && other_obstacle->obstacle_used_
                             && other_obstacle->start_time_ <= time_elapsed_
@@ -730,16 +737,14 @@ void RemoveObstacle(std::shared_ptr<KDTree> Tree,
                             break;
                         }
                     }
-                    o_list_item = o_list_item->child_;
                 }
 
                 if(!conflicts_with_other_obs) {
                     // Reset edge length_ to actual cost
-                    list_item->edge_->dist_ = list_item->edge_->dist_original_;
+                    neighbor_edge->dist_ = neighbor_edge->dist_original_;
                     neighbors_were_blocked = true;
                 }
             }
-            list_item = next_item;
         }
 
         if(neighbors_were_blocked) {
@@ -890,16 +895,14 @@ bool ExplicitEdgeCheck(shared_ptr<ConfigSpace> &C,
     bool vis_traj = false;
     bool vis_coll = false;
 
-    shared_ptr<ListNode> obstacle_list_node;
-    int length;
+    vector<int> ids;
     {
         lock_guard<mutex> lock(C->cspace_mutex_);
-        obstacle_list_node = C->obstacles_->front_;
-        length = C->obstacles_->length_;
         f1 = chrono::steady_clock::now();
-        for( int i = 0; i < length; i++ ) {
+        ObstaclesNearEdge(C, edge, ids);
+        for( int i = 0; i < (int)ids.size(); i++ ) {
             t1 = chrono::steady_clock::now();
-            if( edge->ExplicitEdgeCheck(obstacle_list_node->obstacle_) ) {
+            if( edge->ExplicitEdgeCheck((*C->obstacles_)[ids[i]]) ) {
                 t2 = chrono::steady_clock::now();
                 delta = chrono::duration_cast<chrono::duration<double> >(t2 - t1).count();
                 if(timingobs) cout << "ExplicitEdgeCheck(obstacle): " << delta << " s" << endl;
@@ -912,7 +915,6 @@ bool ExplicitEdgeCheck(shared_ptr<ConfigSpace> &C,
             delta = chrono::duration_cast<chrono::duration<double> >(t2 - t1).count();
             if(timingobs) cout << "ExplicitEdgeCheck(obstacle): " << delta << " s" << endl;
             C->AddVizEdge(edge,"traj",vis_traj);
-            obstacle_list_node = obstacle_list_node->child_; // iterate
         }
         f2 = chrono::steady_clock::now();
         delta = chrono::duration_cast<chrono::duration<double> >(f2 - f1).count();
@@ -963,16 +965,13 @@ bool QuickCheck2D(shared_ptr<ConfigSpace> &C,
 
 bool QuickCheck(shared_ptr<ConfigSpace> &C, Eigen::VectorXd point)
 {
-    shared_ptr<ListNode> obstacle_list_node;
-    int length;
+    vector<int> ids;
     {
         lock_guard<mutex> lock(C->cspace_mutex_);
-        obstacle_list_node = C->obstacles_->front_;
-        length = C->obstacles_->length_;
-
-        for(int i = 0; i < length; i++) {
-            if(QuickCheck2D(C,point,obstacle_list_node->obstacle_)) return true;
-            obstacle_list_node = obstacle_list_node->child_;
+        // Points outside the bounding circle pass QuickCheck2D
+        C->obstacles_->NearPoint(point(0), point(1), 0.0, ids);
+        for(int i = 0; i < (int)ids.size(); i++) {
+            if(QuickCheck2D(C,point,(*C->obstacles_)[ids[i]])) return true;
         }
     }
     return false;
@@ -1068,17 +1067,18 @@ bool ExplicitPointCheck(shared_ptr<Queue>& Q, Eigen::VectorXd point)
 
     // Point is not inside any obstacles but still may be in collision
     // because of the robot radius
-    shared_ptr<ListNode> obstacle_list_node;
-    int length;
+    vector<int> ids;
     {
         lock_guard<mutex> lock(Q->cspace->cspace_mutex_);
-        obstacle_list_node = Q->cspace->obstacles_->front_;
-        length = Q->cspace->obstacles_->length_;
-
-        for(int i = 0; i < length; i++) {
-            if(ExplicitPointCheck2D(Q->cspace,obstacle_list_node->obstacle_,
+        // ExplicitPointCheck2D gives up on obstacles further than this
+        // (the distance function is never shorter than the 2D distance)
+        Q->cspace->obstacles_->NearPoint(point(0), point(1),
+                                         Q->cspace->robot_radius_
+                                         + Q->cspace->collision_distance_,
+                                         ids);
+        for(int i = 0; i < (int)ids.size(); i++) {
+            if(ExplicitPointCheck2D(Q->cspace,(*Q->cspace->obstacles_)[ids[i]],
                                     point, Q->cspace->robot_radius_)) return true;
-            obstacle_list_node = obstacle_list_node->child_;
         }
     }
     return false;
@@ -0,0 +1,88 @@
+#include <DRRT/obstacleregistry.h>
+#include <DRRT/obstacle.h>
+#include <algorithm>
+
+int ObstacleRegistry::Add(const std::shared_ptr<Obstacle> &O)
+{
+    int id = (int)this->obstacles_.size();
+    this->obstacles_.push_back(O);
+    this->center_x_.push_back(0.0);
+    this->center_y_.push_back(0.0);
+    this->radius_.push_back(INF);
+    this->min_x_.push_back(-INF);
+    this->min_y_.push_back(-INF);
+    this->max_x_.push_back(INF);
+    this->max_y_.push_back(INF);
+    O->id_ = id;
+    Refresh(id);
+    return id;
+}
+
+void ObstacleRegistry::Refresh(int id)
+{
+    Obstacle &O = *this->obstacles_[id];
+    if( O.kind_ == 6 || O.kind_ == 7 || O.origin_.size() < 2 ) {
+        // Where these are depends on time, never filter them out
+        this->center_x_[id] = 0.0;
+        this->center_y_[id] = 0.0;
+        this->radius_[id] = INF;
+        this->min_x_[id] = this->min_y_[id] = -INF;
+        this->max_x_[id] = this->max_y_[id] = INF;
+        return;
+    }
+
+    double x = O.origin_(0), y = O.origin_(1), r = O.radius_;
+    this->center_x_[id] = x;
+    this->center_y_[id] = y;
+    this->radius_[id] = r;
+
+    double min_x = x - r, min_y = y - r, max_x = x + r, max_y = y + r;
+    Eigen::MatrixX2d polygon = O.GetPosition();
+    if( polygon.rows() > 0 ) {
+        min_x = std::min(min_x, polygon.col(0).minCoeff());
+        min_y = std::min(min_y, polygon.col(1).minCoeff());
+        max_x = std::max(max_x, polygon.col(0).maxCoeff());
+        max_y = std::max(max_y, polygon.col(1).maxCoeff());
+    }
+    this->min_x_[id] = min_x;
+    this->min_y_[id] = min_y;
+    this->max_x_[id] = max_x;
+    this->max_y_[id] = max_y;
+}
+
+void ObstacleRegistry::NearPoint(double x, double y, double margin,
+                                 std::vector<int> &ids) const
+{
+    int n = Size();
+    const double *cx = this->center_x_.data();
+    const double *cy = this->center_y_.data();
+    const double *r = this->radius_.data();
+
+    // Every id is written, count only moves past the ones that hit
+    ids.resize(n);
+    int count = 0;
+    for( int i = 0; i < n; i++ ) {
+        double dx = cx[i] - x, dy = cy[i] - y, reach = r[i] + margin;
+        ids[count] = i;
+        count += (dx*dx + dy*dy <= reach*reach);
+    }
+    ids.resize(count);
+}
+
+void ObstacleRegistry::InBox(double min_x, double min_y,
+                             double max_x, double max_y,
+                             std::vector<int> &ids) const
+{
+    int n = Size();
+    const double *lx = this->min_x_.data(), *ly = this->min_y_.data();
+    const double *hx = this->max_x_.data(), *hy = this->max_y_.data();
+
+    ids.resize(n);
+    int count = 0;
+    for( int i = 0; i < n; i++ ) {
+        ids[count] = i;
+        count += (lx[i] <= max_x) & (min_x <= hx[i])
+                 & (ly[i] <= max_y) & (min_y <= hy[i]);
+    }
+    ids.resize(count);
+}
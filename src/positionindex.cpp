@@ -0,0 +1,126 @@
+#include <DRRT/positionindex.h>
+#include <algorithm>
+#include <cmath>
+
+PositionIndex::PositionIndex(int dimensions, double cell_size,
+                             const Eigen::VectorXi &wraps,
+                             const Eigen::VectorXd &wrap_points)
+    :   cell_size_(cell_size), dimensions_(dimensions),
+        wrap_cells_(dimensions, 0), wrap_points_(dimensions, 0.0)
+{
+    for( int i = 0; i < wraps.size(); i++ ) {
+        int j = wraps(i);
+        wrap_points_[j] = wrap_points(i);
+        wrap_cells_[j] = std::max(1, (int)std::floor(wrap_points(i)
+                                                     /cell_size));
+    }
+}
+
+void PositionIndex::Insert(const std::shared_ptr<KDTreeNode> &node)
+{
+    this->cells_[KeyOf(node->position_)].push_back(node);
+}
+
+bool PositionIndex::Remove(const std::shared_ptr<KDTreeNode> &node)
+{
+    std::unordered_map<unsigned long long,Cell>::iterator it
+            = this->cells_.find(KeyOf(node->position_));
+    if( it == this->cells_.end() ) return false;
+
+    Cell &nodes = it->second;
+    Cell::iterator n = std::find(nodes.begin(), nodes.end(), node);
+    if( n == nodes.end() ) return false;
+    *n = nodes.back();
+    nodes.pop_back();
+    if( nodes.empty() ) this->cells_.erase(it);
+    return true;
+}
+
+std::shared_ptr<KDTreeNode> PositionIndex::Find(
+        const Eigen::VectorXd &pos) const
+{
+    std::unordered_map<unsigned long long,Cell>::const_iterator it
+            = this->cells_.find(KeyOf(pos));
+    if( it != this->cells_.end() ) {
+        const Cell &nodes = it->second;
+        for( int i = 0; i < (int)nodes.size(); i++ ) {
+            if( nodes[i]->position_ == pos ) return nodes[i];
+        }
+    }
+    return std::shared_ptr<KDTreeNode>();
+}
+
+bool PositionIndex::FindWithin(const Eigen::VectorXd &pos, double radius,
+                               double (*distance)(Eigen::VectorXd a,
+                                                  Eigen::VectorXd b)) const
+{
+    // Offsets -1, 0 and 1 along each dimension, fewer along a wrapping
+    // dimension with less than 3 cubes so no cube is looked at twice
+    const int d = this->dimensions_;
+    std::vector<long> center(d), cell(d);
+    std::vector<int> low(d), high(d), offset(d);
+    for( int j = 0; j < d; j++ ) {
+        center[j] = CellOf(pos(j), j);
+        low[j] = (this->wrap_cells_[j] == 1 || this->wrap_cells_[j] == 2)
+                 ? 0 : -1;
+        high[j] = (this->wrap_cells_[j] == 1) ? 0 : 1;
+        offset[j] = low[j];
+    }
+
+    while( true ) {
+        for( int j = 0; j < d; j++ ) {
+            cell[j] = center[j] + offset[j];
+            if( this->wrap_cells_[j] > 0 ) {
+                cell[j] = (cell[j] + this->wrap_cells_[j])
+                          % this->wrap_cells_[j];
+            }
+        }
+        std::unordered_map<unsigned long long,Cell>::const_iterator it
+                = this->cells_.find(Key(cell));
+        if( it != this->cells_.end() ) {
+            const Cell &nodes = it->second;
+            for( int i = 0; i < (int)nodes.size(); i++ ) {
+                if( distance(pos, nodes[i]->position_) < radius ) return true;
+            }
+        }
+
+        // Next combination of offsets
+        int j = 0;
+        while( j < d && offset[j] == high[j] ) {
+            offset[j] = low[j];
+            j++;
+        }
+        if( j == d ) break;
+        offset[j] += 1;
+    }
+    return false;
+}
+
+long PositionIndex::CellOf(double x, int j) const
+{
+    int n = this->wrap_cells_[j];
+    if( n == 0 ) return (long)std::floor(x/this->cell_size_);
+
+    // Cubes are wrap_points_[j]/n wide along a wrapping dimension
+    long cell = (long)std::floor(x*n/this->wrap_points_[j]);
+    cell %= n;
+    return (cell < 0) ? cell + n : cell;
+}
+
+unsigned long long PositionIndex::Key(const std::vector<long> &cell) const
+{
+    // Mix the coordinates in one at a time (as in boost::hash_combine)
+    unsigned long long key = 0;
+    for( int j = 0; j < (int)cell.size(); j++ ) {
+        key ^= (unsigned long long)cell[j] + 0x9e3779b97f4a7c15ULL
+               + (key << 6) + (key >> 2);
+    }
+    return key;
+}
+
+unsigned long long PositionIndex::KeyOf(const Eigen::VectorXd &pos) const
+{
+    std::vector<long> cell(this->dimensions_);
+    for( int j = 0; j < this->dimensions_; j++ ) cell[j] = CellOf(pos(j), j);
+    return Key(cell);
+}
@@ -0,0 +1,156 @@
+/* prunetest.cpp
+ * Checks that PruneGraph leaves no edge pointing at a removed node, also
+ * for edges longer than saturation_delta_ (the fallback to the closest
+ * node in FindBestParent makes those). Prints the problems it finds and
+ * returns 1 if there are any
+ * Usage: prunetest
+ */
+
+#include <DRRT/drrt.h>
+#include <cstdio>
+
+using namespace std;
+
+// Same as distance_function in smalltest.cpp
+double distance_function( Eigen::VectorXd a, Eigen::VectorXd b )
+{
+    Eigen::ArrayXd temp = a.head(2) - b.head(2);
+    temp = temp*temp;
+    return sqrt( temp.sum()
+                 + pow( std::min( std::abs(a(2)-b(2)),
+                                  std::min(a(2),b(2)) + 2.0*PI
+                                    - std::max(a(2),b(2)) ), 2 ) );
+}
+
+// Returns a node at x,y in tree with the given parent (none if NULL)
+shared_ptr<KDTreeNode> AddNode( shared_ptr<Queue> &Q, shared_ptr<KDTree> &Tree,
+                                double x, double y,
+                                shared_ptr<KDTreeNode> parent )
+{
+    Eigen::VectorXd position(3);
+    position << x, y, 0.0;
+    shared_ptr<KDTreeNode> node
+            = MakeInArena<KDTreeNode>(Q->cspace->arena_, position);
+    if( parent ) {
+        shared_ptr<Edge> edge = Edge::NewEdge(Q->cspace,Tree,node,parent);
+        edge->dist_ = edge->dist_original_
+                = Tree->distanceFunction(node->position_, parent->position_);
+        MakeParentOf(parent, node, edge);
+        node->rrt_LMC_ = node->rrt_tree_cost_ = parent->rrt_LMC_ + edge->dist_;
+    } else {
+        node->rrt_parent_edge_ = Edge::NewEdge(Q->cspace,Tree,node,node);
+        node->rrt_parent_used_ = false;
+        node->rrt_LMC_ = node->rrt_tree_cost_ = 0.0;
+    }
+    Tree->KDInsert(node);
+    return node;
+}
+
+// Links start and end both ways, as current and initial neighbors, the
+// way Extend links a new node with a node in its ball
+void Link( shared_ptr<Queue> &Q, shared_ptr<KDTree> &Tree,
+           shared_ptr<KDTreeNode> start, shared_ptr<KDTreeNode> end )
+{
+    double dist = Tree->distanceFunction(start->position_, end->position_);
+    shared_ptr<Edge> out = Edge::NewEdge(Q->cspace,Tree,start,end);
+    out->dist_ = out->dist_original_ = dist;
+    MakeInitialOutNeighborOf(end, start, out);
+    MakeNeighborOf(end, start, out);
+
+    shared_ptr<Edge> in = Edge::NewEdge(Q->cspace,Tree,end,start);
+    in->dist_ = in->dist_original_ = dist;
+    MakeInitialInNeighborOf(start, end, in);
+    MakeNeighborOf(start, end, in);
+}
+
+// Returns how many edges of node end at a node that is not in the tree
+// or sit at the wrong index in their set
+int CheckEdges( shared_ptr<KDTreeNode> &node )
+{
+    if( !node->edges_ ) return 0;
+    NodeEdges &edges = *node->edges_;
+    EdgeSet *sets[] = { &edges.out_, &edges.in_, &edges.initial_out_,
+                        &edges.initial_in_, &edges.initial_refs_ };
+    int bad = 0;
+    for( EdgeSet *set : sets ) {
+        for( int i = 0; i < set->Size(); i++ ) {
+            Edge *edge = (*set)[i].get();
+            if( !edge->start_node_->kd_in_tree_
+                    || !edge->end_node_->kd_in_tree_ ) bad++;
+        }
+    }
+    for( int i = 0; i < edges.out_.Size(); i++ ) {
+        if( edges.out_[i]->index_in_start_node_ != i ) bad++;
+    }
+    for( int i = 0; i < edges.in_.Size(); i++ ) {
+        if( edges.in_[i]->index_in_end_node_ != i ) bad++;
+    }
+    return bad;
+}
+
+int main()
+{
+    Eigen::VectorXd lower(3), upper(3), start(3), goal(3);
+    lower << 0.0, 0.0, 0.0;
+    upper << 50.0, 50.0, 2.0*PI;
+    start << 0.0, 0.0, 0.0;
+    goal << 1.0, 1.0, 0.0;
+
+    shared_ptr<Queue> Q = make_shared<Queue>();
+    Q->priority_queue = make_shared<PriorityQueue>();
+    Q->obs_successors = make_shared<JList>(true);
+    Q->change_thresh = 0.5;
+    Q->cspace = make_shared<ConfigSpace>(3, lower, upper, start, goal);
+    Q->cspace->distanceFunction = distance_function;
+    Q->cspace->saturation_delta_ = 1.0;
+    Q->prune_policy.window = 10.0;
+
+    Eigen::VectorXi wraps(0);
+    Eigen::VectorXd wrap_points(0);
+    shared_ptr<KDTree> Tree = make_shared<KDTree>(3, wraps, wrap_points);
+    Tree->SetDistanceFunction(distance_function);
+
+    // The goal and a node near it stay, the far node and its child are
+    // outside the window. The far nodes are linked to the near ones with
+    // edges much longer than saturation_delta_
+    shared_ptr<KDTreeNode> root = AddNode(Q, Tree, 1.0, 1.0, NULL);
+    shared_ptr<KDTreeNode> near = AddNode(Q, Tree, 1.5, 1.0, root);
+    shared_ptr<KDTreeNode> far = AddNode(Q, Tree, 40.0, 40.0, near);
+    shared_ptr<KDTreeNode> far_child = AddNode(Q, Tree, 41.0, 40.0, far);
+    shared_ptr<KDTreeNode> move_goal = AddNode(Q, Tree, 0.5, 0.5, near);
+    Link(Q, Tree, near, far);
+    Link(Q, Tree, far, far_child);
+    Link(Q, Tree, root, near);
+    Link(Q, Tree, far_child, move_goal);
+
+    Q->cspace->root_ = root;
+    Q->cspace->goal_node_ = root;
+    Q->cspace->move_goal_ = move_goal;
+    move_goal->is_move_goal_ = true;
+    shared_ptr<RobotData> Robot
+            = make_shared<RobotData>(move_goal->position_, move_goal, 3);
+    Robot->robot_pose = move_goal->position_;
+
+    weak_ptr<KDTreeNode> far_left = far, far_child_left = far_child;
+    far.reset();
+    far_child.reset();
+
+    int pruned = PruneGraph(Q, Tree, Robot);
+    int bad = 0;
+    if( pruned != 2 ) {
+        printf("pruned %d nodes instead of 2\n", pruned);
+        bad++;
+    }
+    vector<shared_ptr<KDTreeNode>> nodes = Tree->KDNodes();
+    for( int i = 0; i < (int)nodes.size(); i++ ) {
+        bad += CheckEdges(nodes[i]);
+    }
+    nodes.clear();
+    if( !far_left.expired() || !far_child_left.expired() ) {
+        printf("a removed node is still alive\n");
+        bad++;
+    }
+
+    printf("prunetest: %s (%d problems)\n", bad ? "FAILED" : "ok", bad);
+    return bad ? 1 : 0;
+}
@@ -106,7 +106,7 @@ Eigen::VectorXd RandPointDefault(shared_ptr<ConfigSpace> C)
 shared_ptr<KDTreeNode> RandNodeDefault(shared_ptr<ConfigSpace> C)
 {
     Eigen::VectorXd point = RandPointDefault(C);
-    return make_shared<KDTreeNode>(point);
+    return MakeInArena<KDTreeNode>(C->arena_, point);
 }
 
 shared_ptr<KDTreeNode> RandNodeOrGoal(shared_ptr<ConfigSpace> C)
@@ -123,7 +123,7 @@ shared_ptr<KDTreeNode> RandNodeIts(shared_ptr<ConfigSpace> C)
 {
     if( C->iterations_until_sample_ == 0 ) {
         C->iterations_until_sample_ -= 1;
-        return make_shared<KDTreeNode>(C->iteration_sample_point_);
+        return MakeInArena<KDTreeNode>(C->arena_, C->iteration_sample_point_);
     }
     C->iterations_until_sample_ -= 1;
     return RandNodeOrGoal(C);
@@ -133,7 +133,7 @@ shared_ptr<KDTreeNode> RandNodeTime(shared_ptr<ConfigSpace> C)
 {
     if( C->wait_time_ != INF && C->time_elapsed_ >= C->wait_time_ ) {
         C->wait_time_ = INF;
-        return make_shared<KDTreeNode>(C->time_sample_point_);
+        return MakeInArena<KDTreeNode>(C->arena_, C->time_sample_point_);
     }
     return RandNodeOrGoal( C );
 }
@@ -145,7 +145,7 @@ shared_ptr<KDTreeNode> RandNodeOrFromStack(shared_ptr<ConfigSpace> &C)
 {
     if( C->sample_stack_->length_ > 0 ) {
         // Using the sample_stack_ so KDTreeNode->position_ is popped
-        shared_ptr<KDTreeNode> temp = make_shared<KDTreeNode>();
+        shared_ptr<KDTreeNode> temp;
         C->sample_stack_->JListPop(temp);
         return temp;
     } else {
@@ -157,9 +157,9 @@ shared_ptr<KDTreeNode> RandNodeInTimeOrFromStack(shared_ptr<ConfigSpace> C)
 {
     if( C->sample_stack_->length_ > 0 ) {
         // Using the sample_stack_ so KDTreeNode->position_ is popped
-        shared_ptr<KDTreeNode> temp = make_shared<KDTreeNode>();
+        shared_ptr<KDTreeNode> temp;
         C->sample_stack_->JListPop(temp);
-        return make_shared<KDTreeNode>(temp->position_);
+        return MakeInArena<KDTreeNode>(C->arena_, temp->position_);
     } else {
         shared_ptr<KDTreeNode> newNode = RandNodeOrGoal( C );
         if( newNode == C->goal_node_ ) {
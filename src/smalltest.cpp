@@ -25,11 +25,18 @@ shared_ptr<RobotData> Rrtx(Problem p, shared_ptr<thread> &vis)
 
     // Queue
     shared_ptr<Queue> Q = make_shared<Queue>();
-    Q->priority_queue = make_shared<BinaryHeap>(false); // priority queue use Q functions
+    Q->priority_queue = make_shared<PriorityQueue>(); // nodes to be rewired
     Q->obs_successors = make_shared<JList>(true); // obstacle stack uses KDTreeNodes
     Q->change_thresh = p.change_threshold;
     Q->type = p.search_type;
     Q->cspace = p.c_space;
+    Q->prune_policy.prune_cost = p.prune_cost;
+    Q->prune_policy.window = p.prune_window;
+    Q->prune_policy.period = p.prune_period;
+    Q->k_nearest = p.k_nearest;
+    Q->relayout_period = p.relayout_period;
+    Q->min_node_spacing = p.min_node_spacing;
+    Q->reduce_threads = p.reduce_threads;
     Q->cspace->sample_stack_ = make_shared<JList>(true); // uses KDTreeNodes
     Q->cspace->saturation_delta_ = p.delta;
 
@@ -37,6 +44,15 @@ shared_ptr<RobotData> Rrtx(Problem p, shared_ptr<thread> &vis)
     shared_ptr<KDTree> kd_tree
             = make_shared<KDTree>(Q->cspace->num_dimensions_,p.wraps,p.wrap_points);
     kd_tree->SetDistanceFunction(Q->cspace->distanceFunction);
+    if(p.kd_tree_storage == "flat") kd_tree->UseFlatStorage();
+    else if(p.kd_tree_storage == "dubins") kd_tree->UseDubinsStorage();
+    else if(p.kd_tree_storage == "bucket") kd_tree->UseBucketStorage();
+    else if(p.kd_tree_storage == "grid") {
+        kd_tree->UseGridStorage(p.grid_cell_size > 0.0 ? p.grid_cell_size
+                                                       : p.delta);
+    }
+    kd_tree->SetApproximation(p.approx_epsilon, p.approx_budget);
+    if(p.min_node_spacing > 0.0) kd_tree->UsePositionIndex(p.min_node_spacing);
 
     shared_ptr<KDTreeNode> root = make_shared<KDTreeNode>(Q->cspace->start_);
     ExplicitNodeCheck(Q,root);
@@ -218,6 +234,11 @@ int main( int argc, char* argv[] )
     double goal_thresh = 0.5;       // goal detection
     bool move_robot = true;         // move robot after plan_time/slice_time
     int num_threads = 5;            // number of main loop threads to spawn
+    string kd_tree_storage = "bucket"; // "pointer", "flat", "dubins",
+                                       // "bucket", "grid"
+    double prune_period = 0.0;      // prune the graph this often (0 = never)
+    double relayout_period = 0.0;   // re-sort the KD-Tree along a Z-order
+                                    // curve this often (0 = never)
 
     /// Read in Obstacles
     Obstacle::ReadObstaclesFromFile(obstacle_file, cspace);
@@ -227,6 +248,10 @@ int main( int argc, char* argv[] )
                               ball_const, change_thresh, goal_thresh,
                               move_robot, wrap_vec, wrap_points_vec,
                               num_threads);
+    problem.kd_tree_storage = kd_tree_storage;
+    problem.prune_cost = true;
+    problem.prune_period = prune_period;
+    problem.relayout_period = relayout_period;
 
     // Pointer to visualizer thread (created in RRTX())
     shared_ptr<thread> vis_thread;
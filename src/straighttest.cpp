@@ -27,7 +27,7 @@ void printRRTxPath(shared_ptr<KDTreeNode> &leaf)
     while(leaf->rrt_parent_used_) {
         cout << "pose: " << leaf->rrt_LMC_ << "\n" << leaf->position_ << endl;
         cout << "VVVVVVVV" << endl;
-        leaf = leaf->rrt_parent_edge_->end_node_;
+        leaf = leaf->rrt_parent_edge_->end_node_->GetPointer();
     }
     cout << leaf->position_ << endl;
 }
@@ -46,7 +46,7 @@ shared_ptr<RobotData> RRTX(Problem p, shared_ptr<thread> &vis)
 
     /// Queue
     shared_ptr<Queue> Q = make_shared<Queue>();
-    Q->priority_queue = make_shared<BinaryHeap>(false); // priority queue use Q functions
+    Q->priority_queue = make_shared<PriorityQueue>(); // nodes to be rewired
     Q->obs_successors = make_shared<JList>(true); // obstacle stack uses KDTreeNodes
     Q->change_thresh = p.change_threshold;
     Q->type = p.search_type;
@@ -109,7 +109,6 @@ shared_ptr<RobotData> RRTX(Problem p, shared_ptr<thread> &vis)
     double move_distance;
     Eigen::Vector3d prev_pose;
     shared_ptr<Edge> prev_edge;
-    shared_ptr<ListNode> list_item;
     bool /*removed,*/ added;
     shared_ptr<Obstacle> obstacle;
 
@@ -396,12 +395,6 @@ shared_ptr<RobotData> RRTX(Problem p, shared_ptr<thread> &vis)
 //        }
 
         // Add Obstacles
-        {
-            cout << "locking" << endl;lock_guard<mutex> lock(Q->cspace->cspace_mutex_);
-            list_item = Q->cspace->obstacles_->front_;
-            cout << "unlocking" << endl;
-
-        }
         added = false;
         Eigen::VectorXd robot_pose;
         {
@@ -410,8 +403,12 @@ shared_ptr<RobotData> RRTX(Problem p, shared_ptr<thread> &vis)
             cout << "unlocking" << endl;
 
         }
-        while(list_item != list_item->child_) {
-            obstacle = list_item->obstacle_;
+        // The registry is walked in place, so it stays locked for the loop
+        cout << "locking" << endl;
+        unique_lock<mutex> obstacles_lock(Q->cspace->cspace_mutex_);
+        ObstacleRegistry &obstacles = *Q->cspace->obstacles_;
+        for(int i = 0; i < obstacles.Size(); i++) {
+            obstacle = obstacles[i];
 
             if(!obstacle->sensible_obstacle_ && !obstacle->obstacle_used_
                     && obstacle->start_time_ <= Q->cspace->time_elapsed_
@@ -463,8 +460,9 @@ shared_ptr<RobotData> RRTX(Problem p, shared_ptr<thread> &vis)
                     robot->current_move_invalid = true;
                 added = true;
             }
-            list_item = list_item->child_;
         }
+        obstacles_lock.unlock();
+        cout << "unlocking" << endl;
         if(added) {
             PropogateDescendants(Q,kd_tree,robot);
             if(!MarkedOS(Q->cspace->move_goal_)) VerifyInQueue(Q,Q->cspace->move_goal_);
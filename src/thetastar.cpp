@@ -1,10 +1,12 @@
 #include <DRRT/thetastar.h>
+#include <DRRT/bucketqueue.h>
 
 using namespace std;
 
-// Open and closed sets for Theta*
-shared_ptr<BinaryHeap> open_set;
-shared_ptr<JList> closed_set;
+// Open set for Theta*, the closed set is marked on the nodes with the
+// stamp of the search (KDTreeNode::theta_closed_)
+shared_ptr<BucketQueue> open_set;
+unsigned int closed_stamp = 0;
 
 // Euclidean distance
 double DistFunc(Eigen::VectorXd a, Eigen::VectorXd b)
@@ -50,23 +52,26 @@ vector<Eigen::VectorXd> ThetaStar(shared_ptr<Queue> Q)
     shared_ptr<KDTree> tree =
             make_shared<KDTree>(3,wrap_vec,wrap_points_vec);
     tree->SetDistanceFunction(DistFunc);
+    // The grid below is built into the flat tree in one go, the goal
+    // cell is then looked up by position
+    tree->UseFlatStorage(Q->cspace->width_(0)*Q->cspace->width_(1) + 1);
+    tree->UsePositionIndex(1.0);
 
-    shared_ptr<KDTreeNode> start = make_shared<KDTreeNode>(Q->cspace->start_);
+    shared_ptr<KDTreeNode> start
+            = MakeInArena<KDTreeNode>(Q->cspace->arena_,Q->cspace->start_);
     start->rrt_LMC_ = 0;
     shared_ptr<Edge> start_edge = Edge::NewEdge(Q->cspace,tree,start,start);
     start->rrt_parent_edge_ = start_edge;
     start->rrt_parent_used_ = true;
     tree->KDInsert(start);
 
-    shared_ptr<ListNode> osnode;
     {
         lock_guard<mutex> lock(Q->cspace->cspace_mutex_);
-        osnode = Q->cspace->obstacles_->front_;
-        while(osnode->child_ != osnode) {
+        ObstacleRegistry &obstacles = *Q->cspace->obstacles_;
+        for(int i = 0; i < obstacles.Size(); i++) {
             // below takes care of add loop in main
-            osnode->obstacle_->obstacle_used_ = true;
-            AddObstacle(tree,Q,osnode->obstacle_,tree->root);
-            osnode = osnode->child_;
+            obstacles[i]->obstacle_used_ = true;
+            AddObstacle(tree,Q,obstacles[i],tree->root);
         }
     }
 
@@ -77,6 +82,8 @@ vector<Eigen::VectorXd> ThetaStar(shared_ptr<Queue> Q)
     double x_width, y_width, angle;
     x_width = Q->cspace->width_(0);
     y_width = Q->cspace->width_(1);
+    vector<shared_ptr<KDTreeNode>> grid_nodes;
+    grid_nodes.reserve(x_width*y_width);
     for( int i = 0; i < x_width; i++ ) {
         for( int j = 0; j < y_width; j++ ) {
             if( i == 0 && j == 0 ) {
@@ -99,22 +106,25 @@ vector<Eigen::VectorXd> ThetaStar(shared_ptr<Queue> Q)
             this_point(0) = i;
             this_point(1) = j;
             this_point(2) = angle;
-            new_node = make_shared<KDTreeNode>(this_point);
+            new_node = MakeInArena<KDTreeNode>(Q->cspace->arena_,
+                                               this_point);
             // Use this KDTreeNode variable to hold the cost
             new_node->rrt_LMC_
                 = EuclideanDistance2D(new_node->position_.head(2),
                                          start->position_.head(2));
-            tree->KDInsert(new_node);      // this calls AddVizNode
-            tree->RemoveVizNode(new_node); // not visualizing
+            grid_nodes.push_back(new_node);
         }
     }
+    // The grid is not visualized
+    tree->KDBulkBuild(grid_nodes, false, false);
 
     shared_ptr<JList> node_list = make_shared<JList>(true); // uses KDTreeNodes
-    shared_ptr<JListNode> this_item = make_shared<JListNode>();
-    shared_ptr<KDTreeNode> near_node = make_shared<KDTreeNode>();
+    JListNode *this_item = NULL;
+    shared_ptr<KDTreeNode> near_node
+            = MakeInArena<KDTreeNode>(Q->cspace->arena_);
 
     // This is where the robot starts
-    shared_ptr<KDTreeNode> goal = make_shared<KDTreeNode>();
+    shared_ptr<KDTreeNode> goal = MakeInArena<KDTreeNode>(Q->cspace->arena_);
     double x_start = Q->cspace->goal_(0);
     double y_start = Q->cspace->goal_(1);
 
@@ -124,19 +134,27 @@ vector<Eigen::VectorXd> ThetaStar(shared_ptr<Queue> Q)
                     goal);
     goal->rrt_parent_edge_ = Edge::NewEdge(Q->cspace,tree,goal,goal);
 
-    open_set = make_shared<BinaryHeap>(false); // Priority Queue
-    open_set->AddToHeap(goal); // add starting position_
-    closed_set = make_shared<JList>(true); // Uses KDTreeNodes
+    // A new stamp empties the closed set (0 is what new nodes have)
+    if( ++closed_stamp == 0 ) closed_stamp = 1;
+
+    // Costs are distances on the grid, so unit buckets hold only a few
+    // nodes each
+    open_set = make_shared<BucketQueue>(sqrt(x_width*x_width
+                                             + y_width*y_width) + 1.0);
+    open_set->Add(goal, goal->rrt_LMC_); // add starting position_
 
 //    cout << "Searching for Best Any-Angle Path" << endl;
 
     shared_ptr<KDTreeNode> node, end_node, min_neighbor;
-    end_node = make_shared<KDTreeNode>(Eigen::Vector3d(-1,-1,-1));
+    end_node = MakeInArena<KDTreeNode>(Q->cspace->arena_,
+                                       Eigen::Vector3d(-1,-1,-1));
     end_node->rrt_parent_edge_
             = Edge::NewEdge(Q->cspace,tree,end_node,end_node);
     end_node->rrt_LMC_ = INF;
-    while(open_set->index_of_last_ > 0) {
-        open_set->PopHeap(node);
+    shared_ptr<KDTreeNode> no_neighbor
+            = MakeInArena<KDTreeNode>(Q->cspace->arena_);
+    no_neighbor->rrt_LMC_ = INF;
+    while(open_set->Pop(node)) {
 //        cout << "Node: " << node->rrt_LMC_ << "\n" << node->position_ << endl;
 
         if(node == start) {
@@ -146,13 +164,12 @@ vector<Eigen::VectorXd> ThetaStar(shared_ptr<Queue> Q)
             return path;
         }
 
-        closed_set->JListPush(node);
+        node->theta_closed_ = closed_stamp;
 
         // Find eight neighbors around this node
         tree->KDFindWithinRange(node_list,2,node->position_);
 //        cout << "8 neighbors: " << node_list->length_ << endl;
-        min_neighbor = make_shared<KDTreeNode>();
-        min_neighbor->rrt_LMC_ = INF;
+        min_neighbor = no_neighbor;
 
         // Iterate through neighbors
         this_item = node_list->front_;
@@ -167,7 +184,7 @@ vector<Eigen::VectorXd> ThetaStar(shared_ptr<Queue> Q)
 //                    cout << "11,4: " << near_node->rrt_LMC_ << endl;
 //            }
             // If the neighbor is not in the closed set
-            if(!closed_set->JListContains(near_node)) {
+            if(near_node->theta_closed_ != closed_stamp) {
 //                if(!open_set->marked(near_node)) {
 //                    cout << "near_node not marked" << endl;
 //                    near_node->rrt_LMC_ = INF;
@@ -183,9 +200,9 @@ vector<Eigen::VectorXd> ThetaStar(shared_ptr<Queue> Q)
             end_node->rrt_parent_used_ = true;
 
             if(open_set->marked(end_node)) {
-                open_set->RemoveFromHeap(end_node);
+                open_set->Remove(end_node);
             }
-            open_set->AddToHeap(end_node);
+            open_set->Add(end_node, end_node->rrt_LMC_);
         }
 
         tree->EmptyRangeList(node_list); // clean up
@@ -207,18 +224,20 @@ bool UpdateVertex(shared_ptr<Queue> Q,
                   shared_ptr<KDTreeNode> &min_neighbor)
 {
 //    cout << "\tUpdateVertex" << endl;
+    // Nothing to do unless neighbor beats the best so far, edges are
+    // only made once there is a line of sight
+    if(neighbor->rrt_LMC_ >= min_neighbor->rrt_LMC_) return false;
+
     shared_ptr<Edge> this_edge;
     if(node->rrt_parent_used_) {
         shared_ptr<KDTreeNode> current_node = node;
         while(current_node->rrt_parent_used_) {
-            current_node = current_node->rrt_parent_edge_->start_node_;
+            current_node = current_node->rrt_parent_edge_->start_node_->GetPointer();
 //            cout << "| ";
-            this_edge = Edge::NewEdge(Q->cspace,Tree,
-                                      current_node,
-                                      neighbor);
-            if(!LineCheck(Q->cspace,Tree,this_edge->start_node_,
-                          this_edge->end_node_)
-                    && neighbor->rrt_LMC_ < min_neighbor->rrt_LMC_) {
+            if(!LineCheck(Q->cspace,Tree,current_node,neighbor)) {
+                this_edge = Edge::NewEdge(Q->cspace,Tree,
+                                          current_node,
+                                          neighbor);
 //                if((EuclideanDistance2D(current_node->position_.head(2),
 //                                             neighbor->position_.head(2)) <
 //                        EuclideanDistance2D(current_node->position_.head(2),
@@ -234,9 +253,8 @@ bool UpdateVertex(shared_ptr<Queue> Q,
             }
         }
     }
-    this_edge = Edge::NewEdge(Q->cspace,Tree,node,neighbor);
-    if(!LineCheck(Q->cspace,Tree,this_edge->start_node_,this_edge->end_node_)
-            && neighbor->rrt_LMC_ < min_neighbor->rrt_LMC_) {
+    if(!LineCheck(Q->cspace,Tree,node,neighbor)) {
+        this_edge = Edge::NewEdge(Q->cspace,Tree,node,neighbor);
         min_neighbor = neighbor;
         min_neighbor->rrt_parent_edge_ = this_edge;
 //        cout << "Made\n" << node->position_
@@ -252,8 +270,9 @@ vector<Eigen::VectorXd> GetPath(shared_ptr<KDTreeNode> &node)
     path.push_back(node->position_);
     if(node->rrt_parent_edge_->start_node_
             != node->rrt_parent_edge_->end_node_) {
-        vector<Eigen::VectorXd> rec_path
-                = GetPath(node->rrt_parent_edge_->start_node_);
+        shared_ptr<KDTreeNode> parent
+                = node->rrt_parent_edge_->start_node_->GetPointer();
+        vector<Eigen::VectorXd> rec_path = GetPath(parent);
         for(int i = 0; i < rec_path.size(); i++) {
             path.push_back(rec_path.at(i));
         }
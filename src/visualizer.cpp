@@ -56,7 +56,7 @@ void visualizer(shared_ptr<KDTree> Tree,
     pangolin::DisplayBase().AddDisplay(view3d);
 
     // For the obstacles
-    List obstacles;
+    vector<shared_ptr<Obstacle>> obstacles;
     vector<Eigen::Vector2d> origins;
     shared_ptr<Obstacle> this_obstacle;
     shared_ptr<Obstacle> prev_obstacle;
@@ -66,11 +66,11 @@ void visualizer(shared_ptr<KDTree> Tree,
 
     {
         lock_guard<mutex> lock(Q->cspace->cspace_mutex_);
-        obstacles = *Q->cspace->obstacles_;
+        obstacles = Q->cspace->obstacles_->Obstacles();
     }
-    int num_obstacles = obstacles.length_;
+    int num_obstacles = obstacles.size();
     for(int i = 0; i < num_obstacles; i++) {
-        obstacles.ListPop(this_obstacle);
+        this_obstacle = obstacles[i];
         obstacle_pos = this_obstacle->GetPosition();
         polygon = new SceneGraph::GLLineStrip();
         for( int j = 0; j < obstacle_pos.rows(); j++) {
@@ -124,15 +124,15 @@ void visualizer(shared_ptr<KDTree> Tree,
         // Draw obstacles
         {
             lock_guard<mutex> lock(Q->cspace->cspace_mutex_);
-            obstacles = *Q->cspace->obstacles_;
+            obstacles = Q->cspace->obstacles_->Obstacles();
             moved = Q->cspace->obstacles_moved_;
         }
         if(move_switch && !moved) move_switch = false;
-        num_obstacles = obstacles.length_;
+        num_obstacles = obstacles.size();
         if(moved /*&& !move_switch*/) {
 
             for(int i = 0; i < num_obstacles; i++) {
-                obstacles.ListPop(this_obstacle);
+                this_obstacle = obstacles[i];
                 obstacle_pos = this_obstacle->GetPosition();
                 polygon = new SceneGraph::GLLineStrip();
                 for( int j = 0; j < obstacle_pos.rows(); j++) {
@@ -182,7 +182,7 @@ void visualizer(shared_ptr<KDTree> Tree,
                     shared_ptr<KDTreeNode> node = make_shared<KDTreeNode>();
                     shared_ptr<double> dist = make_shared<double>(INF);
                     Tree->KDFindNearest(node,dist,Robot->robot_pose);
-                    Eigen::MatrixXd traj = node->rrt_parent_edge_->trajectory_;
+                    Eigen::MatrixXd traj = node->rrt_parent_edge_->Trajectory();
                     traj_lines = vector<SceneGraph::GLLineStrip*>(traj.rows());
                     while(node->rrt_parent_used_) {
                         traj_line = new SceneGraph::GLLineStrip();
@@ -198,7 +198,7 @@ void visualizer(shared_ptr<KDTree> Tree,
                         traj_line->SetColor(SceneGraph::GLColor(Eigen::Vector4d(0.5,1,1,1)));
                         traj_lines.push_back(traj_line);
                         glGraph.AddChild(traj_line);
-                        node = node->rrt_parent_edge_->end_node_;
+                        node = node->rrt_parent_edge_->end_node_->GetPointer();
                     }
                 }
             }
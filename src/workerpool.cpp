@@ -0,0 +1,61 @@
+#include <DRRT/workerpool.h>
+
+WorkerPool::WorkerPool(int threads)
+    : job_(NULL), generation_(0), running_(0), stop_(false)
+{
+    for( int i = 1; i < threads; i++ ) {
+        this->threads_.push_back(std::thread(&WorkerPool::Work, this, i));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->stop_ = true;
+    }
+    this->start_.notify_all();
+    for( int i = 0; i < (int)this->threads_.size(); i++ ) {
+        this->threads_[i].join();
+    }
+}
+
+void WorkerPool::Run(const std::function<void(int)> &job)
+{
+    std::lock_guard<std::mutex> run_lock(this->run_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->job_ = &job;
+        this->running_ = (int)this->threads_.size();
+        this->generation_++;
+    }
+    this->start_.notify_all();
+
+    job(0);
+
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    while( this->running_ > 0 ) this->finished_.wait(lock);
+    this->job_ = NULL;
+}
+
+void WorkerPool::Work(int index)
+{
+    long seen = 0; // the last job this thread ran
+    while( true ) {
+        const std::function<void(int)> *job;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex_);
+            while( !this->stop_ && this->generation_ == seen ) {
+                this->start_.wait(lock);
+            }
+            if( this->stop_ ) return;
+            seen = this->generation_;
+            job = this->job_;
+        }
+
+        (*job)(index);
+
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        if( --this->running_ == 0 ) this->finished_.notify_one();
+    }
+}